@@ -0,0 +1,100 @@
+/*
+// Source file for the CacheArena class, see cache_arena.h.
+*/
+
+#include "cache_arena.h"
+
+#include <stdexcept>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Rounds size up to a multiple of the power of two align, at least one
+static size_t round_up(size_t size, size_t align) {
+    return size == 0 ? align : (size + align - 1) & ~(align - 1);
+}
+
+// Maps size anonymous bytes with the extra flags, NULL if that fails
+static void *map_anonymous(size_t size, int flags) {
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+void *CacheArena::allocate(size_t size, Pages pages) {
+    release();
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t map_size = round_up(size, page_size);
+    void *data = NULL;
+
+    if (pages == PAGES_HUGE) {
+#ifdef MAP_HUGETLB
+        map_size = round_up(size, HUGE_PAGE_SIZE);
+        data = map_anonymous(map_size, MAP_HUGETLB);
+#endif
+        if (data == NULL) {
+            throw runtime_error("Unable to map " + to_string(map_size) + " B of huge pages for a cache, "
+                                "reserve them in /proc/sys/vm/nr_hugepages or use --cache-pages=thp");
+        }
+    } else if (pages == PAGES_TRANSPARENT && size >= HUGE_PAGE_SIZE) {
+        // Map a huge page more than needed and trim it to a 2 MB boundary,
+        // the kernel only backs aligned 2 MB ranges with huge pages
+        map_size = round_up(size, HUGE_PAGE_SIZE);
+        char *map = (char *)map_anonymous(map_size + HUGE_PAGE_SIZE, 0);
+        if (map != NULL) {
+            char *aligned = (char *)round_up((uintptr_t)map, HUGE_PAGE_SIZE);
+            if (aligned > map) {
+                munmap(map, aligned - map);
+            }
+            munmap(aligned + map_size, map + HUGE_PAGE_SIZE - aligned);
+            data = aligned;
+#ifdef MADV_HUGEPAGE
+            madvise(data, map_size, MADV_HUGEPAGE);
+#endif
+        }
+    } else {
+        data = map_anonymous(map_size, 0);
+    }
+    if (data == NULL) {
+        throw runtime_error("Unable to map " + to_string(map_size) + " B for a cache");
+    }
+
+    m_data = data;
+    m_size = size;
+    m_map_size = map_size;
+    m_pages = pages;
+    return m_data;
+}
+
+void CacheArena::release() {
+    if (m_data != NULL) {
+        munmap(m_data, m_map_size);
+        m_data = NULL;
+        m_size = 0;
+        m_map_size = 0;
+    }
+}
+
+void CacheArena::print(ostream &out, const string &name) const {
+    out << name << ": " << m_size << " B of tag store, " << m_map_size << " B of host memory, "
+        << get_pages_name(m_pages) << " pages" << endl;
+}
+
+CacheArena::Pages CacheArena::get_pages_by_name(const string &name) {
+    if (name == "normal") {
+        return PAGES_NORMAL;
+    } else if (name == "thp") {
+        return PAGES_TRANSPARENT;
+    } else if (name == "huge") {
+        return PAGES_HUGE;
+    }
+    throw runtime_error("Unknown kind of pages for the caches: " + name + ", expected normal, thp or huge");
+}
+
+const char *CacheArena::get_pages_name(Pages pages) {
+    return pages == PAGES_HUGE ? "huge" : pages == PAGES_TRANSPARENT ? "thp" : "normal";
+}
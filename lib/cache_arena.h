@@ -0,0 +1,75 @@
+/*
+// Header file for the CacheArena class, the storage of the tag store of one
+// simulated cache (see CacheArray in cache_kernel.h): the tags, replacement
+// state and valid and dirty bits of all sets live in one contiguous block
+// instead of one allocation per set behind a table of pointers, so a lookup
+// is a single index and a simulation of many cores with large caches does
+// not scatter thousands of small blocks over the heap. The block comes
+// straight from mmap: it is aligned to pages, so to host cache lines,
+// zeroed, and backed by host memory only once touched.
+//
+// The pages are chosen with --cache-pages (see cache_config.h):
+//   normal  Pages of the host's base size
+//   thp     Transparent huge pages: blocks of 2 MB or more are aligned to
+//           2 MB and the kernel is asked to back them with huge pages, which
+//           it may or may not do
+//   huge    Explicit 2 MB huge pages (MAP_HUGETLB), the block is rounded up
+//           to whole huge pages. They have to be reserved beforehand, e.g.
+//           echo 512 > /proc/sys/vm/nr_hugepages
+*/
+
+#ifndef CACHE_ARENA_H
+#define CACHE_ARENA_H
+
+#include <stddef.h>
+#include <ostream>
+#include <string>
+
+class CacheArena {
+    public:
+    enum Pages { PAGES_NORMAL, PAGES_TRANSPARENT, PAGES_HUGE };
+
+    CacheArena() : m_data(NULL), m_size(0), m_map_size(0), m_pages(PAGES_NORMAL) {}
+    ~CacheArena() { release(); }
+
+    /*
+     * Frees the current block and maps a zeroed one of size bytes with
+     * pages, returns its start. Throws a runtime_error if the memory cannot
+     * be mapped, for huge pages also if none are reserved.
+     */
+    void *allocate(size_t size, Pages pages);
+
+    // Allocates n zeroed objects of type T, see allocate()
+    template <class T>
+    T *allocate_array(size_t n, Pages pages) {
+        return (T *)allocate(n * sizeof(T), pages);
+    }
+
+    // Frees the block, if there is one
+    void release();
+
+    void *get_data() const { return m_data; }
+    size_t get_size() const { return m_size; }
+    size_t get_map_size() const { return m_map_size; } // Host memory mapped for the block
+    Pages get_pages() const { return m_pages; }
+
+    // Prints the size of the tag store and its host memory, one line with
+    // name in front
+    void print(std::ostream &out, const std::string &name) const;
+
+    // Returns the Pages for name (normal, thp or huge), throws a
+    // runtime_error for other names
+    static Pages get_pages_by_name(const std::string &name);
+    static const char *get_pages_name(Pages pages);
+
+    private:
+    void *m_data;
+    size_t m_size;
+    size_t m_map_size; // size rounded up to whole pages
+    Pages m_pages;
+
+    // No copies are allowed.
+    CacheArena(const CacheArena &a);
+};
+
+#endif
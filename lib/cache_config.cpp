@@ -0,0 +1,166 @@
+/*
+// Source file for the cache configuration of the simulators, see
+// cache_config.h for the options.
+*/
+
+#include "cache_config.h"
+#include "cache_policy.h"
+#include "params.h"
+
+#include <ctype.h>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+static CacheConfig default_config() {
+    CacheConfig config;
+    config.dcache.init("cache", 32768, 8, 32);
+    config.icache.init("icache", 32768, 4, 64);
+    config.dcache_policy = "lru";
+    config.icache_policy = "lru";
+    config.pages = CacheArena::PAGES_NORMAL;
+    config.hit_latency = 1;
+    config.mem_latency = 100;
+    return config;
+}
+
+CacheConfig cache_config = default_config();
+
+void CacheGeometry::init(const string &name, uint64_t size, uint64_t set_assoc, uint64_t line_size) {
+    if (line_size == 0 || (line_size & (line_size - 1)) != 0) {
+        throw runtime_error("The line size of the " + name + " must be a power of two: " +
+                            to_string(line_size));
+    }
+    if (set_assoc == 0 || size / line_size / set_assoc == 0) {
+        throw runtime_error("The " + name + " needs room for at least one set of " +
+                            to_string(set_assoc) + " lines");
+    }
+    if (size % (line_size * set_assoc) != 0) {
+        throw runtime_error("The size of the " + name + " must be a whole number of sets of " +
+                            to_string(set_assoc) + " lines of " + to_string(line_size) + " B: " +
+                            to_string(size));
+    }
+    this->size = size;
+    this->set_assoc = set_assoc;
+    this->line_size = line_size;
+    n_sets = size / line_size / set_assoc;
+    line_shift = 0;
+    while ((1ULL << line_shift) < line_size) {
+        line_shift++;
+    }
+    sets_pow2 = (n_sets & (n_sets - 1)) == 0;
+    set_mask = sets_pow2 ? n_sets - 1 : 0;
+}
+
+// Returns true for the options of the cache configuration
+static bool is_config_option(const char *arg) {
+    return !strncmp(arg, "--cache-", 8) || !strncmp(arg, "--icache-", 9) ||
+           !strncmp(arg, "--hit-latency=", 14) || !strncmp(arg, "--mem-latency=", 14);
+}
+
+// Stores name=value in params, throws a runtime_error if there is no =
+static void set_option(Params &params, const string &option) {
+    size_t eq = option.find('=');
+    if (eq == string::npos || eq == 0) {
+        throw runtime_error("Error, expected name=value in the cache configuration: " + option);
+    }
+    params.set(option.substr(0, eq), option.substr(eq + 1));
+}
+
+// Reads the options of a configuration file into params
+static void read_config(Params &params, const string &filename) {
+    ifstream input(filename.c_str());
+    if (!input.is_open()) {
+        throw runtime_error("Unable to open file: " + filename);
+    }
+    string line;
+    while (getline(input, line)) {
+        line = line.substr(0, line.find('#'));
+        string option;
+        for (size_t i = 0; i < line.size(); i++) {
+            if (!isspace((unsigned char)line[i])) {
+                option += line[i];
+            }
+        }
+        if (!option.empty()) {
+            set_option(params, option);
+        }
+    }
+}
+
+// Returns the replacement policy set for name, def if it is not set. Throws
+// a runtime_error if the policy does not exist or does not fit geometry.
+static string get_policy(Params &params, const string &name, const string &def,
+                         const CacheGeometry &geometry) {
+    string policy = params.get_string(name, def);
+    delete ReplacementPolicy::create(policy, geometry.n_sets, geometry.set_assoc);
+    return policy;
+}
+
+// Returns a latency in cycles, at least 1 as SystemC cannot wait 0 cycles
+static int get_latency(Params &params, const string &name, int def) {
+    uint64_t v = params.get_count(name, def);
+    if (v == 0 || v > INT32_MAX) {
+        throw runtime_error("Invalid value for " + name + ": " + to_string(v));
+    }
+    return (int)v;
+}
+
+void init_cache_config(int *argc, char **argv[]) {
+    char **args = *argv;
+    int kept = 1;
+
+    // Options on the command line override those of a configuration file
+    Params params;
+    vector<string> options;
+    for (int i = 1; i < *argc; i++) {
+        if (!strncmp(args[i], "--cache-config=", 15)) {
+            read_config(params, args[i] + 15);
+        } else if (is_config_option(args[i])) {
+            options.push_back(args[i] + 2);
+        } else {
+            args[kept++] = args[i];
+        }
+    }
+    for (size_t i = 0; i < options.size(); i++) {
+        set_option(params, options[i]);
+    }
+
+    const CacheConfig def = default_config();
+    CacheConfig config;
+    config.dcache.init("cache", params.get_count("cache-size", def.dcache.size),
+                       params.get_count("cache-assoc", def.dcache.set_assoc),
+                       params.get_count("cache-line", def.dcache.line_size));
+    config.icache.init("icache", params.get_count("icache-size", def.icache.size),
+                       params.get_count("icache-assoc", def.icache.set_assoc),
+                       params.get_count("icache-line", def.icache.line_size));
+    config.dcache_policy = get_policy(params, "cache-policy", def.dcache_policy, config.dcache);
+    config.icache_policy = get_policy(params, "icache-policy", def.icache_policy, config.icache);
+    config.pages = CacheArena::get_pages_by_name(
+        params.get_string("cache-pages", CacheArena::get_pages_name(def.pages)));
+    config.hit_latency = get_latency(params, "hit-latency", def.hit_latency);
+    config.mem_latency = get_latency(params, "mem-latency", def.mem_latency);
+    params.check_used("the cache configuration");
+    cache_config = config;
+
+    *argc = kept;
+    args[kept] = NULL;
+}
+
+// Prints one cache of the configuration
+static void print_geometry(ostream &out, const char *name, const CacheGeometry &g, const string &policy) {
+    out << name << ": " << g.size << " B, " << g.set_assoc << "-way, " << g.line_size
+        << " B lines, " << g.n_sets << " sets, " << policy << endl;
+}
+
+void print_cache_config(ostream &out) {
+    out << "Cache configuration" << endl;
+    print_geometry(out, "  D-cache", cache_config.dcache, cache_config.dcache_policy);
+    print_geometry(out, "  I-cache", cache_config.icache, cache_config.icache_policy);
+    out << "  Hit latency: " << cache_config.hit_latency << " cycles, memory latency: "
+        << cache_config.mem_latency << " cycles" << endl;
+    out << "  Host pages: " << CacheArena::get_pages_name(cache_config.pages) << endl;
+}
@@ -0,0 +1,79 @@
+/*
+// Header file for the cache configuration of the simulators: the geometry
+// of the data and instruction caches and the latencies, chosen at startup
+// so a design space can be swept without recompiling. The defaults are the
+// caches the assignments were written for. Options, which may appear
+// anywhere on the command line:
+//   --cache-size=BYTES    --cache-assoc=WAYS    --cache-line=BYTES
+//   --icache-size=BYTES   --icache-assoc=WAYS   --icache-line=BYTES
+//   --cache-policy=NAME   --icache-policy=NAME  Replacement policy (lru), see
+//                                              cache_policy.h
+//   --cache-pages=KIND    Host pages for the lines of all caches: normal,
+//                         thp or huge (normal), see cache_arena.h
+//   --hit-latency=CYCLES  A cache hit (1)
+//   --mem-latency=CYCLES  A request served by main memory (100)
+//   --cache-config=FILE   Reads the options from FILE, one name=value per
+//                         line without the leading --, # starts a comment
+// Sizes may end in K or M (powers of 1024). Line sizes must be powers of
+// two, every cache needs at least one set and its size must be a whole
+// number of sets. With a power of two number
+// of sets the set index is a mask, as with the compile-time constants.
+*/
+
+#ifndef CACHE_CONFIG_H
+#define CACHE_CONFIG_H
+
+#include "psa.h"
+#include "cache_arena.h"
+
+#include <ostream>
+#include <string>
+
+struct CacheGeometry {
+    uint64_t size;      // Byte
+    uint64_t set_assoc;
+    uint64_t line_size; // Byte
+    uint64_t n_sets;
+    uint32_t line_shift; // log2(line_size)
+    uint64_t set_mask;   // n_sets - 1 if sets_pow2
+    bool sets_pow2;      // n_sets is a power of two
+
+    /*
+     * Sets up the geometry, throws a runtime_error, naming the cache by
+     * name, if the line size is not a power of two, there is no set or size
+     * is not a whole number of sets.
+     */
+    void init(const std::string &name, uint64_t size, uint64_t set_assoc, uint64_t line_size);
+
+    uint64_t block_addr(uint64_t addr) const { return addr >> line_shift; }
+    uint64_t set_index(uint64_t block_addr) const {
+        return sets_pow2 ? block_addr & set_mask : block_addr % n_sets;
+    }
+};
+
+struct CacheConfig {
+    CacheGeometry dcache;
+    CacheGeometry icache;
+    std::string dcache_policy; // Name for ReplacementPolicy::create()
+    std::string icache_policy;
+    CacheArena::Pages pages; // Of the CacheArena of every cache
+    int hit_latency; // Cycles
+    int mem_latency;
+};
+
+// The configuration of the simulation, the defaults until
+// init_cache_config() is called
+extern CacheConfig cache_config;
+
+/*
+ * Sets cache_config from the options above and removes them from argc/argv,
+ * like init_tracefile(). Throws a runtime_error for unknown --cache-,
+ * --icache- options, invalid values, policies that do not fit their cache
+ * and configuration files that cannot be read.
+ */
+void init_cache_config(int *argc, char **argv[]);
+
+// Prints cache_config, so results list the configuration they came from
+void print_cache_config(std::ostream &out);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+// Source file for the cache kernels, see cache_kernel.h. The table below
+// holds the specialized instantiations; a geometry that is not in it runs
+// on the generic kernel.
+*/
+
+#include "cache_kernel.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+#define CACHE_KERNEL(LINE, SETS, WAYS) \
+    { LINE, SETS, WAYS, &CacheKernel<LINE, SETS, WAYS>::access, &CacheKernel<LINE, SETS, WAYS>::run, \
+      &CacheKernel<LINE, SETS, WAYS>::probe_cache, &CacheKernel<LINE, SETS, WAYS>::refresh_lu_time, \
+      &CacheKernel<LINE, SETS, WAYS>::allocate }
+
+#define CACHE_KERNELS_FOR_WAYS(LINE, WAYS) \
+    CACHE_KERNEL(LINE, 64, WAYS), CACHE_KERNEL(LINE, 128, WAYS), CACHE_KERNEL(LINE, 256, WAYS), \
+    CACHE_KERNEL(LINE, 512, WAYS), CACHE_KERNEL(LINE, 1024, WAYS), CACHE_KERNEL(LINE, 2048, WAYS), \
+    CACHE_KERNEL(LINE, 4096, WAYS), CACHE_KERNEL(LINE, 8192, WAYS), CACHE_KERNEL(LINE, 16384, WAYS)
+
+#define CACHE_KERNELS_FOR_LINE(LINE) \
+    CACHE_KERNELS_FOR_WAYS(LINE, 1), CACHE_KERNELS_FOR_WAYS(LINE, 2), CACHE_KERNELS_FOR_WAYS(LINE, 4), \
+    CACHE_KERNELS_FOR_WAYS(LINE, 8), CACHE_KERNELS_FOR_WAYS(LINE, 16), CACHE_KERNELS_FOR_WAYS(LINE, 32)
+
+static const CacheArray::Kernel kernels[] = {
+    CACHE_KERNELS_FOR_LINE(32),
+    CACHE_KERNELS_FOR_LINE(64),
+};
+
+static const CacheArray::Kernel generic_kernel = CACHE_KERNEL(0, 0, 0);
+
+const CacheArray::Kernel *CacheArray::get_kernels(size_t &n) {
+    n = sizeof(kernels) / sizeof(kernels[0]);
+    return kernels;
+}
+
+void CacheArray::init(const CacheGeometry &geometry, const string &policy, bool specialize) {
+    if (geometry.set_assoc > 64) {
+        throw runtime_error("The cache kernels support at most 64 ways, not " +
+                            to_string(geometry.set_assoc));
+    }
+    ReplacementPolicy *p = NULL;
+    if (policy != "lru") {
+        p = ReplacementPolicy::create(policy, geometry.n_sets, geometry.set_assoc);
+    }
+    delete m_policy;
+    m_policy = p;
+    m_geometry = geometry;
+    m_kernel = &generic_kernel;
+    for (size_t i = 0; specialize && i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        const Kernel &k = kernels[i];
+        if (k.line_size == geometry.line_size && k.n_sets == geometry.n_sets &&
+            k.set_assoc == geometry.set_assoc) {
+            m_kernel = &k;
+            break;
+        }
+    }
+    // The arena is zeroed, so every line starts out invalid and clean
+    uint64_t lines = geometry.n_sets * geometry.set_assoc;
+    m_tags = m_arena.allocate_array<uint64_t>(2 * lines + 2 * geometry.n_sets, cache_config.pages);
+    m_lu_times = m_tags + lines;
+    m_valid = m_lu_times + lines;
+    m_dirty = m_valid + geometry.n_sets;
+    m_time = 0;
+}
@@ -0,0 +1,316 @@
+/*
+// Header file for the cache kernels: the tag store of one set-associative
+// cache with write allocate, write back and a replacement policy (LRU by
+// default, see cache_policy.h), as the caches of the simulators, without
+// timing. Models that run many accesses outside of SystemC, like the
+// L1Filter, call access() per line. The simulators, which spend cycles
+// between the lookup of a line and its fill, call the steps of access() one
+// by one: probe(), refresh(), fill() and invalidate() on snooped writes. All
+// of them make the same hit and eviction decisions.
+//
+// The kernel, probe_cache(), allocate() and refresh_lu_time(), is a template
+// on the line size, the number of sets and the associativity, so the block
+// address is a shift, the set index a mask and the loop over the ways has a
+// fixed trip count the compiler can unroll. A parameter of 0 is read from
+// the geometry at runtime instead, CacheKernel<0, 0, 0> is the generic
+// kernel. CacheArray::init() picks a prebuilt instantiation for the common
+// geometries (32 or 64 byte lines, 1 to 32 ways, 64 to 16384 sets) and the
+// generic kernel for any other geometry. cache_bench compares the two.
+//
+// The tag store is a structure of arrays: the tags and the last use times
+// of the ways of a set are contiguous, and the valid and dirty bits of a set
+// are bitmasks, so a cache holds at most 64 ways. A lookup compares the tag
+// with all ways of the set at once and turns the result into a bitmask, as
+// does the search for the least recently used way, with AVX2 or SSE4.2
+// when the compiler targets them (see SIMD_FLAGS in the Makefile) and with
+// scalar code otherwise. LRU runs on the last use times of the tag store,
+// the other policies keep their own state and are called per access. The
+// tag store lives in a CacheArena with the pages of --cache-pages.
+*/
+
+#ifndef CACHE_KERNEL_H
+#define CACHE_KERNEL_H
+
+#include "cache_arena.h"
+#include "cache_config.h"
+#include "cache_policy.h"
+
+#include <ostream>
+#include <string>
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+// Returns a mask with bit i set where values[i] == value, for the first n
+// values, n at most 64
+inline uint64_t match_ways(const uint64_t *values, uint64_t value, uint64_t n) {
+    uint64_t mask = 0;
+    uint64_t i = 0;
+#if defined(__AVX2__)
+    __m256i v4 = _mm256_set1_epi64x(value);
+    for (; i + 4 <= n; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(values + i)), v4);
+        mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+    }
+#endif
+#if defined(__SSE4_2__)
+    __m128i v2 = _mm_set1_epi64x(value);
+    for (; i + 2 <= n; i += 2) {
+        __m128i eq = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(values + i)), v2);
+        mask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+    }
+#endif
+    for (; i < n; i++) {
+        mask |= (uint64_t)(values[i] == value) << i;
+    }
+    return mask;
+}
+
+// Returns the smallest of the first n values, which are below 2^63, n at
+// least 1
+inline uint64_t min_way(const uint64_t *values, uint64_t n) {
+    uint64_t min = UINT64_MAX;
+    uint64_t i = 0;
+#if defined(__AVX2__)
+    if (n >= 4) {
+        __m256i m4 = _mm256_loadu_si256((const __m256i *)values);
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(values + i));
+            m4 = _mm256_blendv_epi8(m4, v, _mm256_cmpgt_epi64(m4, v));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, m4);
+        for (int k = 0; k < 4; k++) {
+            min = lanes[k] < min ? lanes[k] : min;
+        }
+    }
+#endif
+#if defined(__SSE4_2__)
+    if (n - i >= 2) {
+        __m128i m2 = _mm_loadu_si128((const __m128i *)(values + i));
+        for (i += 2; i + 2 <= n; i += 2) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+            m2 = _mm_blendv_epi8(m2, v, _mm_cmpgt_epi64(m2, v));
+        }
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i *)lanes, m2);
+        for (int k = 0; k < 2; k++) {
+            min = lanes[k] < min ? lanes[k] : min;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        min = values[i] < min ? values[i] : min;
+    }
+    return min;
+}
+
+template <uint64_t LINE_SIZE, uint64_t N_SETS, uint64_t WAYS>
+struct CacheKernel;
+
+class CacheArray {
+    public:
+    struct Result {
+        bool hit;
+        bool writeback; // A dirty line was evicted
+        uint64_t victim; // Block address of the evicted line if writeback
+    };
+
+    // An instantiation of the kernel, for the geometry given by line_size,
+    // n_sets and set_assoc; 0 for those read at runtime
+    struct Kernel {
+        uint64_t line_size;
+        uint64_t n_sets;
+        uint64_t set_assoc;
+        Result (*access)(CacheArray &c, uint64_t block_addr, bool is_write);
+        uint64_t (*run)(CacheArray &c, const uint64_t *addrs, const bool *writes, size_t n);
+        uint64_t (*probe)(const CacheArray &c, uint64_t set, uint64_t block_addr, bool &hit);
+        void (*refresh)(CacheArray &c, uint64_t set, uint64_t way);
+        Result (*allocate)(CacheArray &c, uint64_t set, uint64_t way, uint64_t block_addr, bool is_write);
+    };
+
+    CacheArray()
+    : m_kernel(NULL), m_policy(NULL), m_tags(NULL), m_lu_times(NULL), m_valid(NULL), m_dirty(NULL),
+      m_time(0) {}
+    ~CacheArray() { delete m_policy; }
+
+    /*
+     * Empties the cache and sets it up with geometry and the replacement
+     * policy called policy, using the specialized kernel for the geometry
+     * if there is one and specialize is set. The tag store is mapped with
+     * cache_config.pages. Throws a runtime_error for more than 64 ways,
+     * policies that do not exist or do not fit and tag stores that cannot
+     * be mapped.
+     */
+    void init(const CacheGeometry &geometry, const std::string &policy = "lru", bool specialize = true);
+
+    /*
+     * Accesses the line with block address block_addr: refreshes it on a
+     * hit and allocates it on a miss, evicting the line the replacement
+     * policy picks if the set is full. A write marks the line dirty.
+     */
+    Result access(uint64_t block_addr, bool is_write) {
+        return m_kernel->access(*this, block_addr, is_write);
+    }
+
+    // Accesses the lines of the n byte addresses addrs, writes where writes
+    // is set, and returns the number of misses
+    uint64_t run(const uint64_t *addrs, const bool *writes, size_t n) {
+        return m_kernel->run(*this, addrs, writes, n);
+    }
+
+    // The steps of access(), for models that spend time between them. Set
+    // is the set index of block_addr and way a way of that set.
+
+    // Returns the way of set that holds block_addr and sets hit, or else the
+    // way a fill takes: the first empty way or the victim of the replacement
+    // policy. Changes nothing, so the answer holds until the set changes.
+    uint64_t probe(uint64_t set, uint64_t block_addr, bool &hit) const {
+        return m_kernel->probe(*this, set, block_addr, hit);
+    }
+
+    // Tells the replacement policy about a hit on way
+    void refresh(uint64_t set, uint64_t way) { m_kernel->refresh(*this, set, way); }
+
+    // Fills way with block_addr, dirty for a write, returns what was evicted
+    Result fill(uint64_t set, uint64_t way, uint64_t block_addr, bool is_write) {
+        return m_kernel->allocate(*this, set, way, block_addr, is_write);
+    }
+
+    void set_dirty(uint64_t set, uint64_t way) { m_dirty[set] |= 1ULL << way; }
+
+    // Invalidates way, which then is the first to be filled
+    void invalidate(uint64_t set, uint64_t way) {
+        m_valid[set] &= ~(1ULL << way);
+        m_dirty[set] &= ~(1ULL << way);
+        if (m_policy != NULL) {
+            m_policy->invalidate(set, way);
+        }
+    }
+
+    // Returns true if way is valid and holds block_addr
+    bool holds(uint64_t set, uint64_t way, uint64_t block_addr) const {
+        return is_valid(set, way) && get_tag(set, way) == block_addr;
+    }
+
+    uint64_t get_tag(uint64_t set, uint64_t way) const { return m_tags[set * m_geometry.set_assoc + way]; }
+    bool is_valid(uint64_t set, uint64_t way) const { return (m_valid[set] >> way) & 1; }
+    bool is_dirty(uint64_t set, uint64_t way) const { return (m_dirty[set] >> way) & 1; }
+
+    // Prints the host memory of the tag store, see CacheArena::print()
+    void print_memory(std::ostream &out, const std::string &name) const { m_arena.print(out, name); }
+
+    const CacheGeometry &get_geometry() const { return m_geometry; }
+    bool is_specialized() const { return m_kernel->line_size != 0; }
+    const char *get_policy_name() const { return m_policy != NULL ? m_policy->get_name() : "lru"; }
+
+    // The specialized kernels, in the order they are looked up
+    static const Kernel *get_kernels(size_t &n);
+
+    private:
+    template <uint64_t LINE_SIZE, uint64_t N_SETS, uint64_t WAYS>
+    friend struct CacheKernel;
+
+    CacheGeometry m_geometry;
+    const Kernel *m_kernel;
+    ReplacementPolicy *m_policy; // NULL for LRU, which uses m_lu_times
+    CacheArena m_arena;   // Holds the arrays below, one after the other
+    uint64_t *m_tags;     // Block addresses, set_assoc per set
+    uint64_t *m_lu_times; // Last use of the ways, set_assoc per set
+    uint64_t *m_valid;    // Bit i for way i, one mask per set
+    uint64_t *m_dirty;
+    uint64_t m_time;      // Number of line accesses, the LRU clock
+
+    // No copies are allowed.
+    CacheArray(const CacheArray &c);
+};
+
+template <uint64_t LINE_SIZE, uint64_t N_SETS, uint64_t WAYS>
+struct CacheKernel {
+    static uint64_t ways(const CacheArray &c) {
+        return WAYS ? WAYS : c.m_geometry.set_assoc;
+    }
+
+    // Mask with a bit for every way of a set
+    static uint64_t way_mask(const CacheArray &c) {
+        return ways(c) == 64 ? UINT64_MAX : (1ULL << ways(c)) - 1;
+    }
+
+    static uint64_t block_addr(const CacheArray &c, uint64_t addr) {
+        return LINE_SIZE ? addr / LINE_SIZE : c.m_geometry.block_addr(addr);
+    }
+
+    // N_SETS is a power of two, see cache_kernel.cpp
+    static uint64_t set_index(const CacheArray &c, uint64_t block_addr) {
+        return N_SETS ? block_addr & (N_SETS - 1) : c.m_geometry.set_index(block_addr);
+    }
+
+    // Returns the way of set that holds block_addr and sets hit, or else
+    // the first empty way, or else the victim of the replacement policy
+    static uint64_t probe_cache(const CacheArray &c, uint64_t set, uint64_t block_addr, bool &hit) {
+        uint64_t valid = c.m_valid[set];
+        uint64_t hits = match_ways(&c.m_tags[set * ways(c)], block_addr, ways(c)) & valid;
+        hit = hits != 0;
+        if (hit) {
+            return __builtin_ctzll(hits);
+        }
+        uint64_t empty = ~valid & way_mask(c);
+        if (empty != 0) {
+            return __builtin_ctzll(empty);
+        }
+        if (c.m_policy != NULL) {
+            return c.m_policy->victim(set);
+        }
+        // The clock ticks on every access, so only one way has the oldest time
+        const uint64_t *lu_times = &c.m_lu_times[set * ways(c)];
+        return __builtin_ctzll(match_ways(lu_times, min_way(lu_times, ways(c)), ways(c)));
+    }
+
+    static void refresh_lu_time(CacheArray &c, uint64_t set, uint64_t way) {
+        if (c.m_policy != NULL) {
+            c.m_policy->hit(set, way);
+        } else {
+            c.m_lu_times[set * ways(c) + way] = ++c.m_time;
+        }
+    }
+
+    // Inserts block_addr into way of set, returns what was evicted
+    static CacheArray::Result allocate(CacheArray &c, uint64_t set, uint64_t way, uint64_t block_addr, bool is_write) {
+        uint64_t bit = 1ULL << way;
+        uint64_t &tag = c.m_tags[set * ways(c) + way];
+        CacheArray::Result r = { false, (c.m_valid[set] & c.m_dirty[set] & bit) != 0, tag };
+        tag = block_addr;
+        c.m_valid[set] |= bit;
+        c.m_dirty[set] = is_write ? c.m_dirty[set] | bit : c.m_dirty[set] & ~bit;
+        if (c.m_policy != NULL) {
+            c.m_policy->insert(set, way);
+        } else {
+            c.m_lu_times[set * ways(c) + way] = ++c.m_time;
+        }
+        return r;
+    }
+
+    static CacheArray::Result access(CacheArray &c, uint64_t block_addr, bool is_write) {
+        uint64_t set = set_index(c, block_addr);
+        bool hit;
+        uint64_t way = probe_cache(c, set, block_addr, hit);
+
+        if (hit) {
+            refresh_lu_time(c, set, way);
+            c.m_dirty[set] |= (uint64_t)is_write << way;
+            CacheArray::Result r = { true, false, 0 };
+            return r;
+        }
+        return allocate(c, set, way, block_addr, is_write);
+    }
+
+    static uint64_t run(CacheArray &c, const uint64_t *addrs, const bool *writes, size_t n) {
+        uint64_t misses = 0;
+        for (size_t i = 0; i < n; i++) {
+            misses += !access(c, block_addr(c, addrs[i]), writes[i]).hit;
+        }
+        return misses;
+    }
+};
+
+#endif
@@ -0,0 +1,284 @@
+/*
+// Source file for the replacement policies, see cache_policy.h.
+*/
+
+#include "cache_policy.h"
+
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static const uint64_t POLICY_SEED = 0x5EED;
+static const uint32_t BIMODAL_THROTTLE = 32; // One in 32 fills is treated as recent
+static const uint8_t RRPV_MAX = 3;           // 2-bit re-reference prediction values
+static const uint64_t DUEL_PERIOD = 64;      // One leader set of each policy per 64 sets
+static const uint32_t PSEL_MAX = 1023;       // 10-bit policy selector
+
+// SplitMix64, as the trace generators
+static inline uint64_t next_random(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Ranks the ways of every set from 0, the most recent, to ways - 1, the
+ * next victim. LRU moves a line to the front on every hit and fill, FIFO
+ * only on fills, BIP puts most fills at the back.
+ */
+class RankPolicy : public ReplacementPolicy {
+    public:
+    enum Kind { LRU, FIFO, DIP };
+
+    RankPolicy(Kind kind, uint64_t n_sets, uint64_t ways)
+    : m_kind(kind), m_ways(ways), m_ranks(n_sets * ways), m_rng(POLICY_SEED), m_psel(PSEL_MAX / 2),
+      m_period(n_sets < DUEL_PERIOD ? n_sets : DUEL_PERIOD) {
+        for (uint64_t i = 0; i < m_ranks.size(); i++) {
+            m_ranks[i] = i % ways;
+        }
+    }
+
+    uint32_t victim(uint64_t set) const {
+        const uint8_t *ranks = &m_ranks[set * m_ways];
+        for (uint32_t way = 0; way < m_ways; way++) {
+            if (ranks[way] == m_ways - 1) {
+                return way;
+            }
+        }
+        return 0; // The ranks are a permutation, not reached
+    }
+
+    void hit(uint64_t set, uint32_t way) {
+        if (m_kind != FIFO) {
+            promote(set, way);
+        }
+    }
+
+    void insert(uint64_t set, uint32_t way) {
+        if (m_kind != DIP || !use_bip(set)) {
+            promote(set, way);
+        } else if (next_random(m_rng) % BIMODAL_THROTTLE == 0) {
+            promote(set, way);
+        } else {
+            demote(set, way);
+        }
+    }
+
+    void invalidate(uint64_t set, uint32_t way) {
+        demote(set, way);
+    }
+
+    const char *get_name() const {
+        return m_kind == LRU ? "lru" : m_kind == FIFO ? "fifo" : "dip";
+    }
+
+    private:
+    Kind m_kind;
+    uint32_t m_ways;
+    std::vector<uint8_t> m_ranks;
+    uint64_t m_rng;
+    uint32_t m_psel;   // Above the middle once the LRU leaders missed more
+    uint64_t m_period;
+
+    // Moves way to rank 0
+    void promote(uint64_t set, uint32_t way) {
+        uint8_t *ranks = &m_ranks[set * m_ways];
+        uint8_t rank = ranks[way];
+        for (uint32_t i = 0; i < m_ways; i++) {
+            ranks[i] += ranks[i] < rank;
+        }
+        ranks[way] = 0;
+    }
+
+    // Moves way to the last rank
+    void demote(uint64_t set, uint32_t way) {
+        uint8_t *ranks = &m_ranks[set * m_ways];
+        uint8_t rank = ranks[way];
+        for (uint32_t i = 0; i < m_ways; i++) {
+            ranks[i] -= ranks[i] > rank;
+        }
+        ranks[way] = m_ways - 1;
+    }
+
+    // Counts the miss of a fill in a leader set and returns true if the
+    // fill uses BIP
+    bool use_bip(uint64_t set) {
+        uint64_t slot = set % m_period;
+        if (slot == 0) { // LRU leader
+            m_psel += m_psel < PSEL_MAX;
+            return false;
+        }
+        if (m_period > 1 && slot == m_period - 1) { // BIP leader
+            m_psel -= m_psel > 0;
+            return true;
+        }
+        return m_psel > PSEL_MAX / 2;
+    }
+};
+
+/*
+ * Tree pseudo-LRU. The bits of the inner nodes of a binary tree over the
+ * ways, node 1 the root and 2n, 2n + 1 the children of n, point towards the
+ * half to evict next: 0 left, 1 right.
+ */
+class TreePolicy : public ReplacementPolicy {
+    public:
+    TreePolicy(uint64_t n_sets, uint64_t ways) : m_ways(ways), m_bits(n_sets, 0) {
+        if ((ways & (ways - 1)) != 0) {
+            throw runtime_error("The plru policy needs a power of two number of ways, not " +
+                                to_string(ways));
+        }
+    }
+
+    uint32_t victim(uint64_t set) const {
+        uint64_t node = 1;
+        while (node < m_ways) {
+            node = 2 * node + ((m_bits[set] >> node) & 1);
+        }
+        return node - m_ways;
+    }
+
+    void hit(uint64_t set, uint32_t way) {
+        point(set, way, true);
+    }
+
+    void insert(uint64_t set, uint32_t way) {
+        point(set, way, true);
+    }
+
+    void invalidate(uint64_t set, uint32_t way) {
+        point(set, way, false);
+    }
+
+    const char *get_name() const {
+        return "plru";
+    }
+
+    private:
+    uint32_t m_ways;
+    std::vector<uint64_t> m_bits; // Bit n for node n
+
+    // Points the nodes above way away from it, or towards it
+    void point(uint64_t set, uint32_t way, bool away) {
+        uint64_t node = way + m_ways;
+        while (node > 1) {
+            uint64_t parent = node / 2;
+            bool right = (node & 1) != away; // Towards the sibling if away
+            m_bits[set] = (m_bits[set] & ~(1ULL << parent)) | ((uint64_t)right << parent);
+            node = parent;
+        }
+    }
+};
+
+/*
+ * Re-reference interval prediction with a 2-bit RRPV per way. A hit
+ * predicts a near re-reference (0). The victim is the first way with the
+ * largest RRPV; the RRPVs of the set age by what the filled way lacks to
+ * the maximum when the fill happens, as if the victim search had aged them.
+ */
+class RripPolicy : public ReplacementPolicy {
+    public:
+    RripPolicy(bool bimodal, uint64_t n_sets, uint64_t ways)
+    : m_bimodal(bimodal), m_ways(ways), m_rrpv(n_sets * ways, RRPV_MAX), m_rng(POLICY_SEED) {
+    }
+
+    uint32_t victim(uint64_t set) const {
+        const uint8_t *rrpv = &m_rrpv[set * m_ways];
+        uint32_t victim = 0;
+        for (uint32_t way = 1; way < m_ways; way++) {
+            victim = rrpv[way] > rrpv[victim] ? way : victim;
+        }
+        return victim;
+    }
+
+    void hit(uint64_t set, uint32_t way) {
+        m_rrpv[set * m_ways + way] = 0;
+    }
+
+    void insert(uint64_t set, uint32_t way) {
+        uint8_t *rrpv = &m_rrpv[set * m_ways];
+        uint8_t age = RRPV_MAX - rrpv[way];
+        for (uint32_t i = 0; i < m_ways; i++) {
+            rrpv[i] = rrpv[i] + age < RRPV_MAX ? rrpv[i] + age : RRPV_MAX;
+        }
+        bool distant = m_bimodal && next_random(m_rng) % BIMODAL_THROTTLE != 0;
+        rrpv[way] = distant ? RRPV_MAX : RRPV_MAX - 1;
+    }
+
+    void invalidate(uint64_t set, uint32_t way) {
+        m_rrpv[set * m_ways + way] = RRPV_MAX;
+    }
+
+    const char *get_name() const {
+        return m_bimodal ? "brrip" : "srrip";
+    }
+
+    private:
+    bool m_bimodal;
+    uint32_t m_ways;
+    std::vector<uint8_t> m_rrpv;
+    uint64_t m_rng;
+};
+
+// Evicts a random way, drawn anew whenever the victim of a set is filled
+class RandomPolicy : public ReplacementPolicy {
+    public:
+    RandomPolicy(uint64_t n_sets, uint64_t ways) : m_ways(ways), m_victims(n_sets), m_rng(POLICY_SEED) {
+        for (uint64_t i = 0; i < n_sets; i++) {
+            m_victims[i] = next_random(m_rng) % ways;
+        }
+    }
+
+    uint32_t victim(uint64_t set) const {
+        return m_victims[set];
+    }
+
+    void hit(uint64_t set, uint32_t way) {
+        (void)set;
+        (void)way;
+    }
+
+    void insert(uint64_t set, uint32_t way) {
+        if (way == m_victims[set]) {
+            m_victims[set] = next_random(m_rng) % m_ways;
+        }
+    }
+
+    void invalidate(uint64_t set, uint32_t way) {
+        (void)set;
+        (void)way;
+    }
+
+    const char *get_name() const {
+        return "random";
+    }
+
+    private:
+    uint32_t m_ways;
+    std::vector<uint8_t> m_victims;
+    uint64_t m_rng;
+};
+
+ReplacementPolicy *ReplacementPolicy::create(const string &name, uint64_t n_sets, uint64_t ways) {
+    if (ways == 0 || ways > 64) {
+        throw runtime_error("The replacement policies handle 1 to 64 ways, not " + to_string(ways));
+    }
+    if (name == "lru") {
+        return new RankPolicy(RankPolicy::LRU, n_sets, ways);
+    } else if (name == "fifo") {
+        return new RankPolicy(RankPolicy::FIFO, n_sets, ways);
+    } else if (name == "dip") {
+        return new RankPolicy(RankPolicy::DIP, n_sets, ways);
+    } else if (name == "plru") {
+        return new TreePolicy(n_sets, ways);
+    } else if (name == "srrip") {
+        return new RripPolicy(false, n_sets, ways);
+    } else if (name == "brrip") {
+        return new RripPolicy(true, n_sets, ways);
+    } else if (name == "random") {
+        return new RandomPolicy(n_sets, ways);
+    }
+    throw runtime_error("Unknown replacement policy: " + name);
+}
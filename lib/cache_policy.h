@@ -0,0 +1,62 @@
+/*
+// Header file for the replacement policies of the caches. A policy keeps
+// its own compact state for every set and is told about the hits, fills and
+// invalidations of the lines; the cache asks it for the way to evict once a
+// set is full. Empty ways are filled before anything is evicted, that is up
+// to the cache. The policies, chosen at startup with --cache-policy and
+// --icache-policy (see cache_config.h):
+//   lru     Least recently used, a rank per way
+//   fifo    The line filled first, the same ranks but hits leave them alone
+//   plru    Tree pseudo-LRU, ways - 1 bits per set, the number of ways has
+//           to be a power of two
+//   srrip   Static re-reference interval prediction, a 2-bit RRPV per way,
+//           lines are filled with a long re-reference interval (2)
+//   brrip   Bimodal RRIP, lines are filled with a distant interval (3) and
+//           only one in 32 with a long one
+//   random  A random way, drawn when the previous victim of the set is
+//           filled
+//   dip     Dynamic insertion: set dueling between LRU and the bimodal
+//           insertion policy BIP, which fills lines as least recently used
+//           and only one in 32 as most recently used. One set of every 64
+//           always runs LRU and one BIP, a 10-bit saturating counter of
+//           their misses picks the policy of the other sets.
+// All policies handle at most 64 ways. The random choices come from a fixed
+// seed, so simulations repeat exactly.
+*/
+
+#ifndef CACHE_POLICY_H
+#define CACHE_POLICY_H
+
+#include <stdint.h>
+#include <string>
+
+class ReplacementPolicy {
+    public:
+    virtual ~ReplacementPolicy() {}
+
+    /*
+     * Returns the way of the full set to evict. Does not change the state
+     * of the policy, so a cache may ask before it knows it will evict.
+     */
+    virtual uint32_t victim(uint64_t set) const = 0;
+
+    // A hit on the line in way of set
+    virtual void hit(uint64_t set, uint32_t way) = 0;
+
+    // A line was filled into way of set after a miss
+    virtual void insert(uint64_t set, uint32_t way) = 0;
+
+    // The line in way of set was invalidated
+    virtual void invalidate(uint64_t set, uint32_t way) = 0;
+
+    virtual const char *get_name() const = 0;
+
+    /*
+     * Creates the policy called name (see above) for a cache of n_sets sets
+     * of ways ways. Throws a runtime_error for unknown names and
+     * geometries the policy cannot handle.
+     */
+    static ReplacementPolicy *create(const std::string &name, uint64_t n_sets, uint64_t ways);
+};
+
+#endif
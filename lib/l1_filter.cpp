@@ -0,0 +1,137 @@
+/*
+// Source file for the L1Filter class, see l1_filter.h for what the filtered
+// trace holds.
+*/
+
+#include "l1_filter.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+L1Filter::L1Filter(TraceReader *reader, uint32_t procs_count, const CacheConfig &config)
+: m_reader(reader), m_cpus(procs_count), m_batch(BATCH_SIZE) {
+    for (size_t k = 0; k < m_cpus.size(); k++) {
+        Cpu &c = m_cpus[k];
+        c.dcache.init(config.dcache, config.dcache_policy);
+        c.icache.init(config.icache, config.icache_policy);
+        c.next = 0;
+        c.gap = 0;
+        c.gap_start = 0;
+        c.ended = false;
+        c.stats = Stats();
+    }
+}
+
+L1Filter::~L1Filter() {
+}
+
+size_t L1Filter::fetch(uint32_t pid, TraceFile::PackedEntry *out, uint64_t *orig, size_t n) {
+    Cpu &c = m_cpus.at(pid);
+
+    if (c.pending.size() < n && !c.ended) {
+        size_t got = m_reader->fetch(pid, m_batch.data(), m_batch.size());
+        if (got == 0) { // A trace without end tag
+            filter(c, TraceFile::PackedEntry::make(TraceFile::ENTRY_TYPE_END, 0));
+            c.stats.entries--; // The end tag was not read
+        }
+        for (size_t i = 0; i < got && !c.ended; i++) {
+            filter(c, m_batch[i]);
+        }
+    }
+
+    size_t k = 0;
+    while (k < n && !c.pending.empty()) {
+        out[k] = c.pending.front();
+        orig[k] = c.pending_orig.front();
+        c.pending.pop_front();
+        c.pending_orig.pop_front();
+        k++;
+    }
+    return k;
+}
+
+void L1Filter::filter(Cpu &c, TraceFile::PackedEntry pe) {
+    uint64_t kept = c.stats.kept;
+    c.stats.entries++;
+    c.next++;
+
+    switch (pe.type()) {
+    case TraceFile::ENTRY_TYPE_NOP:
+        break;
+    case TraceFile::ENTRY_TYPE_READ:
+        access(c, c.dcache, pe, false);
+        break;
+    case TraceFile::ENTRY_TYPE_WRITE:
+        access(c, c.dcache, pe, true);
+        break;
+    case TraceFile::ENTRY_TYPE_IFETCH:
+        access(c, c.icache, pe, false);
+        break;
+    case TraceFile::ENTRY_TYPE_RMW:
+        access(c, c.dcache, pe, true);
+        keep(c, pe);
+        break;
+    case TraceFile::ENTRY_TYPE_END:
+        c.ended = true;
+        keep(c, pe);
+        break;
+    default: // Fences and barriers
+        keep(c, pe);
+        break;
+    }
+
+    if (c.stats.kept == kept) { // Filtered out, the processor was busy for its cycles
+        if (c.gap == 0) {
+            c.gap_start = c.next - 1;
+        }
+        c.gap += pe.type() == TraceFile::ENTRY_TYPE_NOP && pe.addr() > 1 ? pe.addr() : 1;
+    }
+}
+
+void L1Filter::access(Cpu &c, CacheArray &cache, TraceFile::PackedEntry pe, bool is_write) {
+    const CacheGeometry &g = cache.get_geometry();
+    bool rmw = pe.type() == TraceFile::ENTRY_TYPE_RMW;
+    uint64_t first = g.block_addr(pe.addr());
+    uint64_t lines = TraceFile::lines_touched(pe.addr(), pe.size(), g.line_size);
+
+    for (uint64_t block_addr = first; block_addr < first + lines; block_addr++) {
+        CacheArray::Result r = cache.access(block_addr, is_write);
+        c.stats.accesses++;
+        if (r.hit) {
+            continue;
+        }
+
+        c.stats.misses++;
+        if (r.writeback) { // Write back the evicted line
+            c.stats.writebacks++;
+            keep(c, TraceFile::PackedEntry::make(TraceFile::ENTRY_TYPE_WRITE,
+                                                 r.victim * g.line_size, g.line_size));
+        }
+        if (!rmw) { // The RMW itself is kept instead
+            keep(c, TraceFile::PackedEntry::make(pe.type(), block_addr * g.line_size, g.line_size));
+        }
+    }
+}
+
+void L1Filter::keep(Cpu &c, TraceFile::PackedEntry pe) {
+    if (c.gap > 0) {
+        uint64_t cycles = c.gap < TraceFile::PackedEntry::addr_mask ? c.gap : TraceFile::PackedEntry::addr_mask;
+        c.pending.push_back(TraceFile::PackedEntry::make(TraceFile::ENTRY_TYPE_NOP, cycles > 1 ? cycles : 0));
+        c.pending_orig.push_back(c.gap_start);
+        c.stats.kept++;
+        c.gap = 0;
+    }
+    c.pending.push_back(pe);
+    c.pending_orig.push_back(c.next - 1);
+    c.stats.kept++;
+}
+
+bool L1Filter::done(uint32_t pid) const {
+    const Cpu &c = m_cpus.at(pid);
+    return c.ended && c.pending.empty();
+}
+
+const L1Filter::Stats &L1Filter::get_stats(uint32_t pid) const {
+    return m_cpus.at(pid).stats;
+}
@@ -0,0 +1,108 @@
+/*
+// Header file for the L1Filter class, which runs the private L1 caches of
+// the simulators over a trace and keeps only the entries that reach the
+// level below: the misses and the write backs of dirty lines. Studies that
+// only change the bus, a shared cache or the memory can then run on the
+// filtered trace, which is much shorter than the original one. trf_filter
+// writes it to a 5TRF file.
+//
+// Every processor has an L1 data cache and an L1 instruction cache with
+// write allocate, write back and the geometry and replacement policy of a
+// CacheConfig (see cache_config.h), run by the cache kernels of
+// cache_kernel.h, as the caches of the simulators, so they hit and evict
+// alike. The caches of the processors
+// are independent, invalidations by the other processors are not modelled,
+// so misses caused by sharing are missing from the filtered trace.
+//
+// The filtered trace of a processor consists of:
+//   - a read, write or instruction fetch of the whole line for every miss,
+//     after a write of the evicted line if it was dirty (entries cover at
+//     most 64 bytes of longer lines)
+//   - every RMW, at its own address: atomics have to reach the level below
+//     anyway, they update the data cache like a write
+//   - every fence, barrier and the end tag
+//   - a NOP in place of the entries that were filtered out in between,
+//     whose cycles are the sum of the cycles of these entries (a hit or an
+//     access takes one), so timed simulations (see trace_timed) keep the
+//     pace of the processor
+// Every entry of the filtered trace is tagged with the index of the entry
+// of the original trace it comes from; a NOP with the index of the first
+// entry it replaces.
+*/
+
+#ifndef L1_FILTER_H
+#define L1_FILTER_H
+
+#include "psa.h"
+#include "cache_config.h"
+#include "cache_kernel.h"
+#include "trace_reader.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+class L1Filter {
+    public:
+    struct Stats {
+        uint64_t entries;    // Entries read, the end tag included
+        uint64_t accesses;   // Cache lines accessed
+        uint64_t misses;
+        uint64_t writebacks;
+        uint64_t kept;       // Entries of the filtered trace
+    };
+
+    /*
+     * Filters the trace read by reader, which stays owned by the caller,
+     * through the data and instruction caches of config and their
+     * policies. The latencies of config are not used. Throws a
+     * runtime_error for policies that do not fit a cache.
+     */
+    L1Filter(TraceReader *reader, uint32_t procs_count, const CacheConfig &config = cache_config);
+    ~L1Filter();
+
+    /*
+     * Stores up to n entries of the filtered trace of processor pid in out
+     * and the index of their original entry in orig. Returns the number of
+     * entries stored. At most one batch of the original trace is read per
+     * call, so the processors can be read side by side from a pipe, and a
+     * call may store nothing while the trace goes on; see done().
+     */
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, uint64_t *orig, size_t n);
+
+    // Returns true once every entry of the filtered trace of pid was fetched
+    bool done(uint32_t pid) const;
+
+    const Stats &get_stats(uint32_t pid) const;
+
+    private:
+    struct Cpu {
+        CacheArray dcache;
+        CacheArray icache;
+        uint64_t next;     // Index of the next original entry
+        uint64_t gap;      // Cycles of the entries filtered out since the last kept one
+        uint64_t gap_start; // Index of the first of them
+        bool ended;
+        std::deque<TraceFile::PackedEntry> pending;
+        std::deque<uint64_t> pending_orig;
+        Stats stats;
+    };
+
+    TraceReader *m_reader;
+    std::vector<Cpu> m_cpus;
+    std::vector<TraceFile::PackedEntry> m_batch;
+
+    // Runs one original entry through the caches of c
+    void filter(Cpu &c, TraceFile::PackedEntry pe);
+
+    // Accesses every line of the access pe in cache, keeping the misses
+    void access(Cpu &c, CacheArray &cache, TraceFile::PackedEntry pe, bool is_write);
+
+    // Appends an entry to the filtered trace, after the NOP for the gap
+    void keep(Cpu &c, TraceFile::PackedEntry pe);
+
+    // No copies are allowed.
+    L1Filter(const L1Filter &f);
+};
+
+#endif
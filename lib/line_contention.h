@@ -0,0 +1,52 @@
+/*
+// Header file for the contention statistics of atomic read-modify-writes
+// (RMWs), kept per cache line by the simulators that model coherence. An
+// RMW is contended if it had to take its line over from another CPU, as
+// locks and counters do that several CPUs update, or that share a line
+// with one another.
+*/
+
+#ifndef LINE_CONTENTION_H
+#define LINE_CONTENTION_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <systemc>
+#include <vector>
+
+// Contention on a cache line by atomic read-modify-writes
+struct LineContention {
+    uint64_t rmws;         // Atomic read-modify-writes to the line
+    uint64_t contended;    // RMWs that had to take the line from another cache
+    sc_core::sc_time wait; // Time the RMWs waited for the bus
+    uint64_t owner;        // Cache of the last RMW, once rmws > 0
+};
+
+// Prints the top lines of contention, most contended first
+inline void print_contention(const std::map<uint64_t, LineContention> &contention, size_t top) {
+    if (contention.empty()) {
+        return;
+    }
+    std::vector<std::pair<uint64_t, LineContention> > lines(contention.begin(), contention.end());
+    std::sort(lines.begin(), lines.end(),
+              [](const std::pair<uint64_t, LineContention> &a, const std::pair<uint64_t, LineContention> &b) {
+                  return a.second.contended > b.second.contended;
+              });
+
+    size_t w = 12;
+    std::cout << "RMW contention per line (top " << std::min(top, lines.size()) << " of " << lines.size()
+              << ")" << std::endl;
+    std::cout << std::setw(w + 6) << "Line" << std::setw(w) << "RMWs" << std::setw(w) << "Contended"
+              << std::setw(w + 4) << "TotalWait" << std::setw(w + 4) << "AvgWait" << std::endl;
+    for (size_t i = 0; i < lines.size() && i < top; i++) {
+        const LineContention &c = lines[i].second;
+        std::cout << std::setw(w + 6) << std::hex << lines[i].first << std::dec << std::setw(w) << c.rmws
+                  << std::setw(w) << c.contended << std::setw(w + 4) << c.wait
+                  << std::setw(w + 4) << c.wait / (double)c.rmws << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+// Source file for the Params class, see params.h.
+*/
+
+#include "params.h"
+
+#include <errno.h>
+#include <stdexcept>
+#include <stdlib.h>
+
+using namespace std;
+
+void Params::set(const string &name, const string &value) {
+    m_values[name] = value;
+}
+
+const string *Params::find(const string &name) {
+    map<string, string>::const_iterator it = m_values.find(name);
+    if (it == m_values.end()) {
+        return NULL;
+    }
+    m_used[name] = true;
+    return &it->second;
+}
+
+uint64_t Params::get_count(const string &name, uint64_t def) {
+    const string *value = find(name);
+    if (value == NULL) {
+        return def;
+    }
+
+    char *end;
+    errno = 0;
+    uint64_t v = strtoull(value->c_str(), &end, 0);
+    uint32_t shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    default: break;
+    }
+    if (value->empty() || *end != '\0' || (*value)[0] == '-') {
+        throw runtime_error("Invalid value for " + name + ": " + *value);
+    }
+    if (errno == ERANGE || v > (UINT64_MAX >> shift)) {
+        throw runtime_error("Value of " + name + " out of range: " + *value);
+    }
+    return v << shift;
+}
+
+double Params::get_fraction(const string &name, double def) {
+    const string *value = find(name);
+    if (value == NULL) {
+        return def;
+    }
+
+    char *end;
+    double v = strtod(value->c_str(), &end);
+    if (value->empty() || *end != '\0' || !(v >= 0)) {
+        throw runtime_error("Invalid value for " + name + ": " + *value);
+    }
+    return v;
+}
+
+string Params::get_string(const string &name, const string &def) {
+    const string *value = find(name);
+    return value != NULL ? *value : def;
+}
+
+void Params::check_used(const string &what) const {
+    for (map<string, string>::const_iterator it = m_values.begin(); it != m_values.end(); ++it) {
+        if (m_used.find(it->first) == m_used.end()) {
+            throw runtime_error("Unknown parameter of " + what + ": " + it->first);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+/*
+// Header file for the Params class, parameters given by name as text, as
+// taken by the trace generators, the trace mixes and the cache
+// configuration. Numbers may end in K, M or G (powers of 1024).
+*/
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+// Parameters by name
+class Params {
+    public:
+    void set(const std::string &name, const std::string &value);
+
+    // Return the value of a parameter, def if it is not set. Throw a
+    // runtime_error if the value is not a number.
+    uint64_t get_count(const std::string &name, uint64_t def);
+    double get_fraction(const std::string &name, double def);
+    std::string get_string(const std::string &name, const std::string &def);
+
+    // Throws a runtime_error naming the first parameter no get was done
+    // for, as a parameter of what
+    void check_used(const std::string &what) const;
+
+    private:
+    std::map<std::string, std::string> m_values;
+    std::map<std::string, bool> m_used;
+
+    const std::string *find(const std::string &name);
+};
+
+#endif
@@ -25,34 +25,16 @@
 #include <cstdint>
 #include <iomanip>
 #include <algorithm>
-
-#if defined(__APPLE__)
-#include <machine/endian.h>
-#else
-#include <endian.h>
-#endif
+#include <sstream>
 
 #include <systemc.h>
 
-using namespace std;
-
-#if !defined(__APPLE__)
-
-#if defined(__BYTE_ORDER) && (__BYTE_ORDER == __LITTLE_ENDIAN) || (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
-uint64_t ntohll(uint64_t net) {
-    uint64_t host = 0;
-    for (int i = 0; i < 8; ++i) {
-        host = (host << 8) | ((net >> i * 8) & 0xFF);
-    }
-    return host;
-}
-#else
-uint64_t ntohll(uint64_t net) {
-    return net;
-}
-#endif
+#include "trace_header.h"
+#include "trace_mix.h"
+#include "trace_prefetch.h"
+#include "trace_reader.h"
 
-#endif
+using namespace std;
 
 // Internal structure to keep track of statistics per CPU
 struct stats {
@@ -60,6 +42,8 @@ struct stats {
     int writemiss;
     int readhit;
     int readmiss;
+    int ifetchhit;
+    int ifetchmiss;
 };
 
 // Constant to put a 64 bit wire in high impedance mode.
@@ -68,24 +52,51 @@ const char *float_64_bit_wire = "ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ
 static stats *stats_percpu = NULL;
 TraceFile *tracefile_ptr = NULL;
 uint32_t num_cpus = 0;
+bool trace_timed = false;
 
 // Initializes the tracefile from the 1st argv argument then takes it out of
 // argc/argv for argument parsing elsewhere
 void init_tracefile(int *argc, char **argv[]) {
-    // Check if we got at least one argument, otherwise throw an error
-    if (*argc < 2) {
-        throw runtime_error(string("Error, usage: ") + (*argv)[0] + string(" <tracefile>"));
-    } else {
-        // Open the tracefile and create TraceFile object
-        tracefile_ptr = new TraceFile((*argv)[1]);
-
-        // Get the number of CPU's from the tracefile
-        num_cpus = tracefile_ptr->get_proc_count();
+    char **args = *argv;
+    const char *filename = NULL;
+    bool prefetch = false;
+    int kept = 1;
+
+    // Pick out the trace options and the tracefile, keep everything else
+    for (int i = 1; i < *argc; i++) {
+        if (!strcmp(args[i], "--trace-prefetch")) {
+            prefetch = true;
+        } else if (!strcmp(args[i], "--trace-timed")) {
+            trace_timed = true;
+        } else if (!strncmp(args[i], "--trace-", 8)) {
+            throw runtime_error(string("Error, unknown option: ") + args[i]);
+        } else if (filename == NULL) {
+            filename = args[i];
+        } else {
+            args[kept++] = args[i];
+        }
+    }
 
-        // Reset arguments to the next set
-        *argv = &((*argv)[2]);
-        (*argc)--;
+    // Check if we got the tracefile argument, otherwise throw an error
+    if (filename == NULL) {
+        throw runtime_error(string("Error, usage: ") + args[0] +
+                            string(" [--trace-prefetch] [--trace-timed] <tracefile>"));
     }
+
+    // Open the tracefile and create TraceFile object
+    tracefile_ptr = new TraceFile(filename, TraceFile::READ_AUTO, prefetch);
+
+    // Get the number of CPU's from the tracefile
+    num_cpus = tracefile_ptr->get_proc_count();
+
+    // Reset arguments to the remaining ones
+    *argc = kept;
+    args[kept] = NULL;
+}
+
+void init_tracefile(TraceFile *trace) {
+    tracefile_ptr = trace;
+    num_cpus = trace->get_proc_count();
 }
 
 // Allocates and sets up stats datastructure
@@ -101,6 +112,8 @@ void stats_init() {
         stats_percpu[i].writemiss = 0;
         stats_percpu[i].readhit = 0;
         stats_percpu[i].readmiss = 0;
+        stats_percpu[i].ifetchhit = 0;
+        stats_percpu[i].ifetchmiss = 0;
     }
 }
 
@@ -142,8 +155,42 @@ void stats_print() {
             rhitrate << setw(w) << whitrate << setw(w) << hitrate << endl;
     }
 
+    // Instruction fetches, only for traces that have them
+    bool fetched = false;
+    for (unsigned int i = 0; i < num_cpus; i++) {
+        fetched = fetched || stats_percpu[i].ifetchhit + stats_percpu[i].ifetchmiss > 0;
+    }
+    if (fetched) {
+        cout << setw(w) << "CPU" << setw(w) << "IFetches" << setw(w) << "IHit" \
+            << setw(w) << "IMiss" << setw(w) << "IHitrate" << endl;
+        for (unsigned int i = 0; i < num_cpus; i++) {
+            int fetches = stats_percpu[i].ifetchhit + stats_percpu[i].ifetchmiss;
+            double ihitrate = (stats_percpu[i].ifetchhit / (double) fetches) * 100;
+            cout << setw(w) << setprecision(4) << i << setw(w) << fetches << \
+                setw(w) << stats_percpu[i].ifetchhit << setw(w) << \
+                stats_percpu[i].ifetchmiss << setw(w) << ihitrate << endl;
+        }
+    }
+
+    // The job of every CPU of a multiprogrammed trace
+    vector<string> jobs;
+    if (tracefile_ptr != NULL && get_mix_jobs(tracefile_ptr->get_header(), jobs)) {
+        for (unsigned int i = 0; i < num_cpus && i < jobs.size(); i++) {
+            cout << "CPU " << i << " runs " << jobs[i] << endl;
+        }
+    }
+
     cout << "Total simulation time: " << sc_time_stamp() << endl;
 
+    // Shows whether the simulation ever had to wait for the trace
+    if (tracefile_ptr != NULL && tracefile_ptr->is_prefetching()) {
+        cout << "Trace prefetch stalls:";
+        for (unsigned int i = 0; i < num_cpus; i++) {
+            cout << " " << tracefile_ptr->get_prefetch_stalls(i);
+        }
+        cout << endl;
+    }
+
 }
 
 void stats_writehit(uint32_t cpuid) {
@@ -170,113 +217,212 @@ void stats_readmiss(uint32_t cpuid) {
     }
 }
 
-TraceFile::TraceFile(const char *filename)
-: m_input(filename, ios::in | ios::binary), m_num_finished(0) {
-    // Check if the file properly opened
-    if (!m_input.is_open() || !m_input.good()) {
-        throw runtime_error(string("Unable to open file: ") + filename);
+void stats_ifetchhit(uint32_t cpuid) {
+    if (cpuid < num_cpus && stats_percpu != NULL) {
+        stats_percpu[cpuid].ifetchhit++;
     }
+}
 
-    // Check file signature
-    char signature[4];
-    m_input.read((char *)&signature, 4);
-    if (m_input.fail() || strncmp(signature, "5TRF", 4)) {
-        throw runtime_error(string("Invalid file signature in file: ") + filename);
+void stats_ifetchmiss(uint32_t cpuid) {
+    if (cpuid < num_cpus && stats_percpu != NULL) {
+        stats_percpu[cpuid].ifetchmiss++;
     }
+}
 
-    // Read number of processors the file was created for
+TraceFile::TraceFile(const char *filename, ReadMode mode, bool prefetch)
+: m_reader(NULL), m_prefetch(NULL), m_proc_count(0), m_num_finished(0) {
+    // Open the file with the reader for its format
     uint32_t procs_count;
-    m_input.read((char *)&procs_count, sizeof(uint32_t));
-    if (m_input.fail()) {
-        throw runtime_error("Unable to read file");
-    }
+    TraceReader *reader = open_trace_reader(filename, mode, procs_count);
+    init(reader, procs_count, prefetch);
+}
+
+TraceFile::TraceFile(TraceReader *reader, uint32_t procs_count, bool prefetch)
+: m_reader(NULL), m_prefetch(NULL), m_proc_count(0), m_num_finished(0) {
+    init(reader, procs_count, prefetch);
+}
 
-    // Transform result into host-order
-    procs_count = ntohl(procs_count);
+void TraceFile::init(TraceReader *reader, uint32_t procs_count, bool prefetch) {
+    m_reader = reader;
+    m_proc_count = procs_count;
 
-    // Set the start positions of the processor traces
-    m_positions.resize(procs_count);
-    streampos start = m_input.tellg();
+    // Decode ahead on a background thread
+    if (prefetch) {
+        m_prefetch = new PrefetchReader(m_reader, m_proc_count);
+        m_reader = m_prefetch;
+    }
 
     // Setup the waiting vector for barrier events.
-    m_waiting.resize(procs_count, false);
+    m_waiting.resize(m_proc_count, false);
+    m_finished.resize(m_proc_count, false);
+    m_buffers.resize(m_proc_count, NULL);
+}
 
-    // And in the meanwhile store the end position of the file
-    m_input.seekg(0, ios::end);
-    m_endstream = m_input.tellg();
+TraceFile::~TraceFile() {
+    close();
+}
 
-    if ((start + (streamoff)((procs_count * entry_size) + (entry_size - 1))) >= m_endstream) {
-        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+void TraceFile::close() {
+    for (size_t i = 0; i < m_buffers.size(); i++) {
+        delete m_buffers[i];
     }
+    m_buffers.resize(0);
 
-    for (uint32_t i = 0; i < procs_count; i++) {
-        m_positions[i] = start + (streamoff)(i * entry_size);
+    delete m_reader;
+    m_reader = NULL;
+    m_prefetch = NULL;
+    m_proc_count = 0;
+}
+
+bool TraceFile::is_mapped() const {
+    return m_reader != NULL && m_reader->is_mapped();
+}
+
+bool TraceFile::is_prefetching() const {
+    return m_prefetch != NULL;
+}
+
+uint64_t TraceFile::get_prefetch_stalls(uint32_t pid) const {
+    if (m_prefetch == NULL || pid >= get_proc_count()) {
+        return 0;
     }
+    return m_prefetch->get_stall_count(pid);
 }
 
-TraceFile::~TraceFile() {}
+bool TraceFile::has_index() const {
+    return m_reader != NULL && m_reader->get_index() != NULL;
+}
 
-void TraceFile::close() {
-    m_input.close();
-    m_positions.resize(0);
+const TraceHeader *TraceFile::get_header() const {
+    return m_reader != NULL ? m_reader->get_header() : NULL;
+}
+
+uint64_t TraceFile::get_entry_count(uint32_t pid) const {
+    if (pid >= get_proc_count()) {
+        return 0;
+    }
+    if (has_index()) {
+        return m_reader->get_index()->get_entry_count(pid);
+    }
+    const TraceHeader *header = get_header();
+    if (header != NULL && header->has_counts()) {
+        return header->get_entry_count(pid);
+    }
+    return 0;
+}
+
+uint64_t TraceFile::get_epoch_count() const {
+    const TraceIndex *index = has_index() ? m_reader->get_index() : NULL;
+    const TraceHeader *header = get_header();
+    if (index == NULL && (header == NULL || !header->has_counts())) {
+        return 0;
+    }
+
+    // An epoch only starts once every processor reached its barrier
+    uint64_t barriers = UINT64_MAX;
+    for (uint32_t pid = 0; pid < get_proc_count(); pid++) {
+        uint64_t count = index != NULL ? index->get_barrier_count(pid)
+                                       : header->get_barrier_count(pid);
+        barriers = std::min(barriers, count);
+    }
+    return barriers + 1;
+}
+
+void TraceFile::seek_to_entry(uint64_t n) {
+    seek(vector<uint64_t>(get_proc_count(), n));
+}
+
+void TraceFile::seek_to_epoch(uint64_t k) {
+    if (!has_index()) {
+        throw runtime_error("Tracefile has no index, add one with trf_index");
+    }
+    if (k >= get_epoch_count()) {
+        throw runtime_error("Tracefile has only " + to_string(get_epoch_count()) +
+                            " barrier epochs");
+    }
+
+    // Every processor continues right after its k-th barrier
+    const TraceIndex *index = m_reader->get_index();
+    vector<uint64_t> entries(get_proc_count(), 0);
+    for (uint32_t pid = 0; pid < get_proc_count() && k > 0; pid++) {
+        entries[pid] = index->get_barrier(pid, k - 1) + 1;
+    }
+    seek(entries);
+}
+
+void TraceFile::seek(const vector<uint64_t> &entries) {
+    if (m_reader == NULL) {
+        throw runtime_error("Tracefile is closed");
+    }
+    m_reader->seek(entries);
+
+    // Start over with the barrier and end bookkeeping
+    std::fill(m_waiting.begin(), m_waiting.end(), false);
+    std::fill(m_finished.begin(), m_finished.end(), false);
+    m_num_finished = 0;
+    for (size_t i = 0; i < m_attached.size(); i++) {
+        m_attached[i]->reset();
+    }
 }
 
 uint32_t TraceFile::get_proc_count() const {
-    return m_positions.size();
+    return m_proc_count;
 }
 
 /* No need for locking, systemc is not multithreaded. */
 bool TraceFile::next(uint32_t pid, Entry &e) {
-    uint32_t cpucount = get_proc_count();
-
-    if (pid >= cpucount) {
+    if (pid >= get_proc_count()) {
         // Invalid processor ID
         return false;
     }
 
-    uint64_t data;
-    assert(sizeof(data) == entry_size);
-
-    // If trace position is no longer valid this trace has ended, return NOP.
-    if (m_positions[pid] == (streampos)0) {
-        // This trace already ended so we only send a NOP
-        e.addr = 0;
-        e.type = ENTRY_TYPE_NOP;
-        return true;
+    // Entries are decoded in batches, the buffer takes care of the barrier
+    // and end handling.
+    if (m_buffers[pid] == NULL) {
+        m_buffers[pid] = new TraceBuffer(this, pid);
     }
+    return m_buffers[pid]->next(e);
+}
 
-    // If we are the end of stream there is no valid event, return NOP.
-    if (m_positions[pid] > (m_endstream - (streampos)sizeof(data))) {
-        // We didnt encounter an end tag but we can no longer read a whole
-        // entry from the file, so we stop reading this trace from now on
-        e.type = ENTRY_TYPE_NOP;
-        m_positions[pid] = 0;
-        m_num_finished++;
-        return true;
-    } 
-
-    // If we are waiting at a barrier, don't advance trace and return a NOP
-    if (m_waiting[pid]) {
-        e.addr = 0;
-        e.type = ENTRY_TYPE_NOP;
-        return true;
+size_t TraceFile::next_batch(uint32_t pid, PackedEntry *out, size_t n) {
+    if (pid >= get_proc_count() || m_finished[pid]) {
+        return 0;
     }
-    
-    // Read current trace event into data.
-    m_input.seekg(m_positions[pid]);
-    m_input.read((char *)&data, sizeof(data));
+    return m_reader->fetch(pid, out, n);
+}
 
-    // Transform data into host byte order.
-    data = ntohll(data);
+const TraceFile::PackedEntry *TraceFile::view_batch(uint32_t pid, size_t &n) {
+    if (pid >= get_proc_count() || m_finished[pid]) {
+        return NULL;
+    }
+    return m_reader->view(pid, n);
+}
 
-    // Seek to the next value.
-    m_positions[pid] += cpucount * sizeof(data);
+void TraceFile::PackedEntry::check_legacy(const PackedEntry *entries, size_t n) {
+    uint64_t words = 0;
+    for (size_t i = 0; i < n; i++) {
+        words |= entries[i].word;
+    }
+    if ((words & size_mask) == 0) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if ((entries[i].word & size_mask) != 0) {
+            ostringstream msg;
+            msg << "Address 0x" << hex << (entries[i].word & ~(0x7ULL << 61))
+                << " of a trace without the version 2 header does not fit in 55 bits";
+            throw runtime_error(msg.str());
+        }
+    }
+}
 
+void TraceFile::retire(uint32_t pid, PackedEntry pe, Entry &e) {
     // Decode event: separate Address and Type-Tag information
     // Three most significant bits are used for the entry type
     // Set Entry e with current trace data.
-    e.addr = data & ~(0b111LL << 61);
-    e.type = (EntryType)(data >> 61);
+    e.addr = pe.addr();
+    e.type = pe.type();
+    e.size = pe.size();
 
     // Handle the barrier event.
     if (e.type == ENTRY_TYPE_BARRIER) {
@@ -291,10 +437,11 @@ bool TraceFile::next(uint32_t pid, Entry &e) {
         // A barrier is treated as a NOP event.
         e.addr = 0;
         e.type = ENTRY_TYPE_NOP;
-        return true;
+        e.size = 1;
+        return;
     }
 
-    // Now handle: NOP, READ and WRITE
+    // Now handle: NOP, READ, WRITE, IFETCH, RMW and FENCE
 
     // Check if we encountered an end tag
     if (e.type == ENTRY_TYPE_END) {
@@ -302,13 +449,81 @@ bool TraceFile::next(uint32_t pid, Entry &e) {
         e.type = ENTRY_TYPE_NOP;
 
         // And register that this cpu's trace has ended
-        m_positions[pid] = 0;
-        m_num_finished++;
+        finish(pid);
     }
+}
 
-    return true;
+void TraceFile::finish(uint32_t pid) {
+    if (!m_finished[pid]) {
+        m_finished[pid] = true;
+        m_num_finished++;
+    }
 }
 
 bool TraceFile::eof() const {
-    return (m_num_finished == m_positions.size());
+    return (m_num_finished == get_proc_count());
+}
+
+TraceBuffer::TraceBuffer(TraceFile *trace, uint32_t pid)
+: m_trace(trace), m_pid(pid), m_entries(batch_size), m_view(m_entries.data()),
+  m_head(0), m_tail(0) {
+    m_trace->m_attached.push_back(this);
+}
+
+TraceBuffer::~TraceBuffer() {
+    vector<TraceBuffer *> &attached = m_trace->m_attached;
+    attached.erase(std::remove(attached.begin(), attached.end(), this), attached.end());
+}
+
+void TraceBuffer::reset() {
+    m_head = 0;
+    m_tail = 0;
+}
+
+bool TraceBuffer::next_slow(TraceFile::Entry &e) {
+    if (m_pid >= m_trace->get_proc_count()) {
+        // Invalid processor ID
+        return false;
+    }
+
+    // This trace already ended so we only send a NOP
+    if (m_trace->m_finished[m_pid]) {
+        e.addr = 0;
+        e.type = TraceFile::ENTRY_TYPE_NOP;
+        e.size = 1;
+        return true;
+    }
+
+    // Decode the next batch once all buffered entries are consumed, or take
+    // the entries in place from a reader that holds them in memory
+    if (m_head == m_tail) {
+        m_head = 0;
+        size_t n = view_size;
+        m_view = m_trace->view_batch(m_pid, n);
+        if (m_view == NULL) {
+            m_view = m_entries.data();
+            n = m_trace->next_batch(m_pid, m_entries.data(), batch_size);
+        }
+        m_tail = n;
+    }
+
+    // The trace ran out without an end tag, stop reading it from now on
+    if (m_head == m_tail) {
+        e.addr = 0;
+        e.type = TraceFile::ENTRY_TYPE_NOP;
+        e.size = 1;
+        m_trace->finish(m_pid);
+        return true;
+    }
+
+    // Don't advance the trace while waiting at a barrier
+    if (m_trace->m_waiting[m_pid]) {
+        e.addr = 0;
+        e.type = TraceFile::ENTRY_TYPE_NOP;
+        e.size = 1;
+        return true;
+    }
+
+    m_trace->retire(m_pid, m_view[m_head++], e);
+    return true;
 }
@@ -38,10 +38,27 @@ typedef unsigned __int64 uint64_t;
  * Initializes the Tracefile and sets the number of cpu's. It expects the
  * first argument from argv to be the Tracefile name, and modifies argv/argc
  * to remove this argument so that the user can add their own options and
- * argument parser after this function
+ * argument parser after this function. Afterwards argv[0] is still the
+ * program name and argv[1] the first argument after the Tracefile name.
+ * The Tracefile name - reads the trace from stdin, so traces can be piped in.
+ * Names of the form scheme:spec select another trace source, see
+ * register_trace_source() in trace_reader.h; mem:file runs the simulation
+ * from a copy of the trace in memory, shm:file from a copy in shared memory
+ * that later runs on the same trace map instead of decoding it again.
+ *
+ * Options starting with --trace- may appear anywhere and are removed too:
+ *   --trace-prefetch  Decode the trace ahead on a background thread
+ *   --trace-timed     Sets trace_timed: the CPUs issue every access at the
+ *                     time the idle cycles before it ask for, see Entry
  */
 void init_tracefile(int *argc, char **argv[]);
 
+class TraceFile;
+
+// Uses trace, e.g. one reading from memory or a generator, as the Tracefile
+// and sets the number of cpu's. Takes ownership of trace.
+void init_tracefile(TraceFile *trace);
+
 /*
  * Initializes the statistic counters, needs to be run after init_tracefile
  * as it uses num_cpus to generate its datastructures.
@@ -60,9 +77,19 @@ void stats_writemiss(uint32_t cpuid);
 void stats_readhit(uint32_t cpuid);
 void stats_readmiss(uint32_t cpuid);
 
+// Updates the instruction fetch counters for given CPU, stats_print() shows
+// them once any CPU fetched an instruction
+void stats_ifetchhit(uint32_t cpuid);
+void stats_ifetchmiss(uint32_t cpuid);
+
 // Declaration of a constant to put a 64 bit wire in high impedance mode.
 extern const char *float_64_bit_wire;
 
+class TraceReader;
+class TraceBuffer;
+class TraceHeader;
+class PrefetchReader;
+
 class TraceFile {
     public:
     // Data type of a memory request's operation type.
@@ -71,17 +98,92 @@ class TraceFile {
         ENTRY_TYPE_READ = 0x1,
         ENTRY_TYPE_WRITE = 0x2,
         ENTRY_TYPE_END = 0x3, // End is only used internally
-        ENTRY_TYPE_BARRIER = 0x4
+        ENTRY_TYPE_BARRIER = 0x4,
+        ENTRY_TYPE_IFETCH = 0x5, // Instruction fetch, goes to the I-cache
+        ENTRY_TYPE_RMW = 0x6, // Atomic read-modify-write of the access
+        ENTRY_TYPE_FENCE = 0x7 // Memory fence, has no address
     };
 
-    // Data type of a memory request entry for a processor
+    /*
+     * Data type of a memory request entry for a processor. An access covers
+     * size bytes from addr on, which may lie in two cache lines.
+     *
+     * A NOP is an idle cycle of the processor, or cycles() idle cycles if
+     * its address field is above 1. The idle cycles before an access are
+     * the time between the issue of the previous access and this one in the
+     * traced program. By default CPUs spend a cycle on every NOP once the
+     * previous access completed, with trace_timed they idle from the issue
+     * of the previous access on, so the idle time overlaps with its latency.
+     */
     struct Entry {
         EntryType type;
         uint64_t addr;
+        uint32_t size;
+
+        uint64_t cycles() const { return addr > 1 ? addr : 1; }
+    };
+
+    // Entry in its 8 byte trace encoding (in host byte order): the three most
+    // significant bits hold the type, the next six bits the access size in
+    // bytes minus one (1 to 64 bytes) and the remaining 55 bits the address.
+    // The size field comes with the version 2 header (see trace_header.h).
+    // 5TRF traces without that header were written before sizes were added,
+    // their entries read as 1 byte accesses as long as the addresses fit in
+    // 55 bits; the readers reject them otherwise, see check_legacy().
+    struct PackedEntry {
+        uint64_t word;
+
+        static const uint64_t addr_mask = (1ULL << 55) - 1;
+        static const uint64_t size_mask = 0x3FULL << 55;
+        static const uint32_t max_size = 64;
+
+        EntryType type() const { return (EntryType)(word >> 61); }
+        uint64_t addr() const { return word & addr_mask; }
+        uint32_t size() const { return ((word >> 55) & 0x3F) + 1; }
+
+        // Encodes an entry, size is clamped to 1 to max_size bytes
+        static PackedEntry make(EntryType type, uint64_t addr, uint32_t size = 1) {
+            uint64_t s = size < 1 ? 0 : (size > max_size ? max_size : size) - 1;
+            PackedEntry pe = { ((uint64_t)type << 61) | (s << 55) | (addr & addr_mask) };
+            return pe;
+        }
+
+        /*
+         * Checks n entries of a 5TRF trace without the version 2 header.
+         * Their size field holds the upper bits of the address, throws a
+         * runtime_error if any of them is set, instead of reading the
+         * address as a truncated one with a size.
+         */
+        static void check_legacy(const PackedEntry *entries, size_t n);
+    };
+
+    // Returns the number of cache lines of line_size bytes (a power of two)
+    // that an access of size bytes at addr touches, 1 or 2 for sizes up to
+    // the line size.
+    static uint64_t lines_touched(uint64_t addr, uint32_t size, uint64_t line_size) {
+        uint64_t last = addr + (size > 0 ? size - 1 : 0);
+        return last / line_size - addr / line_size + 1;
+    }
+
+    // How the trace data is accessed. READ_AUTO maps the file into memory
+    // when possible and falls back to the stream reader otherwise.
+    enum ReadMode {
+        READ_AUTO,
+        READ_MMAP,
+        READ_STREAM
     };
 
-    // Constructor / Destructor
-    TraceFile(const char *filename);
+    // Constructor / Destructor. The trace may be in the 5TRF format, with or
+    // without the version 2 header of trace_header.h, or in the compressed
+    // 5TRZ format written by trf_convert, the format is detected
+    // from the file signature. Pipes and stdin ("-") are read front to back
+    // (see StreamTraceReader in trace_reader.h). With prefetch set the trace
+    // is decoded ahead on a background thread (see trace_prefetch.h).
+    TraceFile(const char *filename, ReadMode mode = READ_AUTO, bool prefetch = false);
+
+    // Reads the trace from any trace source, see TraceReader in
+    // trace_reader.h. Takes ownership of reader.
+    TraceFile(TraceReader *reader, uint32_t procs_count, bool prefetch = false);
     ~TraceFile();
 
     // Closes the file
@@ -94,30 +196,155 @@ class TraceFile {
      */
     bool next(uint32_t pid, Entry &e);
 
+    /*
+     * Decodes up to n consecutive entries of processor pid into out and
+     * returns the number of entries decoded, 0 once the trace has no entries
+     * left. Entries are returned as stored: barriers and the end tag are not
+     * processed (decoding stops after an end tag). Use a TraceBuffer to
+     * consume them with the same semantics as next().
+     */
+    size_t next_batch(uint32_t pid, PackedEntry *out, size_t n);
+
+    /*
+     * Same as next_batch(), but hands out up to n entries in place if the
+     * reader holds them in memory (see TraceReader::view()), and sets n to
+     * their number. Returns NULL if the reader cannot do so.
+     */
+    const PackedEntry *view_batch(uint32_t pid, size_t &n);
+
     // Determines if the end-of-file has been reached
     bool eof() const;
 
     // Returns the number of processors this file contains traces for
     uint32_t get_proc_count() const;
 
-    private:
-    const uint32_t entry_size = 8; // Trace element is 8 bytes.
-    struct EntryInfo;
+    // Returns true if the trace is read from a memory mapping of the file
+    bool is_mapped() const;
+
+    // Returns true if the trace is decoded ahead on a background thread
+    bool is_prefetching() const;
+
+    // Returns how often processor pid found no prefetched entries and had
+    // to wait for the background thread, 0 without prefetching.
+    uint64_t get_prefetch_stalls(uint32_t pid) const;
+
+    // Returns true if the file has an index (see trace_index.h and trf_index)
+    bool has_index() const;
+
+    // Returns the version 2 header of the trace with its entry counts and
+    // workload description (see trace_header.h), NULL if it has none.
+    const TraceHeader *get_header() const;
 
-    std::ifstream m_input;
-    std::vector<std::streampos> m_positions;
+    // Returns the number of entries in the trace of processor pid, including
+    // its end tag. Needs an index or a header with entry counts, returns 0
+    // without them.
+    uint64_t get_entry_count(uint32_t pid) const;
+
+    // Returns the number of barrier epochs: the part of the trace before the
+    // first barrier and the parts after every barrier all processors reach.
+    // Needs an index or a header with entry counts, returns 0 without them.
+    uint64_t get_epoch_count() const;
+
+    /*
+     * Continues the trace of every processor at its entry n (counting from
+     * 0), as if the entries before it were never there: barriers are no
+     * longer waited for and ended traces start again. TraceBuffers on this
+     * trace drop the entries they hold. 5TRF files can always seek, 5TRZ
+     * files use the checkpoints of their index to skip decoding.
+     */
+    void seek_to_entry(uint64_t n);
+
+    // Continues the trace of every processor right after its k-th barrier,
+    // k = 0 is the start of the trace. Needs an index.
+    void seek_to_epoch(uint64_t k);
+
+    private:
+    TraceReader *m_reader;
+    PrefetchReader *m_prefetch; // Same object as m_reader when prefetching
+    uint32_t m_proc_count;
     std::vector<bool> m_waiting;
+    std::vector<bool> m_finished;
     uint32_t m_num_finished;
-    std::streampos m_endstream;
+
+    // Buffers through which next() reads each processor's trace
+    std::vector<TraceBuffer *> m_buffers;
+
+    // All buffers reading from this trace, they are emptied when seeking
+    std::vector<TraceBuffer *> m_attached;
+
+    void init(TraceReader *reader, uint32_t procs_count, bool prefetch);
+
+    // Continues processor p at entries[p], see seek_to_entry()
+    void seek(const std::vector<uint64_t> &entries);
+
+    // Handles an entry taken from the trace of processor pid in program
+    // order: updates the barrier and end bookkeeping and fills in e.
+    void retire(uint32_t pid, PackedEntry pe, Entry &e);
+
+    // Registers that the trace of processor pid has ended
+    void finish(uint32_t pid);
+
+    friend class TraceBuffer;
 
     // Private copy constructor because no copies are allowed.
     TraceFile(const TraceFile &trf);
 };
 
+/*
+ * Buffers the trace of a single processor. Entries are decoded from the
+ * TraceFile in batches and handed out one at a time by next(), which behaves
+ * exactly like TraceFile::next() for that processor. A processor should be
+ * read either through its TraceBuffer or through TraceFile::next(), not both.
+ */
+class TraceBuffer {
+    public:
+    TraceBuffer(TraceFile *trace, uint32_t pid);
+    ~TraceBuffer();
+
+    // Drops the buffered entries
+    void reset();
+
+    bool next(TraceFile::Entry &e) {
+        // Fast path: entries other than barriers and end tags need no
+        // bookkeeping
+        if (m_head < m_tail && !m_trace->m_waiting[m_pid]) {
+            TraceFile::PackedEntry pe = m_view[m_head];
+            if (pe.type() != TraceFile::ENTRY_TYPE_END &&
+                pe.type() != TraceFile::ENTRY_TYPE_BARRIER) {
+                m_head++;
+                e.addr = pe.addr();
+                e.type = pe.type();
+                e.size = pe.size();
+                return true;
+            }
+        }
+        return next_slow(e);
+    }
+
+    private:
+    static const size_t batch_size = 256;
+    static const size_t view_size = 1 << 16; // Entries handed out in place
+
+    TraceFile *m_trace;
+    uint32_t m_pid;
+    std::vector<TraceFile::PackedEntry> m_entries;
+    const TraceFile::PackedEntry *m_view; // m_entries, or those of the reader
+    size_t m_head;
+    size_t m_tail;
+
+    bool next_slow(TraceFile::Entry &e);
+
+    // No copies are allowed.
+    TraceBuffer(const TraceBuffer &buf);
+};
+
 // Global value giving the number of CPU's in the simulation
 extern uint32_t num_cpus;
 
 // Global pointer to the TraceFile class of the opened Tracefile
 extern TraceFile *tracefile_ptr;
 
+// Set by the --trace-timed option, see TraceFile::Entry
+extern bool trace_timed;
+
 #endif
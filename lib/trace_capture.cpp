@@ -0,0 +1,381 @@
+/*
+// Source file for the trace capture library, see trace_capture.h.
+*/
+
+#include "trace_capture.h"
+#include "trace_writer.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const size_t chunk_entries = 1 << 16;
+static const size_t ring_size = 16; // Chunks in flight per thread
+static const size_t merge_batch = 4096;
+
+thread_local CaptureBuffer *capture_buffer = NULL;
+
+// Lock-free ring of chunks between one producer and one consumer thread
+class ChunkRing {
+    public:
+    ChunkRing() : m_head(0), m_tail(0) {}
+
+    bool push(uint64_t *chunk) {
+        size_t tail = m_tail.load(memory_order_relaxed);
+        if (tail - m_head.load(memory_order_acquire) == ring_size) {
+            return false;
+        }
+        m_chunks[tail % ring_size] = chunk;
+        m_tail.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    uint64_t *pop() {
+        size_t head = m_head.load(memory_order_relaxed);
+        if (head == m_tail.load(memory_order_acquire)) {
+            return NULL;
+        }
+        uint64_t *chunk = m_chunks[head % ring_size];
+        m_head.store(head + 1, memory_order_release);
+        return chunk;
+    }
+
+    private:
+    uint64_t *m_chunks[ring_size];
+    atomic<size_t> m_head;
+    atomic<size_t> m_tail;
+};
+
+/*
+ * Everything about one recording thread. The full ring passes chunks to the
+ * background thread, the free ring hands them back for reuse. The first
+ * entry of every chunk holds its entry count once it is full.
+ */
+struct ThreadCapture : CaptureBuffer {
+    uint32_t pid;
+    uint64_t *chunk; // The chunk pos points into
+    ChunkRing full;
+    ChunkRing free;
+    FILE *spill;     // Only used by the background thread until the stop
+    string spill_name;
+    uint64_t barriers;
+    atomic<bool> dropping; // Nothing is written anymore, full chunks are dropped
+};
+
+class Capture {
+    public:
+    string filename;
+    string workload;
+    string params;
+    uint32_t line_size;
+
+    mutex lock; // Guards threads and pids, only taken to add a thread
+    vector<ThreadCapture *> threads;
+    vector<bool> pids;
+    uint32_t next_pid;
+
+    thread writer;
+    atomic<bool> stopping;
+    atomic<bool> failed; // The background thread stopped on error
+    string error; // First error of the background thread
+
+    // Creates the capture of the calling thread, as CPU pid or the next
+    // free CPU if pid is -1
+    ThreadCapture *add_thread(int64_t pid);
+
+    // Writes the chunks in the full rings to the spill files
+    bool spill_all();
+    void spill(ThreadCapture *t, const uint64_t *chunk, size_t n);
+
+    // Makes all threads drop their chunks instead of waiting for the
+    // background thread
+    void drop_all();
+
+    // Body of the background thread
+    void run();
+};
+
+static atomic<Capture *> capture(NULL);
+static mutex capture_lock; // Serializes starting and stopping
+
+ThreadCapture *Capture::add_thread(int64_t pid) {
+    lock_guard<mutex> guard(lock);
+    if (pid < 0) {
+        while (next_pid < pids.size() && pids[next_pid]) {
+            next_pid++;
+        }
+        pid = next_pid;
+    } else if ((uint64_t)pid < pids.size() && pids[pid]) {
+        throw runtime_error("CPU " + to_string(pid) + " of the trace is taken");
+    }
+    if ((uint64_t)pid >= pids.size()) {
+        pids.resize(pid + 1, false);
+    }
+    pids[pid] = true;
+
+    ThreadCapture *t = new ThreadCapture;
+    t->pid = pid;
+    t->chunk = new uint64_t[chunk_entries + 1];
+    t->pos = t->chunk + 1;
+    t->end = t->chunk + 1 + chunk_entries;
+    t->spill = NULL;
+    t->spill_name = filename + ".cpu" + to_string(pid);
+    t->barriers = 0;
+    t->dropping = failed.load(memory_order_acquire);
+    threads.push_back(t);
+    return t;
+}
+
+void Capture::drop_all() {
+    lock_guard<mutex> guard(lock);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->dropping.store(true, memory_order_release);
+    }
+}
+
+void Capture::spill(ThreadCapture *t, const uint64_t *chunk, size_t n) {
+    if (t->spill == NULL) {
+        t->spill = fopen(t->spill_name.c_str(), "w+b");
+        if (t->spill == NULL) {
+            throw runtime_error("Unable to create " + t->spill_name);
+        }
+    }
+    if (fwrite(chunk, sizeof(uint64_t), n, t->spill) != n) {
+        throw runtime_error("Unable to write " + t->spill_name);
+    }
+}
+
+bool Capture::spill_all() {
+    vector<ThreadCapture *> snapshot;
+    {
+        lock_guard<mutex> guard(lock);
+        snapshot = threads;
+    }
+    bool any = false;
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        ThreadCapture *t = snapshot[i];
+        uint64_t *chunk;
+        while ((chunk = t->full.pop()) != NULL) {
+            spill(t, chunk + 1, chunk[0]);
+            if (!t->free.push(chunk)) {
+                delete[] chunk;
+            }
+            any = true;
+        }
+    }
+    return any;
+}
+
+void Capture::run() {
+    try {
+        while (!stopping.load(memory_order_acquire)) {
+            if (!spill_all()) {
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+        }
+        spill_all();
+    } catch (exception &e) {
+        error = e.what();
+        failed.store(true, memory_order_release);
+        drop_all();
+    }
+}
+
+void capture_slow(uint64_t word) {
+    ThreadCapture *t = (ThreadCapture *)capture_buffer;
+    if (t == NULL || t->chunk == NULL) {
+        // A new thread, or one that recorded in an earlier capture
+        Capture *c = capture.load(memory_order_acquire);
+        if (c == NULL) {
+            return;
+        }
+        t = c->add_thread(-1);
+        capture_buffer = t;
+    } else {
+        // Hand over the full chunk and go on with a free one, waiting for
+        // the background thread if it has too many chunks to write. Once it
+        // failed or the capture stops, the chunk is dropped and reused.
+        t->chunk[0] = t->pos - t->chunk - 1;
+        bool dropped = false;
+        while (!dropped && !t->full.push(t->chunk)) {
+            dropped = t->dropping.load(memory_order_acquire);
+            if (!dropped) {
+                this_thread::yield();
+            }
+        }
+        if (!dropped) {
+            t->chunk = t->free.pop();
+            if (t->chunk == NULL) {
+                t->chunk = new uint64_t[chunk_entries + 1];
+            }
+        }
+        t->pos = t->chunk + 1;
+        t->end = t->chunk + 1 + chunk_entries;
+    }
+    *t->pos++ = word;
+}
+
+void trace_start(const string &filename, const string &workload,
+                 const string &params, uint32_t line_size) {
+    lock_guard<mutex> guard(capture_lock);
+    if (capture.load() != NULL) {
+        throw runtime_error("A trace capture runs already");
+    }
+
+    // Fail here rather than in the background thread if the trace, and so
+    // the spill files next to it, cannot be created
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == NULL) {
+        throw runtime_error("Unable to create " + filename);
+    }
+    fclose(f);
+
+    Capture *c = new Capture;
+    c->filename = filename;
+    c->workload = workload;
+    c->params = params;
+    c->line_size = line_size;
+    c->next_pid = 0;
+    c->stopping = false;
+    c->failed = false;
+    try {
+        c->writer = thread(&Capture::run, c);
+    } catch (exception &e) {
+        delete c;
+        throw runtime_error(string("Unable to start the trace writer thread: ") + e.what());
+    }
+    capture.store(c, memory_order_release);
+}
+
+void trace_thread(uint32_t pid) {
+    ThreadCapture *t = (ThreadCapture *)capture_buffer;
+    if (t != NULL && t->chunk != NULL) {
+        throw runtime_error("The thread recorded already as CPU " + to_string(t->pid));
+    }
+    Capture *c = capture.load(memory_order_acquire);
+    if (c == NULL) {
+        throw runtime_error("No trace capture runs");
+    }
+    capture_buffer = c->add_thread(pid);
+}
+
+void trace_barrier() {
+    capture_record(TraceFile::ENTRY_TYPE_BARRIER, 0, 1);
+    ThreadCapture *t = (ThreadCapture *)capture_buffer;
+    if (t != NULL && t->chunk != NULL) {
+        t->barriers++;
+    }
+}
+
+void trace_stop() {
+    Capture *c;
+    {
+        lock_guard<mutex> guard(capture_lock);
+        c = capture.exchange(NULL);
+    }
+    if (c == NULL) {
+        throw runtime_error("No trace capture runs");
+    }
+    c->drop_all();
+    c->stopping.store(true, memory_order_release);
+    c->writer.join();
+
+    // Spill what is left, close the buffers and merge the spill files. The
+    // buffers themselves stay allocated: other threads may still point to
+    // them, and find them closed when they record again.
+    string error = c->error;
+    uint32_t procs_count = c->pids.size();
+    vector<ThreadCapture *> by_pid(procs_count, (ThreadCapture *)NULL);
+    try {
+        for (size_t i = 0; i < c->threads.size(); i++) {
+            ThreadCapture *t = c->threads[i];
+            uint64_t *chunk;
+            while (error.empty() && (chunk = t->full.pop()) != NULL) {
+                c->spill(t, chunk + 1, chunk[0]);
+                delete[] chunk;
+            }
+            if (error.empty()) {
+                c->spill(t, t->chunk + 1, t->pos - t->chunk - 1);
+            }
+            by_pid[t->pid] = t;
+        }
+
+        if (error.empty() && procs_count > 0) {
+            TraceWriter writer(c->filename.c_str(), procs_count);
+            writer.set_workload(c->workload);
+            writer.set_params(c->params);
+            writer.set_line_size(c->line_size);
+            for (uint32_t pid = 0; pid < procs_count; pid++) {
+                if (by_pid[pid] != NULL && by_pid[pid]->spill != NULL) {
+                    rewind(by_pid[pid]->spill);
+                }
+            }
+
+            // Read the threads side by side, so the writer only holds a few
+            // batches of every CPU
+            vector<uint64_t> words(merge_batch);
+            vector<TraceFile::PackedEntry> batch(merge_batch);
+            bool more = true;
+            while (more) {
+                more = false;
+                for (uint32_t pid = 0; pid < procs_count; pid++) {
+                    ThreadCapture *t = by_pid[pid];
+                    if (t == NULL || t->spill == NULL) {
+                        continue;
+                    }
+                    size_t n = fread(words.data(), sizeof(uint64_t), words.size(), t->spill);
+                    for (size_t i = 0; i < n; i++) {
+                        batch[i].word = words[i];
+                    }
+                    writer.add(pid, batch.data(), n);
+                    more |= n > 0;
+                }
+            }
+            writer.close();
+        }
+    } catch (exception &e) {
+        if (error.empty()) {
+            error = e.what();
+        }
+    }
+
+    uint64_t min_barriers = UINT64_MAX;
+    uint64_t max_barriers = 0;
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        uint64_t barriers = by_pid[pid] != NULL ? by_pid[pid]->barriers : 0;
+        min_barriers = barriers < min_barriers ? barriers : min_barriers;
+        max_barriers = barriers > max_barriers ? barriers : max_barriers;
+    }
+    for (size_t i = 0; i < c->threads.size(); i++) {
+        ThreadCapture *t = c->threads[i];
+        if (t->spill != NULL) {
+            fclose(t->spill);
+            remove(t->spill_name.c_str());
+        }
+        uint64_t *chunk;
+        while ((chunk = t->free.pop()) != NULL) {
+            delete[] chunk;
+        }
+        delete[] t->chunk;
+        t->chunk = NULL;
+        t->pos = NULL;
+        t->end = NULL;
+    }
+    delete c;
+
+    if (!error.empty()) {
+        throw runtime_error("Trace capture failed: " + error);
+    }
+    if (min_barriers != max_barriers) {
+        throw runtime_error("The threads of the trace capture recorded between " +
+                            to_string(min_barriers) + " and " + to_string(max_barriers) +
+                            " barriers");
+    }
+}
@@ -0,0 +1,103 @@
+/*
+// Header file for the trace capture library, which records the memory
+// accesses of a multithreaded program from within the program and writes
+// them as a 5TRF trace, e.g. to trace a kernel at sizes the simulators were
+// never given traces for. The program calls the functions below next to the
+// accesses it wants traced:
+//   trace_start("matmul.trf");
+//   ... in every thread:
+//       trace_read(&a[i][k]); trace_read(&b[k][j]); ...
+//       trace_write(&c[i][j]);
+//       trace_barrier(); // wherever the threads synchronize
+//   ... after joining the threads:
+//   trace_stop();
+// Only this file, trace_capture.cpp, trace_writer.cpp and trace_header.cpp
+// are needed, the program does not link against SystemC:
+//   g++ -O2 -pthread -I lib prog.cpp lib/trace_capture.cpp
+//       lib/trace_writer.cpp lib/trace_header.cpp
+//
+// Every thread records into a buffer of its own with a plain store, without
+// locks or atomics, so recording costs a few nanoseconds. Full chunks of a
+// buffer are passed to a background thread through a lock-free single
+// producer, single consumer ring. It spills them to a file per thread next to
+// the trace, which trace_stop() merges into the 5TRF file. When the
+// background thread falls behind the recording threads wait for it. If it
+// fails, e.g. as the disk is full, the threads drop what they record from
+// then on and trace_stop() reports the error.
+//
+// A thread becomes CPU n when it records its first entry and n threads
+// recorded before it, or it picks its CPU with trace_thread() first. A
+// barrier of the trace makes the CPUs wait for each other, so every thread
+// has to record the barriers the others record, as it passes the same
+// synchronization points of the program; trace_stop() checks this.
+*/
+
+#ifndef TRACE_CAPTURE_H
+#define TRACE_CAPTURE_H
+
+#include "psa.h"
+
+#include <string>
+
+struct CaptureBuffer {
+    uint64_t *pos; // Where the next entry goes
+    uint64_t *end; // End of the current chunk, pos == end when closed
+};
+
+// Buffer of the calling thread, NULL before it recorded anything
+extern thread_local CaptureBuffer *capture_buffer;
+
+// Records an entry when the buffer of the thread has no room, or the thread
+// has no buffer yet. Does nothing while no capture runs.
+void capture_slow(uint64_t word);
+
+inline void capture_record(TraceFile::EntryType type, uint64_t addr, uint32_t size) {
+    uint64_t word = TraceFile::PackedEntry::make(type, addr, size).word;
+    CaptureBuffer *b = capture_buffer;
+    if (b != NULL && b->pos != b->end) {
+        *b->pos++ = word;
+    } else {
+        capture_slow(word);
+    }
+}
+
+/*
+ * Starts a capture into filename, with the workload and parameters given
+ * for the header of the trace. Creates filename right away, the spill files
+ * go next to it. Throws a runtime_error if a capture runs already, filename
+ * cannot be created or the background thread cannot be started.
+ */
+void trace_start(const std::string &filename, const std::string &workload = "",
+                 const std::string &params = "", uint32_t line_size = 0);
+
+/*
+ * Makes the calling thread CPU pid of the trace. Throws a runtime_error if
+ * the thread recorded already or pid is taken.
+ */
+void trace_thread(uint32_t pid);
+
+inline void trace_read(uint64_t addr, uint32_t size = 1) {
+    capture_record(TraceFile::ENTRY_TYPE_READ, addr, size);
+}
+inline void trace_write(uint64_t addr, uint32_t size = 1) {
+    capture_record(TraceFile::ENTRY_TYPE_WRITE, addr, size);
+}
+inline void trace_read(const void *addr, uint32_t size = 1) {
+    trace_read((uint64_t)(uintptr_t)addr, size);
+}
+inline void trace_write(const void *addr, uint32_t size = 1) {
+    trace_write((uint64_t)(uintptr_t)addr, size);
+}
+
+// Records that the calling thread reached a barrier
+void trace_barrier();
+
+/*
+ * Ends the capture and writes the trace. Has to be called once no thread
+ * records anymore. Throws a runtime_error if the trace could not be written
+ * or the threads recorded different numbers of barriers; the trace is
+ * written in the latter case but will not simulate.
+ */
+void trace_stop();
+
+#endif
@@ -0,0 +1,838 @@
+/*
+// Source file for the synthetic trace generators, see trace_gen.h for the
+// patterns and the spec syntax.
+*/
+
+#include "trace_gen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <stdlib.h>
+
+using namespace std;
+
+// Phases start this far apart by default, so they do not share data
+static const uint64_t phase_spacing = 1ULL << 32;
+
+// Private regions of the processors are page aligned
+static const uint64_t page_size = 4096;
+
+// Bytes per instruction fetch
+static const uint32_t insn_size = 4;
+
+static TraceFile::PackedEntry make_entry(TraceFile::EntryType type, uint64_t addr,
+                                         uint32_t size = 1) {
+    return TraceFile::PackedEntry::make(type, addr, size);
+}
+
+// SplitMix64, fast and good enough for address streams
+static inline uint64_t next_random(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Returns a random number below bound
+static inline uint64_t random_below(uint64_t &state, uint64_t bound) {
+    return (uint64_t)(((unsigned __int128)next_random(state) * bound) >> 64);
+}
+
+// Returns a random number in [0, 1)
+static inline double random_unit(uint64_t &state) {
+    return (next_random(state) >> 11) * (1.0 / (1ULL << 53));
+}
+
+/*
+ * Base of the patterns that make len accesses per processor, each preceded
+ * by fetch instruction fetches and followed by a NOP of delay idle cycles
+ * and gap NOPs. Derived classes pass the address of every access to emit().
+ */
+class AccessPattern : public Pattern {
+    public:
+    // A negative writes_default means the pattern only reads
+    AccessPattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params,
+                  double writes_default);
+
+    protected:
+    struct Cpu {
+        uint64_t rng;
+        uint64_t base;     // Start of the region of this processor
+        uint64_t done;     // Accesses made
+        uint64_t gap_left; // NOPs still to come after the last access
+        bool delay_left;   // The delay NOP after the last access is still to come
+        uint64_t fetch_left; // Instruction fetches still to come before the next access
+        uint64_t pc;       // Offset of the next instruction in the code region
+        uint64_t pos;      // Pattern specific position
+    };
+
+    uint64_t m_length;
+    uint64_t m_gap;
+    uint64_t m_delay;      // Idle cycles after every access
+    uint64_t m_fetch;      // Instruction fetches per access
+    uint64_t m_code_base;  // Code region, shared by all processors
+    uint64_t m_code_blocks;
+    uint64_t m_block;      // Bytes per basic block
+    uint32_t m_width;  // Bytes per access
+    uint64_t m_writes; // Accesses with a 32 bit random number below this write
+    uint64_t m_base;
+    std::vector<Cpu> m_cpus;
+
+    // Gives every processor its own region of size bytes, or the same one
+    void set_region(uint64_t size, bool shared);
+
+    // Generates entries, addr(c) returns the address of the next access
+    template <class F>
+    size_t emit(uint32_t pid, TraceFile::PackedEntry *out, size_t n, F addr) {
+        Cpu &c = m_cpus[pid];
+        size_t k = 0;
+        while (k < n && c.done < m_length) {
+            if (c.delay_left) {
+                out[k++] = make_entry(TraceFile::ENTRY_TYPE_NOP, m_delay > 1 ? m_delay : 0);
+                c.delay_left = false;
+                continue;
+            }
+            if (c.gap_left > 0) {
+                size_t g = min<uint64_t>(n - k, c.gap_left);
+                for (size_t i = 0; i < g; i++) {
+                    out[k + i].word = 0;
+                }
+                k += g;
+                c.gap_left -= g;
+                continue;
+            }
+            if (c.fetch_left > 0) {
+                size_t f = min<uint64_t>(n - k, c.fetch_left);
+                for (size_t i = 0; i < f; i++) {
+                    out[k + i] = make_entry(TraceFile::ENTRY_TYPE_IFETCH, fetch_addr(c), insn_size);
+                }
+                k += f;
+                c.fetch_left -= f;
+                continue;
+            }
+
+            size_t stop = min<uint64_t>(n, k + (m_length - c.done));
+            if (m_gap > 0 || m_fetch > 0 || m_delay > 0) {
+                stop = k + 1;
+            }
+            for (; k < stop; k++) {
+                bool write = (next_random(c.rng) >> 32) < m_writes;
+                out[k] = make_entry(write ? TraceFile::ENTRY_TYPE_WRITE : TraceFile::ENTRY_TYPE_READ,
+                                    addr(c), m_width);
+                c.done++;
+            }
+            c.delay_left = m_delay > 0;
+            c.gap_left = m_gap;
+            c.fetch_left = m_fetch;
+        }
+        return k;
+    }
+
+    private:
+    // Address of the next instruction of c. Every basic block ends in a
+    // jump to a random block of the code region.
+    uint64_t fetch_addr(Cpu &c) {
+        uint64_t addr = m_code_base + c.pc;
+        c.pc += insn_size;
+        if (c.pc % m_block == 0) {
+            c.pc = random_below(c.rng, m_code_blocks) * m_block;
+        }
+        return addr;
+    }
+};
+
+AccessPattern::AccessPattern(uint32_t procs_count, uint64_t seed, uint32_t phase,
+                             Params &params, double writes_default)
+: m_cpus(procs_count) {
+    m_length = params.get_count("len", 1 << 20);
+    m_gap = params.get_count("gap", 0);
+    m_delay = params.get_count("delay", 0);
+    if (m_delay > TraceFile::PackedEntry::addr_mask) {
+        throw runtime_error("The delay can be at most 2^55 - 1 cycles");
+    }
+    m_base = params.get_count("base", phase_spacing * (phase + 1));
+    uint64_t width = params.get_count("width", 1);
+    if (width < 1 || width > TraceFile::PackedEntry::max_size) {
+        throw runtime_error("The access width must be 1 to 64 bytes");
+    }
+    m_width = width;
+
+    m_fetch = params.get_count("fetch", 0);
+    uint64_t code = params.get_count("code", 1 << 16);
+    m_block = params.get_count("block", 32);
+    if (m_block < insn_size || m_block % insn_size != 0 || code < m_block) {
+        throw runtime_error("The code needs blocks of a multiple of 4 bytes, at most code bytes");
+    }
+    m_code_blocks = code / m_block;
+    m_code_base = m_base + phase_spacing / 2;
+
+    double writes = 0;
+    if (writes_default >= 0) {
+        writes = params.get_fraction("writes", writes_default);
+        if (writes > 1) {
+            throw runtime_error("The fraction of writes can be at most 1");
+        }
+    }
+    m_writes = (uint64_t)(writes * 4294967296.0);
+
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        Cpu &c = m_cpus[pid];
+        c.rng = seed ^ ((uint64_t)(pid + 1) << 40);
+        next_random(c.rng);
+        c.base = m_base;
+        c.done = 0;
+        c.gap_left = 0;
+        c.delay_left = false;
+        c.fetch_left = m_fetch;
+        c.pc = 0;
+        c.pos = 0;
+    }
+}
+
+void AccessPattern::set_region(uint64_t size, bool shared) {
+    uint64_t span = (size + page_size - 1) / page_size * page_size;
+    for (size_t pid = 0; pid < m_cpus.size(); pid++) {
+        m_cpus[pid].base = m_base + (shared ? 0 : pid * span);
+    }
+}
+
+// Sequential or strided stream, wraps around at the end of the region
+class StridePattern : public AccessPattern {
+    public:
+    StridePattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params)
+    : AccessPattern(procs_count, seed, phase, params, 0.3) {
+        m_stride = params.get_count("stride", 8);
+        m_size = params.get_count("size", max<uint64_t>(m_length * m_stride, 1));
+        if (m_size == 0) {
+            throw runtime_error("seq needs a size of at least 1 byte");
+        }
+        m_stride %= m_size;
+        set_region(m_size, params.get_count("shared", 0) != 0);
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        const uint64_t stride = m_stride, size = m_size;
+        return emit(pid, out, n, [stride, size](Cpu &c) {
+            uint64_t addr = c.base + c.pos;
+            c.pos += stride;
+            if (c.pos >= size) {
+                c.pos -= size;
+            }
+            return addr;
+        });
+    }
+
+    private:
+    uint64_t m_stride;
+    uint64_t m_size;
+};
+
+// Uniformly random aligned accesses to a region
+class UniformPattern : public AccessPattern {
+    public:
+    UniformPattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params)
+    : AccessPattern(procs_count, seed, phase, params, 0.3) {
+        uint64_t size = params.get_count("size", 1 << 20);
+        m_align = params.get_count("align", 8);
+        if (m_align == 0 || size < m_align) {
+            throw runtime_error("uniform needs 0 < align <= size");
+        }
+        m_slots = size / m_align;
+        set_region(size, params.get_count("shared", 1) != 0);
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        const uint64_t slots = m_slots, align = m_align;
+        return emit(pid, out, n, [slots, align](Cpu &c) {
+            return c.base + random_below(c.rng, slots) * align;
+        });
+    }
+
+    private:
+    uint64_t m_align;
+    uint64_t m_slots;
+};
+
+/*
+ * Zipfian accesses to cache lines: rank k is drawn with a probability
+ * proportional to 1 / k^s, by rejection-inversion (W. Hormann and G.
+ * Derflinger, "Rejection-inversion to generate variates from monotone
+ * discrete distributions", 1996), which needs no tables and works for any
+ * s > 0. Ranks are spread over the lines so the hot lines are not adjacent.
+ */
+class ZipfPattern : public AccessPattern {
+    public:
+    ZipfPattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params)
+    : AccessPattern(procs_count, seed, phase, params, 0.3) {
+        m_lines = params.get_count("lines", 1 << 16);
+        m_s = params.get_fraction("s", 0.99);
+        m_line = params.get_count("line", 64);
+        if (m_lines == 0 || m_lines > (1ULL << 32) || m_s <= 0) {
+            throw runtime_error("zipf needs 0 < lines <= 4G and s > 0");
+        }
+        set_region(m_lines * m_line, params.get_count("shared", 1) != 0);
+
+        m_h_x1 = h_integral(1.5) - 1;
+        m_h_n = h_integral(m_lines + 0.5);
+        m_squeeze = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+
+        // Up to 64K lines the distribution is inverted with a table,
+        // which is several times faster
+        if (m_lines <= table_limit) {
+            m_cdf.resize(m_lines);
+            double sum = 0;
+            for (uint64_t k = 0; k < m_lines; k++) {
+                sum += h(k + 1);
+                m_cdf[k] = sum;
+            }
+            for (uint64_t k = 0; k < m_lines; k++) {
+                m_cdf[k] /= sum;
+            }
+            m_cdf[m_lines - 1] = 1;
+
+            // guide[j] is the first rank with a cdf of at least j / lines
+            m_guide.resize(m_lines);
+            uint64_t k = 0;
+            for (uint64_t j = 0; j < m_lines; j++) {
+                while (m_cdf[k] < (double)j / m_lines) {
+                    k++;
+                }
+                m_guide[j] = k;
+            }
+        }
+
+        // A multiplier without common factors with the number of lines
+        // visits every line once
+        m_spread = 0x9E3779B97F4A7C15ULL % m_lines;
+        while (gcd(m_spread, m_lines) != 1) {
+            m_spread++;
+        }
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        return emit(pid, out, n, [this](Cpu &c) {
+            return c.base + (sample(c.rng) - 1) * m_spread % m_lines * m_line;
+        });
+    }
+
+    private:
+    uint64_t m_lines;
+    double m_s;
+    uint64_t m_line;
+    uint64_t m_spread;
+    double m_h_x1;
+    double m_h_n;
+    double m_squeeze;
+
+    static const uint64_t table_limit = 1 << 16;
+    std::vector<double> m_cdf;      // Probability of rank k + 1 or lower
+    std::vector<uint32_t> m_guide;  // Where to start looking in m_cdf
+
+    static uint64_t gcd(uint64_t a, uint64_t b) {
+        while (b != 0) {
+            uint64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // log(1 + x) / x and (exp(x) - 1) / x, accurate near 0
+    static double helper1(double x) {
+        return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+    static double helper2(double x) {
+        return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+    }
+
+    double h(double x) const {
+        return exp(-m_s * log(x));
+    }
+    double h_integral(double x) const {
+        double log_x = log(x);
+        return helper2((1 - m_s) * log_x) * log_x;
+    }
+    double h_integral_inverse(double x) const {
+        double t = x * (1 - m_s);
+        if (t < -1) {
+            t = -1; // Rounding errors
+        }
+        return exp(helper1(t) * x);
+    }
+
+    uint64_t sample(uint64_t &rng) const {
+        if (!m_cdf.empty()) {
+            double u = random_unit(rng);
+            uint64_t k = m_guide[(size_t)(u * m_lines)];
+            while (m_cdf[k] < u) {
+                k++;
+            }
+            return k + 1;
+        }
+
+        while (true) {
+            double u = m_h_n + random_unit(rng) * (m_h_x1 - m_h_n);
+            double x = h_integral_inverse(u);
+            double k = floor(x + 0.5);
+            if (k < 1) {
+                k = 1;
+            } else if (k > m_lines) {
+                k = m_lines;
+            }
+            if (k - x <= m_squeeze || u >= h_integral(k + 0.5) - h(k)) {
+                return (uint64_t)k;
+            }
+        }
+    }
+};
+
+// Pointer chase through a random cycle over all nodes
+class ChasePattern : public AccessPattern {
+    public:
+    ChasePattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params)
+    : AccessPattern(procs_count, seed, phase, params, -1) {
+        uint64_t nodes = params.get_count("nodes", 1 << 16);
+        m_node = params.get_count("node", 64);
+        bool shared = params.get_count("shared", 0) != 0;
+        if (nodes == 0 || nodes > (1ULL << 32)) {
+            throw runtime_error("chase needs 0 < nodes <= 4G");
+        }
+        set_region(nodes * m_node, shared);
+
+        // Sattolo's algorithm gives a single cycle through all nodes
+        uint64_t rng = seed;
+        m_next.resize(nodes);
+        for (uint64_t i = 0; i < nodes; i++) {
+            m_next[i] = i;
+        }
+        for (uint64_t i = nodes - 1; i > 0; i--) {
+            swap(m_next[i], m_next[random_below(rng, i)]);
+        }
+
+        // Processors sharing the nodes start at different places
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            m_cpus[pid].pos = shared ? nodes * pid / procs_count : 0;
+        }
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        const uint32_t *next = m_next.data();
+        const uint64_t node = m_node;
+        return emit(pid, out, n, [next, node](Cpu &c) {
+            uint64_t addr = c.base + c.pos * node;
+            c.pos = next[c.pos];
+            return addr;
+        });
+    }
+
+    private:
+    uint64_t m_node;
+    std::vector<uint32_t> m_next;
+};
+
+// Every processor accesses its own word of a single shared line
+class FalseSharingPattern : public AccessPattern {
+    public:
+    FalseSharingPattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params)
+    : AccessPattern(procs_count, seed, phase, params, 1) {
+        uint64_t line = params.get_count("line", 64);
+        if (line < 8) {
+            throw runtime_error("false needs a line of at least 8 bytes");
+        }
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            m_cpus[pid].base = m_base + pid % (line / 8) * 8;
+        }
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        return emit(pid, out, n, [](Cpu &c) {
+            return c.base;
+        });
+    }
+};
+
+/*
+ * Producer/consumer handoff. Every round each processor writes every line
+ * of its buffer, waits at a barrier, reads every line of the buffer of the
+ * previous processor and waits at a barrier again.
+ */
+class ProducerConsumerPattern : public Pattern {
+    public:
+    ProducerConsumerPattern(uint32_t procs_count, uint32_t phase, Params &params)
+    : m_cpus(procs_count) {
+        m_rounds = params.get_count("rounds", 16);
+        m_lines = params.get_count("lines", 64);
+        m_line = params.get_count("line", 64);
+        m_gap = params.get_count("gap", 0);
+        uint64_t base = params.get_count("base", phase_spacing * (phase + 1));
+        uint64_t span = (m_lines * m_line + page_size - 1) / page_size * page_size;
+
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            Cpu &c = m_cpus[pid];
+            c.own = base + pid * span;
+            c.other = base + (pid + procs_count - 1) % procs_count * span;
+            c.round = 0;
+            c.step = STEP_WRITE;
+            c.line = 0;
+            c.gap_left = 0;
+        }
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        Cpu &c = m_cpus[pid];
+        size_t k = 0;
+        while (k < n && c.round < m_rounds) {
+            if (c.gap_left > 0) {
+                out[k++].word = 0;
+                c.gap_left--;
+                continue;
+            }
+
+            switch (c.step) {
+            case STEP_WRITE:
+            case STEP_READ:
+                if (c.line < m_lines) {
+                    bool write = c.step == STEP_WRITE;
+                    out[k++] = make_entry(write ? TraceFile::ENTRY_TYPE_WRITE : TraceFile::ENTRY_TYPE_READ,
+                                          (write ? c.own : c.other) + c.line * m_line);
+                    c.line++;
+                    c.gap_left = m_gap;
+                } else {
+                    c.line = 0;
+                    c.step = (Step)(c.step + 1);
+                }
+                break;
+            case STEP_HANDOFF:
+                out[k++] = make_entry(TraceFile::ENTRY_TYPE_BARRIER, 0);
+                c.step = STEP_READ;
+                break;
+            case STEP_DONE:
+                // The barrier after the last round is the one between phases
+                c.round++;
+                c.step = STEP_WRITE;
+                if (c.round < m_rounds) {
+                    out[k++] = make_entry(TraceFile::ENTRY_TYPE_BARRIER, 0);
+                }
+                break;
+            }
+        }
+        return k;
+    }
+
+    private:
+    enum Step {
+        STEP_WRITE,
+        STEP_HANDOFF,
+        STEP_READ,
+        STEP_DONE
+    };
+
+    struct Cpu {
+        uint64_t own;   // Buffer written by this processor
+        uint64_t other; // Buffer read by this processor
+        uint64_t round;
+        Step step;
+        uint64_t line;
+        uint64_t gap_left;
+    };
+
+    uint64_t m_rounds;
+    uint64_t m_lines;
+    uint64_t m_line;
+    uint64_t m_gap;
+    std::vector<Cpu> m_cpus;
+};
+
+/*
+ * Lock contention. Every critical section takes a random lock with an
+ * atomic RMW of its lock word, fences, makes hold accesses to the data line
+ * next to the lock word, fences again and releases the lock with a write.
+ */
+class LockPattern : public Pattern {
+    public:
+    LockPattern(uint32_t procs_count, uint64_t seed, uint32_t phase, Params &params)
+    : m_cpus(procs_count) {
+        m_sections = params.get_count("len", 1 << 16);
+        m_locks = params.get_count("locks", 1);
+        m_hold = params.get_count("hold", 4);
+        m_line = params.get_count("line", 64);
+        m_gap = params.get_count("gap", 0);
+        m_base = params.get_count("base", phase_spacing * (phase + 1));
+        double writes = params.get_fraction("writes", 0.5);
+        if (m_locks == 0 || m_line < 8 || writes > 1) {
+            throw runtime_error("lock needs at least 1 lock, a line of at least 8 bytes "
+                                "and at most 1 as the fraction of writes");
+        }
+        m_writes = (uint64_t)(writes * 4294967296.0);
+
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            Cpu &c = m_cpus[pid];
+            c.rng = seed ^ ((uint64_t)(pid + 1) << 40);
+            next_random(c.rng);
+            c.done = 0;
+            c.step = STEP_ACQUIRE;
+            c.lock = 0;
+            c.left = 0;
+        }
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        Cpu &c = m_cpus[pid];
+        size_t k = 0;
+        while (k < n && c.done < m_sections) {
+            // Lock l has its lock word at the start of line 2l, its data in
+            // line 2l + 1
+            uint64_t lock_addr = m_base + c.lock * 2 * m_line;
+            switch (c.step) {
+            case STEP_ACQUIRE:
+                c.lock = random_below(c.rng, m_locks);
+                out[k++] = make_entry(TraceFile::ENTRY_TYPE_RMW, m_base + c.lock * 2 * m_line, 8);
+                c.left = m_hold;
+                c.step = STEP_ENTER;
+                break;
+            case STEP_ENTER:
+            case STEP_LEAVE:
+                out[k++] = make_entry(TraceFile::ENTRY_TYPE_FENCE, 0);
+                c.step = (Step)(c.step + 1);
+                break;
+            case STEP_HOLD:
+                if (c.left > 0) {
+                    bool write = (next_random(c.rng) >> 32) < m_writes;
+                    uint64_t word = (m_hold - c.left) % (m_line / 8);
+                    out[k++] = make_entry(write ? TraceFile::ENTRY_TYPE_WRITE : TraceFile::ENTRY_TYPE_READ,
+                                          lock_addr + m_line + word * 8, 8);
+                    c.left--;
+                } else {
+                    c.step = STEP_LEAVE;
+                }
+                break;
+            case STEP_RELEASE:
+                out[k++] = make_entry(TraceFile::ENTRY_TYPE_WRITE, lock_addr, 8);
+                c.left = m_gap;
+                c.step = STEP_GAP;
+                break;
+            case STEP_GAP:
+                if (c.left > 0) {
+                    out[k++].word = 0;
+                    c.left--;
+                } else {
+                    c.done++;
+                    c.step = STEP_ACQUIRE;
+                }
+                break;
+            }
+        }
+        return k;
+    }
+
+    private:
+    enum Step {
+        STEP_ACQUIRE,
+        STEP_ENTER,
+        STEP_HOLD,
+        STEP_LEAVE,
+        STEP_RELEASE,
+        STEP_GAP
+    };
+
+    struct Cpu {
+        uint64_t rng;
+        uint64_t done; // Critical sections made
+        Step step;
+        uint64_t lock; // Lock of the current critical section
+        uint64_t left; // Accesses or NOPs still to come in this step
+    };
+
+    uint64_t m_sections;
+    uint64_t m_locks;
+    uint64_t m_hold;
+    uint64_t m_line;
+    uint64_t m_gap;
+    uint64_t m_base;
+    uint64_t m_writes; // Accesses with a 32 bit random number below this write
+    std::vector<Cpu> m_cpus;
+};
+
+// NOPs only, e.g. to let other phases drain
+class IdlePattern : public Pattern {
+    public:
+    IdlePattern(uint32_t procs_count, Params &params) : m_left(procs_count) {
+        uint64_t length = params.get_count("len", 1 << 20);
+        std::fill(m_left.begin(), m_left.end(), length);
+    }
+
+    size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+        size_t k = min<uint64_t>(n, m_left[pid]);
+        for (size_t i = 0; i < k; i++) {
+            out[i].word = 0;
+        }
+        m_left[pid] -= k;
+        return k;
+    }
+
+    private:
+    std::vector<uint64_t> m_left;
+};
+
+Pattern *Pattern::create(const string &name, uint32_t procs_count, uint64_t seed,
+                         uint32_t phase, Params &params) {
+    Pattern *pattern;
+    if (name == "seq") {
+        pattern = new StridePattern(procs_count, seed, phase, params);
+    } else if (name == "uniform") {
+        pattern = new UniformPattern(procs_count, seed, phase, params);
+    } else if (name == "zipf") {
+        pattern = new ZipfPattern(procs_count, seed, phase, params);
+    } else if (name == "chase") {
+        pattern = new ChasePattern(procs_count, seed, phase, params);
+    } else if (name == "false") {
+        pattern = new FalseSharingPattern(procs_count, seed, phase, params);
+    } else if (name == "prodcons") {
+        pattern = new ProducerConsumerPattern(procs_count, phase, params);
+    } else if (name == "lock") {
+        pattern = new LockPattern(procs_count, seed, phase, params);
+    } else if (name == "idle") {
+        pattern = new IdlePattern(procs_count, params);
+    } else {
+        throw runtime_error("Unknown trace pattern: " + name);
+    }
+
+    try {
+        params.check_used(name);
+    } catch (exception &e) {
+        delete pattern;
+        throw;
+    }
+    return pattern;
+}
+
+GeneratorTraceReader::GeneratorTraceReader(uint32_t procs_count)
+: m_procs_count(procs_count), m_cpus(procs_count) {
+    if (procs_count == 0) {
+        throw runtime_error("A generated trace needs at least 1 processor");
+    }
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        m_cpus[pid].phase = 0;
+        m_cpus[pid].ended = false;
+    }
+}
+
+// Splits s at every sep
+static vector<string> split(const string &s, char sep) {
+    vector<string> parts;
+    size_t pos = 0;
+    while (true) {
+        size_t next = s.find(sep, pos);
+        parts.push_back(s.substr(pos, next == string::npos ? string::npos : next - pos));
+        if (next == string::npos) {
+            return parts;
+        }
+        pos = next + 1;
+    }
+}
+
+// Parses name=value,... into params
+static void parse_params(const string &list, Params &params, const string &spec) {
+    if (list.empty()) {
+        return;
+    }
+    vector<string> items = split(list, ',');
+    for (size_t i = 0; i < items.size(); i++) {
+        size_t eq = items[i].find('=');
+        if (eq == string::npos || eq == 0) {
+            throw runtime_error("Invalid trace generator spec: " + spec);
+        }
+        params.set(items[i].substr(0, eq), items[i].substr(eq + 1));
+    }
+}
+
+GeneratorTraceReader::GeneratorTraceReader(const string &spec) : m_procs_count(0) {
+    string phases = spec;
+    Params settings;
+    size_t semicolon = spec.find(';');
+    if (semicolon != string::npos) {
+        parse_params(spec.substr(0, semicolon), settings, spec);
+        phases = spec.substr(semicolon + 1);
+    }
+    uint64_t procs_count = settings.get_count("cpus", 1);
+    uint64_t seed = settings.get_count("seed", 1);
+    settings.check_used("the trace generator");
+    if (procs_count == 0 || procs_count > 1024) {
+        throw runtime_error("A generated trace has 1 up to 1024 processors");
+    }
+
+    m_procs_count = procs_count;
+    m_cpus.resize(procs_count);
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        m_cpus[pid].phase = 0;
+        m_cpus[pid].ended = false;
+    }
+
+    try {
+        vector<string> parts = split(phases, '+');
+        for (uint32_t phase = 0; phase < parts.size(); phase++) {
+            const string &part = parts[phase];
+            size_t open = part.find('(');
+            if (open == string::npos || part.empty() || part[part.size() - 1] != ')') {
+                throw runtime_error("Invalid trace generator spec: " + spec);
+            }
+            string name = part.substr(0, open);
+            string list = part.substr(open + 1, part.size() - open - 2);
+
+            Params params;
+            parse_params(list, params, spec);
+            uint64_t repeat = params.get_count("repeat", 1);
+
+            // Repetitions go over the same data with new random numbers
+            for (uint64_t r = 0; r < repeat; r++) {
+                uint64_t phase_seed = seed * 0x100000001B3ULL + (m_phases.size() + 1);
+                Params copy = params;
+                add_phase(Pattern::create(name, m_procs_count, phase_seed, phase, copy));
+            }
+        }
+    } catch (exception &e) {
+        for (size_t i = 0; i < m_phases.size(); i++) {
+            delete m_phases[i];
+        }
+        throw;
+    }
+}
+
+GeneratorTraceReader::~GeneratorTraceReader() {
+    for (size_t i = 0; i < m_phases.size(); i++) {
+        delete m_phases[i];
+    }
+}
+
+void GeneratorTraceReader::add_phase(Pattern *pattern) {
+    m_phases.push_back(pattern);
+}
+
+size_t GeneratorTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    Cpu &c = m_cpus[pid];
+    size_t k = 0;
+    while (k < n && !c.ended) {
+        if (c.phase < m_phases.size()) {
+            size_t got = m_phases[c.phase]->generate(pid, out + k, n - k);
+            if (got > 0) {
+                k += got;
+                continue;
+            }
+
+            // Phases are separated by barriers
+            c.phase++;
+            if (c.phase < m_phases.size()) {
+                out[k++] = make_entry(TraceFile::ENTRY_TYPE_BARRIER, 0);
+            }
+            continue;
+        }
+        out[k++] = make_entry(TraceFile::ENTRY_TYPE_END, 0);
+        c.ended = true;
+    }
+    return k;
+}
+
+uint32_t GeneratorTraceReader::get_proc_count() const {
+    return m_procs_count;
+}
@@ -0,0 +1,110 @@
+/*
+// Header file for the synthetic trace generators. A generated trace is a
+// sequence of phases separated by barriers, every phase runs an access
+// pattern on all processors. Generated traces can be written to a 5TRF file
+// with trf_gen, or drive a simulation directly through the gen: trace
+// source, e.g.
+//   ./assignment_3.bin "gen:cpus=8;seq(len=1M,stride=64)+zipf(len=1M,s=0.9)"
+//
+// A spec is an optional list of settings followed by the phases:
+//   [cpus=N,seed=S;]pattern(param=value,...)[+pattern(...)]...
+// Numbers may end in K, M or G (powers of 1024). Patterns and parameters:
+//   seq       Sequential or strided stream through a region
+//             len, stride (8), size (len * stride), shared (0)
+//   uniform   Uniformly random accesses to a region
+//             len, size (1M), align (8), shared (1)
+//   zipf      Zipfian random accesses to cache lines, rank 1 is hottest
+//             len, lines (64K), s (0.99), line (64), shared (1)
+//   chase     Pointer chase through a random cycle of nodes, reads only
+//             len, nodes (64K), node (64), shared (0)
+//   prodcons  Every processor writes a buffer, then after a barrier reads
+//             the buffer of the previous processor
+//             rounds, lines (64), line (64)
+//   false     All processors access their own word of one shared line
+//             len, line (64), writes (1)
+//   lock      Critical sections on random locks: an atomic RMW of the lock
+//             word, a fence, hold accesses to the data line after the lock
+//             word, a fence and a write to release the lock. Takes gap and
+//             base, writes is the fraction of the hold accesses (0.5)
+//             len (sections), locks (1), hold (4), line (64)
+//   idle      NOPs only
+//             len
+// All patterns but chase and idle take writes (fraction of the accesses
+// that are writes, 0.3 by default). All patterns but prodcons, lock and
+// idle take gap (NOPs after every access, 0), delay (idle cycles after every
+// access, stored in a single NOP, 0), base (start address) and width (bytes
+// per access, 1 to 64, 1 by default). They also take fetch (instruction
+// fetches before every access, 0), code (bytes of code, 64K) and block
+// (bytes per basic block, 32): the fetches run through the basic blocks of
+// a code region shared by all processors, jumping to a random block at the
+// end of each block. A pattern that is not shared gives every processor its
+// own copy of the region. Every phase can be repeated with repeat=N.
+*/
+
+#ifndef TRACE_GEN_H
+#define TRACE_GEN_H
+
+#include "params.h"
+#include "trace_reader.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * An access pattern, which generates a part of the trace of every
+ * processor. Patterns keep their own state per processor and are asked for
+ * entries in batches.
+ */
+class Pattern {
+    public:
+    virtual ~Pattern() {}
+
+    // Generates up to n next entries of processor pid, returns 0 once the
+    // pattern is done for pid
+    virtual size_t generate(uint32_t pid, TraceFile::PackedEntry *out, size_t n) = 0;
+
+    /*
+     * Creates the pattern called name (see above) for procs_count
+     * processors. Phase is the number of the phase it runs in, which picks
+     * the default base address. Throws a runtime_error for unknown patterns
+     * or parameters.
+     */
+    static Pattern *create(const std::string &name, uint32_t procs_count, uint64_t seed,
+                           uint32_t phase, Params &params);
+};
+
+/*
+ * Generates a trace on the fly as a trace source. Phases are added in the
+ * order they run, consecutive phases are separated by a barrier.
+ */
+class GeneratorTraceReader : public TraceReader {
+    public:
+    GeneratorTraceReader(uint32_t procs_count);
+
+    // Parses a spec as described above
+    GeneratorTraceReader(const std::string &spec);
+    ~GeneratorTraceReader();
+
+    // Takes ownership of pattern
+    void add_phase(Pattern *pattern);
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+
+    uint32_t get_proc_count() const;
+
+    private:
+    struct Cpu {
+        size_t phase; // Phase that is generating
+        bool ended;   // The end tag was generated
+    };
+
+    uint32_t m_procs_count;
+    std::vector<Pattern *> m_phases;
+    std::vector<Cpu> m_cpus;
+
+    // No copies are allowed.
+    GeneratorTraceReader(const GeneratorTraceReader &rdr);
+};
+
+#endif
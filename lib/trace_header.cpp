@@ -0,0 +1,161 @@
+/*
+// Source file for the TraceHeader class, see trace_header.h for a
+// description of the format.
+*/
+
+#include "trace_header.h"
+
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static uint64_t get_be64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint32_t get_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be64(vector<unsigned char> &out, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back((unsigned char)(v >> (56 - i * 8)));
+    }
+}
+
+static void put_be32(vector<unsigned char> &out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((unsigned char)(v >> (24 - i * 8)));
+    }
+}
+
+TraceHeader::TraceHeader(uint32_t procs_count)
+: m_procs(procs_count), m_address_bits(0), m_line_size(0) {
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        m_procs[i].entries = 0;
+        m_procs[i].barriers = 0;
+    }
+}
+
+uint32_t TraceHeader::peek_size(const unsigned char *data) {
+    return get_be32(data);
+}
+
+void TraceHeader::parse(uint32_t procs_count, const unsigned char *data, size_t size) {
+    if (size < fixed_size || peek_size(data) != size || size % 8 != 0 ||
+        get_be32(data + 4) < version) {
+        throw runtime_error("Damaged tracefile header");
+    }
+    m_address_bits = get_be32(data + 8);
+    m_line_size = get_be32(data + 12);
+
+    const unsigned char *pos = data + fixed_size;
+    const unsigned char *end = data + size;
+    if (procs_count > (uint64_t)(end - pos) / 16) {
+        throw runtime_error("Damaged tracefile header");
+    }
+    m_procs.resize(procs_count);
+    for (uint32_t i = 0; i < procs_count; i++, pos += 16) {
+        m_procs[i].entries = get_be64(pos);
+        m_procs[i].barriers = get_be64(pos + 8);
+    }
+
+    // Both strings are stored with their length in front
+    string *strings[2] = { &m_workload, &m_params };
+    for (int i = 0; i < 2; i++) {
+        if (end - pos < 4 || get_be32(pos) > (uint64_t)(end - pos - 4)) {
+            throw runtime_error("Damaged tracefile header");
+        }
+        strings[i]->assign((const char *)pos + 4, get_be32(pos));
+        pos += 4 + strings[i]->size();
+    }
+}
+
+uint32_t TraceHeader::get_size() const {
+    uint64_t size = fixed_size + m_procs.size() * 16 + 8 + m_workload.size() + m_params.size();
+    return (size + 7) & ~7ULL;
+}
+
+void TraceHeader::encode(vector<unsigned char> &out) const {
+    size_t start = out.size();
+    put_be32(out, get_size());
+    put_be32(out, version);
+    put_be32(out, m_address_bits);
+    put_be32(out, m_line_size);
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        put_be64(out, m_procs[i].entries);
+        put_be64(out, m_procs[i].barriers);
+    }
+    put_be32(out, m_workload.size());
+    out.insert(out.end(), m_workload.begin(), m_workload.end());
+    put_be32(out, m_params.size());
+    out.insert(out.end(), m_params.begin(), m_params.end());
+    out.resize(start + get_size(), 0);
+}
+
+void TraceHeader::add_entries(uint32_t pid, uint64_t entries, uint64_t barriers) {
+    m_procs.at(pid).entries += entries;
+    m_procs[pid].barriers += barriers;
+}
+
+void TraceHeader::set_address_bits(uint32_t bits) {
+    m_address_bits = bits;
+}
+
+void TraceHeader::set_line_size(uint32_t line_size) {
+    m_line_size = line_size;
+}
+
+void TraceHeader::set_workload(const string &workload) {
+    m_workload = workload;
+}
+
+void TraceHeader::set_params(const string &params) {
+    m_params = params;
+}
+
+uint32_t TraceHeader::get_proc_count() const {
+    return m_procs.size();
+}
+
+bool TraceHeader::has_counts() const {
+    // Every processor has at least its end tag
+    return !m_procs.empty() && m_procs[0].entries > 0;
+}
+
+uint64_t TraceHeader::get_entry_count(uint32_t pid) const {
+    return m_procs.at(pid).entries;
+}
+
+uint64_t TraceHeader::get_barrier_count(uint32_t pid) const {
+    return m_procs.at(pid).barriers;
+}
+
+uint64_t TraceHeader::get_total_entry_count() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        total += m_procs[i].entries;
+    }
+    return total;
+}
+
+uint32_t TraceHeader::get_address_bits() const {
+    return m_address_bits;
+}
+
+uint32_t TraceHeader::get_line_size() const {
+    return m_line_size;
+}
+
+const string &TraceHeader::get_workload() const {
+    return m_workload;
+}
+
+const string &TraceHeader::get_params() const {
+    return m_params;
+}
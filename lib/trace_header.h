@@ -0,0 +1,95 @@
+/*
+// Header file for the TraceHeader class, the version 2 header of the 5TRF
+// format. It describes the trace before any entry is read: how many entries
+// and barriers every processor has, how wide the addresses are and where the
+// trace came from.
+//
+// A file with this header sets header_flag in the processor count, the
+// header follows it. Readers that do not know the flag reject the file as
+// too short. Layout, all fields big endian:
+//   "5TRF" | procs_count | header_flag (32 bit)
+//   header size (32 bit) | version (32 bit)
+//   address bits (32 bit) | line size (32 bit)
+//   per processor: entry count, barrier count (64 bit)
+//   workload name length (32 bit) | workload name
+//   generator parameters length (32 bit) | generator parameters
+//   zero padding up to a multiple of 8 bytes
+// The header size counts the bytes from the size field up to the trace data
+// (or the block table of a transposed trace). Later versions only add fields
+// after the generator parameters, which older readers skip. The entry count
+// of a processor includes its end tag. The counts and the address bits are
+// 0 if the writer could not fill them in, e.g. when it wrote to a pipe. A
+// line size of 0 means no line size is recommended.
+*/
+
+#ifndef TRACE_HEADER_H
+#define TRACE_HEADER_H
+
+#include "psa.h"
+
+#include <string>
+#include <vector>
+
+class TraceHeader {
+    public:
+    static const uint32_t header_flag = 0x40000000;
+    static const uint32_t version = 2;
+
+    // Size of the fields that come before the processor counts
+    static const uint32_t fixed_size = 16;
+
+    TraceHeader(uint32_t procs_count = 0);
+
+    // Returns the header size stored in the first 4 bytes of a header
+    static uint32_t peek_size(const unsigned char *data);
+
+    /*
+     * Parses the size bytes of the header at data, which start right after
+     * the processor count. Throws a runtime_error if the header is damaged.
+     */
+    void parse(uint32_t procs_count, const unsigned char *data, size_t size);
+
+    // Appends the encoded header to out, get_size() bytes
+    void encode(std::vector<unsigned char> &out) const;
+
+    // Size of the encoded header, a multiple of 8 bytes
+    uint32_t get_size() const;
+
+    // Functions to build a header
+    void add_entries(uint32_t pid, uint64_t entries, uint64_t barriers);
+    void set_address_bits(uint32_t bits);
+    void set_line_size(uint32_t line_size);
+    void set_workload(const std::string &workload);
+    void set_params(const std::string &params);
+
+    uint32_t get_proc_count() const;
+
+    // Returns false if the entry and barrier counts are not known
+    bool has_counts() const;
+
+    uint64_t get_entry_count(uint32_t pid) const;
+    uint64_t get_barrier_count(uint32_t pid) const;
+
+    // Sum of the entry counts of all processors
+    uint64_t get_total_entry_count() const;
+
+    // Number of low address bits that are used by any entry
+    uint32_t get_address_bits() const;
+    uint32_t get_line_size() const;
+    const std::string &get_workload() const;
+    const std::string &get_params() const;
+
+    private:
+    struct Proc {
+        uint64_t entries;
+        uint64_t barriers;
+    };
+
+    std::vector<Proc> m_procs;
+    uint32_t m_address_bits;
+    uint32_t m_line_size;
+    std::string m_workload;
+    std::string m_params;
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*
+// Source file for the TraceIndex class, see trace_index.h for a description
+// of the format.
+*/
+
+#include "trace_index.h"
+
+#include <stdexcept>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+static const uint32_t index_version = 1;
+static const size_t header_size = 24;
+static const size_t footer_size = 16;
+
+static uint64_t get_be64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint32_t get_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be64(ostream &output, uint64_t v) {
+    unsigned char data[8];
+    for (int i = 0; i < 8; i++) {
+        data[i] = (unsigned char)(v >> (56 - i * 8));
+    }
+    output.write((const char *)data, sizeof(data));
+}
+
+static void put_be32(ostream &output, uint32_t v) {
+    unsigned char data[4];
+    for (int i = 0; i < 4; i++) {
+        data[i] = (unsigned char)(v >> (24 - i * 8));
+    }
+    output.write((const char *)data, sizeof(data));
+}
+
+// Reads big endian words from the index, checking that they are there
+class IndexParser {
+    public:
+    IndexParser(const unsigned char *pos, const unsigned char *end) : m_pos(pos), m_end(end) {}
+
+    uint64_t next() {
+        if (m_end - m_pos < 8) {
+            throw runtime_error("Damaged tracefile index");
+        }
+        uint64_t v = get_be64(m_pos);
+        m_pos += 8;
+        return v;
+    }
+
+    // Checks that count entries of size bytes are left before allocating them
+    void expect(uint64_t count, uint64_t size) {
+        if (count > (uint64_t)(m_end - m_pos) / size) {
+            throw runtime_error("Damaged tracefile index");
+        }
+    }
+
+    bool done() const { return m_pos == m_end; }
+
+    private:
+    const unsigned char *m_pos;
+    const unsigned char *m_end;
+};
+
+TraceIndex::TraceIndex() : m_state_words(0), m_interval(default_interval) {}
+
+TraceIndex::TraceIndex(uint32_t procs_count, uint32_t state_words, uint64_t interval)
+: m_state_words(state_words), m_interval(interval), m_procs(procs_count) {
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        m_procs[i].entries = 0;
+    }
+}
+
+bool TraceIndex::read(const unsigned char *data, size_t size, uint64_t &data_end) {
+    if (size < footer_size || memcmp(data + size - 8, "5TRFINDX", 8)) {
+        return false;
+    }
+
+    uint64_t start = get_be64(data + size - footer_size);
+    if (start > size - footer_size) {
+        throw runtime_error("Damaged tracefile index");
+    }
+    parse(data + start, size - start, start);
+    data_end = start;
+    return true;
+}
+
+bool TraceIndex::read(istream &input, uint64_t size, uint64_t &data_end) {
+    if (size < footer_size) {
+        return false;
+    }
+
+    unsigned char footer[footer_size];
+    input.clear();
+    input.seekg(size - footer_size);
+    input.read((char *)footer, footer_size);
+    if (input.fail() || memcmp(footer + 8, "5TRFINDX", 8)) {
+        input.clear();
+        return false;
+    }
+
+    uint64_t start = get_be64(footer);
+    if (start > size - footer_size) {
+        throw runtime_error("Damaged tracefile index");
+    }
+    vector<unsigned char> data(size - start);
+    input.seekg(start);
+    input.read((char *)data.data(), data.size());
+    if (input.fail()) {
+        throw runtime_error("Unable to read tracefile index");
+    }
+    parse(data.data(), data.size(), start);
+    data_end = start;
+    return true;
+}
+
+void TraceIndex::parse(const unsigned char *data, size_t size, uint64_t start) {
+    if (size - footer_size < header_size || memcmp(data, "5IDX", 4) ||
+        get_be32(data + 4) != index_version) {
+        throw runtime_error("Damaged tracefile index");
+    }
+
+    uint32_t procs_count = get_be32(data + 8);
+    m_state_words = get_be32(data + 12);
+    IndexParser parser(data + 16, data + size - footer_size);
+    m_interval = parser.next();
+
+    parser.expect(procs_count, 24);
+    m_procs.assign(procs_count, Proc());
+    vector<uint64_t> barriers(procs_count), checkpoints(procs_count);
+    for (uint32_t i = 0; i < procs_count; i++) {
+        m_procs[i].entries = parser.next();
+        barriers[i] = parser.next();
+        checkpoints[i] = parser.next();
+    }
+
+    // Barriers and checkpoints have to be in order and within the trace
+    for (uint32_t i = 0; i < procs_count; i++) {
+        parser.expect(barriers[i], 8);
+        m_procs[i].barriers.resize(barriers[i]);
+        for (uint64_t k = 0; k < barriers[i]; k++) {
+            uint64_t entry = parser.next();
+            if (entry >= m_procs[i].entries || (k > 0 && entry <= m_procs[i].barriers[k - 1])) {
+                throw runtime_error("Damaged tracefile index");
+            }
+            m_procs[i].barriers[k] = entry;
+        }
+    }
+    for (uint32_t i = 0; i < procs_count; i++) {
+        parser.expect(checkpoints[i], 16 + (uint64_t)m_state_words * 8);
+        m_procs[i].checkpoints.resize(checkpoints[i]);
+        for (uint64_t k = 0; k < checkpoints[i]; k++) {
+            TraceCheckpoint &cp = m_procs[i].checkpoints[k];
+            cp.entry = parser.next();
+            cp.offset = parser.next();
+            if (cp.entry > m_procs[i].entries || cp.offset > start ||
+                (k > 0 && cp.entry <= m_procs[i].checkpoints[k - 1].entry)) {
+                throw runtime_error("Damaged tracefile index");
+            }
+            cp.state.resize(m_state_words);
+            for (uint32_t w = 0; w < m_state_words; w++) {
+                cp.state[w] = parser.next();
+            }
+        }
+    }
+    if (!parser.done()) {
+        throw runtime_error("Damaged tracefile index");
+    }
+}
+
+void TraceIndex::write(ostream &output, uint64_t data_end) const {
+    output.write("5IDX", 4);
+    put_be32(output, index_version);
+    put_be32(output, m_procs.size());
+    put_be32(output, m_state_words);
+    put_be64(output, m_interval);
+
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        put_be64(output, m_procs[i].entries);
+        put_be64(output, m_procs[i].barriers.size());
+        put_be64(output, m_procs[i].checkpoints.size());
+    }
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        for (size_t k = 0; k < m_procs[i].barriers.size(); k++) {
+            put_be64(output, m_procs[i].barriers[k]);
+        }
+    }
+    for (size_t i = 0; i < m_procs.size(); i++) {
+        for (size_t k = 0; k < m_procs[i].checkpoints.size(); k++) {
+            const TraceCheckpoint &cp = m_procs[i].checkpoints[k];
+            put_be64(output, cp.entry);
+            put_be64(output, cp.offset);
+            for (uint32_t w = 0; w < m_state_words; w++) {
+                put_be64(output, w < cp.state.size() ? cp.state[w] : 0);
+            }
+        }
+    }
+
+    put_be64(output, data_end);
+    output.write("5TRFINDX", 8);
+}
+
+void TraceIndex::set_entry_count(uint32_t pid, uint64_t entries) {
+    m_procs.at(pid).entries = entries;
+}
+
+void TraceIndex::add_barrier(uint32_t pid, uint64_t entry) {
+    m_procs.at(pid).barriers.push_back(entry);
+}
+
+void TraceIndex::add_checkpoint(uint32_t pid, const TraceCheckpoint &cp) {
+    m_procs.at(pid).checkpoints.push_back(cp);
+}
+
+uint32_t TraceIndex::get_proc_count() const {
+    return m_procs.size();
+}
+
+uint32_t TraceIndex::get_state_words() const {
+    return m_state_words;
+}
+
+uint64_t TraceIndex::get_interval() const {
+    return m_interval;
+}
+
+uint64_t TraceIndex::get_entry_count(uint32_t pid) const {
+    return m_procs.at(pid).entries;
+}
+
+uint64_t TraceIndex::get_barrier_count(uint32_t pid) const {
+    return m_procs.at(pid).barriers.size();
+}
+
+uint64_t TraceIndex::get_barrier(uint32_t pid, uint64_t k) const {
+    return m_procs.at(pid).barriers.at(k);
+}
+
+uint64_t TraceIndex::get_checkpoint_count(uint32_t pid) const {
+    return m_procs.at(pid).checkpoints.size();
+}
+
+const TraceCheckpoint *TraceIndex::find_checkpoint(uint32_t pid, uint64_t entry) const {
+    const vector<TraceCheckpoint> &cps = m_procs.at(pid).checkpoints;
+
+    // Binary search for the first checkpoint after entry
+    size_t lo = 0, hi = cps.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cps[mid].entry <= entry) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == 0 ? NULL : &cps[lo - 1];
+}
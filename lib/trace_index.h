@@ -0,0 +1,94 @@
+/*
+// Header file for the TraceIndex class, the optional index at the end of a
+// tracefile that allows TraceFile to start reading anywhere in the trace.
+//
+// The index is written by trf_index. It follows the trace data, after the
+// end tags of all processors, so readers that do not know about it never
+// read it. Layout, all fields big endian 64 bit unless noted otherwise:
+//   "5IDX" | version (32 bit) | procs_count (32 bit) | state_words (32 bit)
+//   | checkpoint interval
+//   per processor: entry count, barrier count, checkpoint count
+//   per processor: entry index of every barrier
+//   per processor: checkpoints (entry index, offset, state_words words)
+//   offset of "5IDX" in the file | "5TRFINDX"
+//
+// The entry count of a processor includes its end tag. A checkpoint holds
+// everything a reader needs to continue at an entry: the byte offset of the
+// entry for 5TRF, the stream offset and decoder state for 5TRZ.
+*/
+
+#ifndef TRACE_INDEX_H
+#define TRACE_INDEX_H
+
+#include "psa.h"
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+struct TraceCheckpoint {
+    uint64_t entry;  // Index of the next entry of the processor
+    uint64_t offset; // Where that entry is stored, format specific
+    std::vector<uint64_t> state; // Decoder state, format specific
+};
+
+class TraceIndex {
+    public:
+    // Entries per processor between two checkpoints
+    static const uint64_t default_interval = 1 << 16;
+
+    TraceIndex();
+    TraceIndex(uint32_t procs_count, uint32_t state_words,
+               uint64_t interval = default_interval);
+
+    /*
+     * Looks for an index at the end of the size bytes in data. Returns false
+     * if there is none. Otherwise the index is read, data_end is set to the
+     * offset where the trace data ends and true is returned. Throws a
+     * runtime_error if the index is damaged.
+     */
+    bool read(const unsigned char *data, size_t size, uint64_t &data_end);
+
+    // Same as above, for a file of size bytes read through input
+    bool read(std::istream &input, uint64_t size, uint64_t &data_end);
+
+    // Writes the index, data_end is the offset in the file it is written at
+    void write(std::ostream &output, uint64_t data_end) const;
+
+    // Functions to build an index
+    void set_entry_count(uint32_t pid, uint64_t entries);
+    void add_barrier(uint32_t pid, uint64_t entry);
+    void add_checkpoint(uint32_t pid, const TraceCheckpoint &cp);
+
+    uint32_t get_proc_count() const;
+    uint32_t get_state_words() const;
+    uint64_t get_interval() const;
+
+    uint64_t get_entry_count(uint32_t pid) const;
+    uint64_t get_barrier_count(uint32_t pid) const;
+
+    // Returns the entry index of the k-th barrier (counting from 0) of pid
+    uint64_t get_barrier(uint32_t pid, uint64_t k) const;
+
+    uint64_t get_checkpoint_count(uint32_t pid) const;
+
+    // Returns the last checkpoint of pid at or before entry, NULL if none
+    const TraceCheckpoint *find_checkpoint(uint32_t pid, uint64_t entry) const;
+
+    private:
+    struct Proc {
+        uint64_t entries;
+        std::vector<uint64_t> barriers;
+        std::vector<TraceCheckpoint> checkpoints;
+    };
+
+    // Parses the size bytes of the index and footer in data, which start at
+    // offset start of the file
+    void parse(const unsigned char *data, size_t size, uint64_t start);
+
+    uint32_t m_state_words;
+    uint64_t m_interval;
+    std::vector<Proc> m_procs;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/*
+// Source file for multiprogrammed traces, see trace_mix.h for the spec
+// syntax.
+*/
+
+#include "trace_mix.h"
+#include "trace_gen.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+const char *mix_workload = "mix";
+
+// Address space of a job with the default offset
+static const uint64_t job_space = 1ULL << 48;
+
+// Splits s at every sep
+static vector<string> split(const string &s, char sep) {
+    vector<string> parts;
+    size_t pos = 0;
+    while (true) {
+        size_t next = s.find(sep, pos);
+        parts.push_back(s.substr(pos, next == string::npos ? string::npos : next - pos));
+        if (next == string::npos) {
+            return parts;
+        }
+        pos = next + 1;
+    }
+}
+
+MixTraceReader::Job MixTraceReader::parse_job(const string &spec, uint32_t number) {
+    Job job;
+    job.spec = spec;
+    size_t at = spec.rfind('@');
+    job.trace = spec.substr(0, at);
+    if (job.trace.empty()) {
+        throw runtime_error("Invalid job in trace mix: " + spec);
+    }
+
+    Params params;
+    if (at != string::npos) {
+        vector<string> items = split(spec.substr(at + 1), ',');
+        for (size_t i = 0; i < items.size(); i++) {
+            size_t eq = items[i].find('=');
+            if (eq == string::npos || eq == 0) {
+                throw runtime_error("Invalid job in trace mix: " + spec);
+            }
+            params.set(items[i].substr(0, eq), items[i].substr(eq + 1));
+        }
+    }
+    job.offset = params.get_count("offset", UINT64_MAX);
+    job.delay = params.get_count("delay", 0);
+    job.runs = params.get_count("runs", 1);
+    params.check_used("a job");
+
+    if (job.offset == UINT64_MAX) {
+        job.offset = number * job_space;
+        job.limit = job_space;
+    } else if (job.offset > TraceFile::PackedEntry::addr_mask) {
+        throw runtime_error("The address offset of a job must be below 2^55: " + spec);
+    } else {
+        job.limit = TraceFile::PackedEntry::addr_mask + 1 - job.offset;
+    }
+    if (job.runs == 0) {
+        throw runtime_error("A job runs at least once: " + spec);
+    }
+    return job;
+}
+
+MixTraceReader::MixTraceReader(const string &spec, TraceFile::ReadMode mode)
+: m_mode(mode) {
+    vector<string> jobs = split(spec, '+');
+    if (jobs.size() > TraceFile::PackedEntry::addr_mask / job_space) {
+        throw runtime_error("A trace mix has at most 127 jobs");
+    }
+
+    try {
+        for (uint32_t i = 0; i < jobs.size(); i++) {
+            Cpu c;
+            c.job = parse_job(jobs[i], i);
+            c.reader = NULL;
+            c.delay_left = c.job.delay;
+            c.runs_done = 0;
+            c.ended = false;
+            m_cpus.push_back(c);
+            open(m_cpus.back());
+        }
+    } catch (exception &e) {
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            delete m_cpus[i].reader;
+        }
+        throw;
+    }
+
+    m_header = TraceHeader(m_cpus.size());
+    m_header.set_workload(mix_workload);
+    m_header.set_params(spec);
+}
+
+MixTraceReader::~MixTraceReader() {
+    for (size_t i = 0; i < m_cpus.size(); i++) {
+        delete m_cpus[i].reader;
+    }
+}
+
+void MixTraceReader::open(Cpu &c) {
+    delete c.reader;
+    c.reader = NULL;
+
+    uint32_t procs_count;
+    c.reader = open_trace_reader(c.job.trace.c_str(), m_mode, procs_count);
+    if (procs_count != 1) {
+        throw runtime_error("A job of a trace mix needs a single processor trace: " + c.job.trace);
+    }
+}
+
+size_t MixTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    Cpu &c = m_cpus.at(pid);
+    size_t k = 0;
+
+    while (k < n && !c.ended) {
+        if (c.delay_left > 0) {
+            size_t d = c.delay_left < n - k ? c.delay_left : n - k;
+            for (size_t i = 0; i < d; i++) {
+                out[k + i].word = 0;
+            }
+            k += d;
+            c.delay_left -= d;
+            continue;
+        }
+
+        size_t got = c.reader->fetch(0, out + k, n - k);
+        bool ended = got == 0;
+        for (size_t i = k; i < k + got; i++) {
+            switch (out[i].type()) {
+            case TraceFile::ENTRY_TYPE_NOP:
+            case TraceFile::ENTRY_TYPE_FENCE:
+                break; // No address, or the idle cycles of a NOP
+            case TraceFile::ENTRY_TYPE_BARRIER:
+                out[i].word = 0;
+                break;
+            case TraceFile::ENTRY_TYPE_END:
+                ended = true; // Always the last entry, decoding stops after it
+                break;
+            default:
+                if (out[i].addr() >= c.job.limit) {
+                    throw runtime_error("Address out of the address space of the job: " + c.job.spec);
+                }
+                out[i].word += c.job.offset;
+                break;
+            }
+        }
+        k += got;
+
+        if (ended) {
+            // Keep the end tag of the last run only, and end traces without
+            // one too
+            if (got > 0) {
+                k--;
+            }
+            c.runs_done++;
+            if (c.runs_done < c.job.runs) {
+                open(c);
+            } else {
+                out[k++] = TraceFile::PackedEntry::make(TraceFile::ENTRY_TYPE_END, 0);
+                c.ended = true;
+            }
+        }
+    }
+    return k;
+}
+
+const TraceHeader *MixTraceReader::get_header() const {
+    return &m_header;
+}
+
+uint32_t MixTraceReader::get_proc_count() const {
+    return m_cpus.size();
+}
+
+const MixTraceReader::Job &MixTraceReader::get_job(uint32_t pid) const {
+    return m_cpus.at(pid).job;
+}
+
+bool get_mix_jobs(const TraceHeader *header, vector<string> &jobs) {
+    if (header == NULL || header->get_workload() != mix_workload) {
+        return false;
+    }
+    jobs = split(header->get_params(), '+');
+    return jobs.size() == header->get_proc_count();
+}
@@ -0,0 +1,95 @@
+/*
+// Header file for multiprogrammed traces: unrelated single processor jobs
+// that run side by side, one per processor, e.g. to study how they compete
+// for a shared bus or cache. The jobs are read from their own traces while
+// the simulation runs, so a mix needs no space on disk. A mix can drive a
+// simulation directly through the mix: trace source, or be written to a
+// 5TRF file with trf_mix, e.g.
+//   ./assignment_2.bin "mix:tracefiles/fft_1024_p1-O2.trf+tracefiles/matrix_mult_50_50_p1-O2.trf@runs=3"
+//
+// A spec lists the jobs separated by +, each a trace name (a file or
+// scheme:spec) optionally followed by @param=value,... Numbers may end in
+// K, M or G (powers of 1024). Parameters of a job:
+//   offset  Added to every address of the job, job number * 2^48 by
+//           default. Jobs with the default offset must use addresses below
+//           2^48, so the jobs never share data.
+//   delay   NOPs before the job starts (0)
+//   runs    Number of times the job runs, it restarts right after its trace
+//           ends (1)
+// Barriers of a job have no other processors to wait for and become NOPs.
+//
+// The trace of a mix has a version 2 header with the workload name mix and
+// the spec as its parameters, trf_mix writes it to the file too, so the jobs
+// of the processors can be told apart in the statistics (see
+// get_mix_jobs()).
+*/
+
+#ifndef TRACE_MIX_H
+#define TRACE_MIX_H
+
+#include "trace_header.h"
+#include "trace_reader.h"
+
+#include <string>
+#include <vector>
+
+// Workload name of the header of a mix
+extern const char *mix_workload;
+
+class MixTraceReader : public TraceReader {
+    public:
+    struct Job {
+        std::string trace; // Name of the trace, see open_trace_reader()
+        std::string spec;  // The job as given in the spec
+        uint64_t offset;
+        uint64_t limit; // Addresses of the job must be below this
+        uint64_t delay;
+        uint64_t runs;
+    };
+
+    /*
+     * Parses a spec as described above and opens the trace of every job.
+     * Throws a runtime_error for invalid specs, and for jobs with more than
+     * one processor.
+     */
+    MixTraceReader(const std::string &spec, TraceFile::ReadMode mode);
+    ~MixTraceReader();
+
+    // Parses one job of a spec, number is its place in the spec
+    static Job parse_job(const std::string &spec, uint32_t number);
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+    const TraceHeader *get_header() const;
+
+    uint32_t get_proc_count() const;
+
+    // Returns the job that runs on processor pid
+    const Job &get_job(uint32_t pid) const;
+
+    private:
+    struct Cpu {
+        Job job;
+        TraceReader *reader;
+        uint64_t delay_left; // NOPs still to come before the job starts
+        uint64_t runs_done;
+        bool ended;          // The end tag of the last run was read
+    };
+
+    TraceFile::ReadMode m_mode;
+    std::vector<Cpu> m_cpus;
+    TraceHeader m_header;
+
+    // Opens the trace of the job of c from its start
+    void open(Cpu &c);
+
+    // No copies are allowed.
+    MixTraceReader(const MixTraceReader &rdr);
+};
+
+/*
+ * Stores the job of every processor in jobs if header describes a mix, as
+ * written by MixTraceReader or trf_mix. Returns false for other traces.
+ */
+bool get_mix_jobs(const TraceHeader *header, std::vector<std::string> &jobs);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+// Source file for the PrefetchReader class.
+*/
+
+#include "trace_prefetch.h"
+
+#include <string.h>
+
+using namespace std;
+
+PrefetchReader::PrefetchReader(TraceReader *reader, uint32_t procs_count)
+: m_reader(reader), m_queues(procs_count, NULL), m_stop(false),
+  m_reader_sleeping(false), m_consumer_sleeping(false) {
+    for (uint32_t i = 0; i < procs_count; i++) {
+        Queue *q = new Queue;
+        q->entries.resize(queue_size);
+        q->head = 0;
+        q->tail = 0;
+        q->done = false;
+        q->stalls = 0;
+        m_queues[i] = q;
+    }
+
+    m_thread = thread(&PrefetchReader::run, this);
+}
+
+PrefetchReader::~PrefetchReader() {
+    stop();
+    for (size_t i = 0; i < m_queues.size(); i++) {
+        delete m_queues[i];
+    }
+    delete m_reader;
+}
+
+void PrefetchReader::stop() {
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_space_cv.notify_all();
+    m_thread.join();
+}
+
+const TraceIndex *PrefetchReader::get_index() const {
+    return m_reader->get_index();
+}
+
+const TraceHeader *PrefetchReader::get_header() const {
+    return m_reader->get_header();
+}
+
+void PrefetchReader::seek(const vector<uint64_t> &entries) {
+    stop();
+
+    // Also restarts the reader thread if seeking fails, the rings are
+    // emptied either way
+    exception_ptr error;
+    try {
+        m_reader->seek(entries);
+    } catch (...) {
+        error = current_exception();
+    }
+
+    for (size_t i = 0; i < m_queues.size(); i++) {
+        m_queues[i]->head = 0;
+        m_queues[i]->tail = 0;
+        m_queues[i]->done = false;
+    }
+    m_error = NULL;
+    m_stop = false;
+    m_thread = thread(&PrefetchReader::run, this);
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+bool PrefetchReader::is_mapped() const {
+    return m_reader->is_mapped();
+}
+
+uint64_t PrefetchReader::get_stall_count(uint32_t pid) const {
+    return m_queues[pid]->stalls;
+}
+
+bool PrefetchReader::fill(uint32_t pid) {
+    Queue &q = *m_queues[pid];
+    if (q.done.load(memory_order_relaxed)) {
+        return false;
+    }
+
+    uint64_t tail = q.tail.load(memory_order_relaxed);
+    uint64_t head = q.head.load(memory_order_acquire);
+    if (queue_size - (tail - head) < chunk_size) {
+        return false;
+    }
+
+    // Chunks never wrap around, queue_size is a multiple of chunk_size
+    size_t got = m_reader->fetch(pid, &q.entries[tail & (queue_size - 1)], chunk_size);
+    if (got == 0) {
+        q.done.store(true, memory_order_release);
+    } else {
+        q.tail.store(tail + got, memory_order_release);
+    }
+
+    // The consumer sets the flag before it checks the ring for the last
+    // time, so either it sees the new entries or we see that it sleeps.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (m_consumer_sleeping.load()) {
+        lock_guard<mutex> guard(m_lock);
+        m_data_cv.notify_one();
+    }
+    return true;
+}
+
+void PrefetchReader::run() {
+    try {
+        while (!m_stop.load(memory_order_relaxed)) {
+            bool progress = false;
+            bool all_done = true;
+            for (uint32_t pid = 0; pid < m_queues.size(); pid++) {
+                progress = fill(pid) || progress;
+                all_done = all_done && m_queues[pid]->done.load(memory_order_relaxed);
+            }
+            if (all_done) {
+                break;
+            }
+            if (progress) {
+                continue;
+            }
+
+            // Every ring is full, wait until the simulation consumes entries
+            unique_lock<mutex> guard(m_lock);
+            m_reader_sleeping = true;
+            m_space_cv.wait(guard, [this] {
+                if (m_stop) {
+                    return true;
+                }
+                for (size_t i = 0; i < m_queues.size(); i++) {
+                    Queue &q = *m_queues[i];
+                    if (!q.done && queue_size - (q.tail - q.head) >= chunk_size) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+            m_reader_sleeping = false;
+        }
+    } catch (...) {
+        // Handed to the simulation thread once it runs out of entries
+        m_error = current_exception();
+        for (size_t i = 0; i < m_queues.size(); i++) {
+            m_queues[i]->done.store(true, memory_order_release);
+        }
+    }
+
+    lock_guard<mutex> guard(m_lock);
+    m_data_cv.notify_all();
+}
+
+size_t PrefetchReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    Queue &q = *m_queues[pid];
+    uint64_t head = q.head.load(memory_order_relaxed);
+    uint64_t tail = q.tail.load(memory_order_acquire);
+
+    if (head == tail) {
+        // The tail is final once done is set
+        bool done = q.done.load(memory_order_acquire);
+        if (done && q.tail.load(memory_order_acquire) == head) {
+            if (m_error) {
+                rethrow_exception(m_error);
+            }
+            return 0;
+        }
+
+        // The reader thread fell behind
+        if (!done) {
+            q.stalls++;
+            unique_lock<mutex> guard(m_lock);
+            m_consumer_sleeping = true;
+            m_data_cv.wait(guard, [&q, head] { return q.tail != head || q.done; });
+            m_consumer_sleeping = false;
+        }
+        return fetch(pid, out, n);
+    }
+
+    // Copy out of the ring, in two parts if the entries wrap around
+    size_t k = tail - head < n ? tail - head : n;
+    size_t start = head & (queue_size - 1);
+    size_t first = queue_size - start < k ? queue_size - start : k;
+    memcpy(out, &q.entries[start], first * sizeof(TraceFile::PackedEntry));
+    memcpy(out + first, &q.entries[0], (k - first) * sizeof(TraceFile::PackedEntry));
+    q.head.store(head + k, memory_order_release);
+
+    // Orders the store above before the check, see fill()
+    atomic_thread_fence(memory_order_seq_cst);
+    if (m_reader_sleeping.load()) {
+        lock_guard<mutex> guard(m_lock);
+        m_space_cv.notify_one();
+    }
+    return k;
+}
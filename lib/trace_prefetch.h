@@ -0,0 +1,87 @@
+/*
+// Header file for the PrefetchReader class, which decodes a trace on a
+// background thread so the simulation thread does not wait for file I/O or
+// decompression.
+*/
+
+#ifndef TRACE_PREFETCH_H
+#define TRACE_PREFETCH_H
+
+#include "trace_reader.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Wraps another reader. A reader thread goes round-robin over the processors
+ * and decodes their entries ahead into a single-producer/single-consumer ring
+ * per processor. The ring is filled in chunks of a quarter of its size, so
+ * the simulation thread drains one part while the reader thread fills the
+ * next one. fetch() only copies entries out of the ring; the barrier and end
+ * bookkeeping stays with TraceFile on the simulation thread.
+ *
+ * Every fetch() that finds the ring of its processor empty while the trace
+ * has not been fully decoded yet counts as a stall.
+ */
+class PrefetchReader : public TraceReader {
+    public:
+    // Takes ownership of reader
+    PrefetchReader(TraceReader *reader, uint32_t procs_count);
+    ~PrefetchReader();
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+    bool is_mapped() const;
+    const TraceHeader *get_header() const;
+
+    // Seeking stops the reader thread, empties the rings and starts over
+    const TraceIndex *get_index() const;
+    void seek(const std::vector<uint64_t> &entries);
+
+    // Returns the number of times processor pid had to wait for the reader
+    uint64_t get_stall_count(uint32_t pid) const;
+
+    private:
+    static const size_t queue_size = 1 << 16; // Entries per processor, power of 2
+    static const size_t chunk_size = queue_size / 4;
+
+    struct Queue {
+        std::vector<TraceFile::PackedEntry> entries;
+        alignas(64) std::atomic<uint64_t> head; // Written by the consumer
+        alignas(64) std::atomic<uint64_t> tail; // Written by the reader thread
+        std::atomic<bool> done; // No entries will be added anymore
+        uint64_t stalls;
+    };
+
+    TraceReader *m_reader;
+    std::vector<Queue *> m_queues;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::exception_ptr m_error; // Set by the reader thread before it stops
+
+    // Used to sleep when a ring is full (reader) or empty (consumer)
+    std::mutex m_lock;
+    std::condition_variable m_space_cv;
+    std::condition_variable m_data_cv;
+    std::atomic<bool> m_reader_sleeping;
+    std::atomic<bool> m_consumer_sleeping;
+
+    // Body of the reader thread
+    void run();
+
+    // Stops the reader thread, it can be started again afterwards
+    void stop();
+
+    // Decodes the next chunk of processor pid if its ring has room for it,
+    // returns false if there was nothing to do.
+    bool fill(uint32_t pid);
+
+    // No copies are allowed.
+    PrefetchReader(const PrefetchReader &rdr);
+};
+
+#endif
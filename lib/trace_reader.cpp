@@ -0,0 +1,983 @@
+/*
+// Source file for the trace readers used by the TraceFile class.
+// Contains the reader for the interleaved 5TRF format and the code that
+// picks a reader based on the file signature.
+*/
+
+#include "trace_reader.h"
+#include "trace_gen.h"
+#include "trace_mix.h"
+#include "trace_shm.h"
+#include "trz.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <errno.h>
+#include <map>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <machine/endian.h>
+#else
+#include <endian.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+#if defined(__BYTE_ORDER) && (__BYTE_ORDER == __LITTLE_ENDIAN) || (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define HOST_LITTLE_ENDIAN 1
+#else
+#define HOST_LITTLE_ENDIAN 0
+#endif
+
+void ntohll_block(uint64_t *words, size_t n) {
+#if HOST_LITTLE_ENDIAN
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i rev = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8);
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&words[i]);
+        _mm256_storeu_si256((__m256i *)&words[i], _mm256_shuffle_epi8(v, rev));
+    }
+#elif defined(__SSSE3__)
+    const __m128i rev = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                      15, 14, 13, 12, 11, 10, 9, 8);
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&words[i]);
+        _mm_storeu_si128((__m128i *)&words[i], _mm_shuffle_epi8(v, rev));
+    }
+#elif defined(__SSE2__)
+    // Swap the bytes of every 16 bit word, then reverse the order of the
+    // 16 bit words within each 64 bit word.
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&words[i]);
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128((__m128i *)&words[i], v);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n; i += 2) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)&words[i]);
+        vst1q_u8((uint8_t *)&words[i], vrev64q_u8(v));
+    }
+#endif
+
+    for (; i < n; i++) {
+        words[i] = __builtin_bswap64(words[i]);
+    }
+#else
+    (void)words;
+    (void)n;
+#endif
+}
+
+// Reads until len bytes are read or the end of the file is reached. Returns
+// the number of bytes read, -1 on error.
+static ssize_t read_fully(int fd, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t got = ::read(fd, (char *)buf + done, len - done);
+        if (got == 0) {
+            break;
+        }
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += got;
+    }
+    return done;
+}
+
+FileImage::FileImage() : m_data(NULL), m_size(0), m_mapped(false) {}
+
+FileImage::~FileImage() {
+    if (m_mapped) {
+        munmap((void *)m_data, m_size);
+    }
+}
+
+bool FileImage::map(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // Traces are read front to back
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    m_data = (const unsigned char *)map;
+    m_size = st.st_size;
+    m_mapped = true;
+    return true;
+}
+
+void FileImage::load(const char *filename, TraceFile::ReadMode mode) {
+    if (mode != TraceFile::READ_STREAM && map(filename)) {
+        return;
+    }
+    if (mode == TraceFile::READ_MMAP) {
+        throw runtime_error(string("Unable to map file: ") + filename);
+    }
+
+    // Fall back to reading the whole file into memory
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+
+    try {
+        read(fd, NULL, 0);
+    } catch (exception &e) {
+        ::close(fd);
+        throw runtime_error(string("Unable to read file: ") + filename);
+    }
+    ::close(fd);
+}
+
+void FileImage::read(int fd, const char *prefix, size_t len) {
+    m_copy.assign(prefix, prefix + len);
+
+    unsigned char buf[1 << 16];
+    ssize_t got;
+    while ((got = read_fully(fd, buf, sizeof(buf))) > 0) {
+        m_copy.insert(m_copy.end(), buf, buf + got);
+    }
+    if (got < 0) {
+        throw runtime_error("Unable to read file");
+    }
+
+    m_data = m_copy.data();
+    m_size = m_copy.size();
+}
+
+RawTraceReader::RawTraceReader(const char *filename, TraceFile::ReadMode mode)
+: m_input(filename, ios::in | ios::binary), m_stride(0), m_transposed(false),
+  m_has_header(false), m_has_index(false), m_map(NULL) {
+    // Check if the file properly opened
+    if (!m_input.is_open() || !m_input.good()) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+
+    // Check file signature
+    char signature[4];
+    m_input.read((char *)&signature, 4);
+    if (m_input.fail() || strncmp(signature, "5TRF", 4)) {
+        throw runtime_error(string("Invalid file signature in file: ") + filename);
+    }
+
+    // Read number of processors the file was created for
+    uint32_t procs_count;
+    m_input.read((char *)&procs_count, sizeof(uint32_t));
+    if (m_input.fail()) {
+        throw runtime_error("Unable to read file");
+    }
+
+    // Transform result into host-order
+    procs_count = ntohl(procs_count);
+    m_transposed = (procs_count & transposed_flag) != 0;
+    m_has_header = (procs_count & TraceHeader::header_flag) != 0;
+    procs_count &= ~(transposed_flag | TraceHeader::header_flag);
+
+    m_positions.resize(procs_count);
+    m_first.resize(procs_count);
+    m_ends.resize(procs_count);
+    uint64_t start = (uint64_t)m_input.tellg();
+
+    // Prefer reading straight from a mapping of the file, the stream reader
+    // has to seek for every batch as the processor traces are interleaved.
+    // The mapping knows the size of the file, otherwise find its end.
+    if (mode != TraceFile::READ_STREAM && m_image.map(filename)) {
+        m_map = m_image.data();
+        m_endstream = m_image.size();
+    } else if (mode == TraceFile::READ_MMAP) {
+        throw runtime_error(string("Unable to map file: ") + filename);
+    } else {
+        m_input.seekg(0, ios::end);
+        m_endstream = (uint64_t)m_input.tellg();
+    }
+
+    if (m_has_header) {
+        start += read_header(filename);
+    }
+
+    // An index at the end of the file is not part of the trace data
+    if (m_map != NULL) {
+        m_has_index = m_index.read(m_map, m_endstream, m_endstream);
+    } else {
+        m_has_index = m_index.read(m_input, m_endstream, m_endstream);
+    }
+
+    // Set the start positions of the processor traces
+    if (m_transposed) {
+        read_blocks(filename, start);
+    } else {
+        if ((start + (procs_count * entry_size) + (entry_size - 1)) >= m_endstream) {
+            throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+        }
+        m_stride = (uint64_t)procs_count * entry_size;
+        for (uint32_t i = 0; i < procs_count; i++) {
+            m_first[i] = start + (uint64_t)i * entry_size;
+            m_ends[i] = m_endstream;
+        }
+
+        // With the entry counts of the header every processor stops right
+        // after its end tag. A truncated file is read as far as it goes.
+        if (m_has_header && m_header.has_counts()) {
+            for (uint32_t i = 0; i < procs_count; i++) {
+                uint64_t entries = m_header.get_entry_count(i);
+                if (entries > 0 && entries <= stored_entries(i)) {
+                    m_ends[i] = entry_offset(i, entries - 1) + entry_size;
+                }
+            }
+        }
+    }
+    m_positions = m_first;
+
+    if (m_has_index) {
+        validate_index(filename);
+    }
+
+    // The stream is only needed when the file could not be mapped
+    if (m_map != NULL) {
+        m_input.close();
+    }
+}
+
+void RawTraceReader::read_bytes(uint64_t pos, unsigned char *out, size_t size) {
+    if (m_map != NULL) {
+        memcpy(out, m_map + pos, size);
+    } else {
+        m_input.seekg(pos);
+        m_input.read((char *)out, size);
+        if (m_input.fail()) {
+            throw runtime_error("Unable to read file");
+        }
+    }
+}
+
+uint64_t RawTraceReader::read_header(const char *filename) {
+    unsigned char size_field[4];
+    if (m_endstream < 8 + sizeof(size_field)) {
+        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+    }
+    read_bytes(8, size_field, sizeof(size_field));
+
+    uint32_t size = TraceHeader::peek_size(size_field);
+    if (8 + (uint64_t)size > m_endstream) {
+        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+    }
+    vector<unsigned char> data(size);
+    read_bytes(8, data.data(), data.size());
+    m_header.parse(get_proc_count(), data.data(), data.size());
+    return size;
+}
+
+void RawTraceReader::read_blocks(const char *filename, uint64_t start) {
+    uint32_t procs_count = get_proc_count();
+    uint64_t table_end = start + (uint64_t)procs_count * 16;
+    if (procs_count == 0 || table_end > m_endstream) {
+        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+    }
+
+    vector<unsigned char> table(table_end - start);
+    read_bytes(start, table.data(), table.size());
+
+    m_stride = entry_size;
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        uint64_t words[2];
+        memcpy(words, table.data() + pid * 16, sizeof(words));
+        ntohll_block(words, 2);
+        if (words[0] < table_end || words[0] > m_endstream ||
+            words[1] > (m_endstream - words[0]) / entry_size ||
+            (m_has_header && m_header.has_counts() &&
+             words[1] != m_header.get_entry_count(pid))) {
+            throw runtime_error(string("Damaged block table in tracefile: ") + filename);
+        }
+        m_first[pid] = words[0];
+        m_ends[pid] = words[0] + words[1] * entry_size;
+    }
+}
+
+uint64_t RawTraceReader::stored_entries(uint32_t pid) const {
+    if (m_ends[pid] < m_first[pid] + entry_size) {
+        return 0;
+    }
+    return (m_ends[pid] - entry_size - m_first[pid]) / m_stride + 1;
+}
+
+void RawTraceReader::validate_index(const char *filename) {
+    string error = string("Index does not match the trace in file: ") + filename;
+
+    if (m_index.get_proc_count() != get_proc_count() || m_index.get_state_words() != 0) {
+        throw runtime_error(error);
+    }
+
+    for (uint32_t pid = 0; pid < get_proc_count(); pid++) {
+        uint64_t entries = m_index.get_entry_count(pid);
+        if (entries == 0 || entries > stored_entries(pid)) {
+            throw runtime_error(error);
+        }
+
+        // The last entry is the end tag, or the trace data ends after it
+        if (read_entry(entry_offset(pid, entries - 1)).type() != TraceFile::ENTRY_TYPE_END &&
+            entries < stored_entries(pid)) {
+            throw runtime_error(error);
+        }
+
+        for (uint64_t k = 0; k < m_index.get_barrier_count(pid); k++) {
+            uint64_t entry = m_index.get_barrier(pid, k);
+            if (read_entry(entry_offset(pid, entry)).type() != TraceFile::ENTRY_TYPE_BARRIER) {
+                throw runtime_error(error);
+            }
+        }
+    }
+}
+
+TraceFile::PackedEntry RawTraceReader::read_entry(uint64_t pos) {
+    TraceFile::PackedEntry pe;
+    read_bytes(pos, (unsigned char *)&pe.word, entry_size);
+    ntohll_block(&pe.word, 1);
+    return pe;
+}
+
+RawTraceReader::~RawTraceReader() {}
+
+bool RawTraceReader::is_mapped() const {
+    return m_map != NULL;
+}
+
+uint32_t RawTraceReader::get_proc_count() const {
+    return m_positions.size();
+}
+
+bool RawTraceReader::is_transposed() const {
+    return m_transposed;
+}
+
+const TraceIndex *RawTraceReader::get_index() const {
+    return m_has_index ? &m_index : NULL;
+}
+
+const TraceHeader *RawTraceReader::get_header() const {
+    return m_has_header ? &m_header : NULL;
+}
+
+void RawTraceReader::seek(const vector<uint64_t> &entries) {
+    // Entries are at fixed positions, so no checkpoints are needed
+    for (uint32_t pid = 0; pid < get_proc_count(); pid++) {
+        uint64_t n = entries.at(pid);
+        if ((m_has_index && n >= m_index.get_entry_count(pid)) || n > stored_entries(pid)) {
+            m_positions[pid] = 0;
+        } else {
+            m_positions[pid] = entry_offset(pid, n);
+        }
+    }
+}
+
+void RawTraceReader::checkpoint(uint32_t pid, TraceCheckpoint &cp) const {
+    cp.offset = m_positions.at(pid);
+    cp.state.clear();
+}
+
+size_t RawTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    static_assert(sizeof(TraceFile::PackedEntry) == sizeof(uint64_t),
+                  "PackedEntry must match the 8 byte trace encoding");
+
+    uint64_t pos = m_positions[pid];
+
+    // Stop once the end tag was read or no complete entry is left
+    uint64_t end = m_ends[pid];
+    if (pos == 0 || pos + entry_size > end || n == 0) {
+        return 0;
+    }
+
+    uint64_t stride = m_stride;
+
+    // Never read beyond the last complete entry of this processor
+    uint64_t left = (end - entry_size - pos) / stride + 1;
+    if (n > left) {
+        n = left;
+    }
+
+    uint64_t *words = &out[0].word;
+    if (m_map != NULL) {
+        if (stride == entry_size) {
+            memcpy(words, m_map + pos, n * entry_size);
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                memcpy(&words[i], m_map + pos + i * stride, entry_size);
+            }
+        }
+    } else {
+        // Read the whole span in one go and pick out this processor's
+        // entries, instead of seeking to every single one of them.
+        size_t span = (n - 1) * stride + entry_size;
+        m_scratch.resize(span);
+        m_input.seekg(pos);
+        m_input.read(m_scratch.data(), span);
+        if (m_input.fail() || (size_t)m_input.gcount() != span) {
+            throw runtime_error("Unexpected end of tracefile");
+        }
+        for (size_t i = 0; i < n; i++) {
+            memcpy(&words[i], m_scratch.data() + i * stride, entry_size);
+        }
+    }
+
+    // Transform data into host byte order.
+    ntohll_block(words, n);
+    if (!m_has_header) {
+        TraceFile::PackedEntry::check_legacy(out, n);
+    }
+
+    // Nothing is read beyond an end tag
+    for (size_t i = 0; i < n; i++) {
+        if (out[i].type() == TraceFile::ENTRY_TYPE_END) {
+            m_positions[pid] = 0;
+            return i + 1;
+        }
+    }
+
+    // Seek to the next value.
+    m_positions[pid] = pos + n * stride;
+    return n;
+}
+
+void TraceReader::seek(const vector<uint64_t> &entries) {
+    (void)entries;
+    throw runtime_error("Seeking is not supported for this tracefile");
+}
+
+void TraceReader::checkpoint(uint32_t pid, TraceCheckpoint &cp) const {
+    (void)pid;
+    (void)cp;
+    throw runtime_error("Checkpoints are not supported for this tracefile");
+}
+
+StreamTraceReader::StreamTraceReader(int fd, uint32_t procs_count, const TraceHeader *header)
+: m_fd(fd), m_eof(false), m_has_header(header != NULL), m_buffers(procs_count),
+  m_next_pid(0), m_data(read_size), m_data_len(0) {
+    for (size_t i = 0; i < m_buffers.size(); i++) {
+        m_buffers[i].head = 0;
+        m_buffers[i].spill = NULL;
+        m_buffers[i].spill_out = 0;
+        m_buffers[i].spill_in = 0;
+        m_buffers[i].end_read = false;
+        m_buffers[i].ended = false;
+    }
+    if (header != NULL) {
+        m_header = *header;
+    }
+}
+
+const TraceHeader *StreamTraceReader::get_header() const {
+    return m_has_header ? &m_header : NULL;
+}
+
+StreamTraceReader::~StreamTraceReader() {
+    ::close(m_fd);
+    for (size_t i = 0; i < m_buffers.size(); i++) {
+        if (m_buffers[i].spill != NULL) {
+            fclose(m_buffers[i].spill);
+        }
+    }
+}
+
+bool StreamTraceReader::read_more() {
+    if (m_eof) {
+        return false;
+    }
+
+    ssize_t got = read_fully(m_fd, m_data.data() + m_data_len, m_data.size() - m_data_len);
+    if (got < 0) {
+        throw runtime_error("Unable to read tracefile");
+    }
+    if (got == 0) {
+        // A partial entry at the end of the stream is ignored
+        m_eof = true;
+        return false;
+    }
+    m_data_len += got;
+
+    // Sort the complete entries into the buffers of their processors
+    size_t words = m_data_len / entry_size;
+    const unsigned char *p = m_data.data();
+    for (size_t i = 0; i < words; i++, p += entry_size) {
+        Buffer &b = m_buffers[m_next_pid];
+        if (++m_next_pid == m_buffers.size()) {
+            m_next_pid = 0;
+        }
+        // Nothing is read beyond an end tag
+        if (b.end_read) {
+            continue;
+        }
+
+        // The type is in the top bits of the first (most significant) byte
+        uint64_t word;
+        memcpy(&word, p, entry_size);
+        push(b, word);
+        b.end_read = (p[0] >> 5) == TraceFile::ENTRY_TYPE_END;
+    }
+
+    // Keep the bytes of a partial entry for the next read
+    size_t used = words * entry_size;
+    memmove(m_data.data(), m_data.data() + used, m_data_len - used);
+    m_data_len -= used;
+    return true;
+}
+
+uint64_t StreamTraceReader::available(const Buffer &b) {
+    return b.words.size() - b.head + (b.spill_in - b.spill_out) + b.staged.size();
+}
+
+void StreamTraceReader::push(Buffer &b, uint64_t word) {
+    // Once entries are spilled the later ones go after them, to keep the order
+    if (b.spill_in == b.spill_out && b.staged.empty() && b.words.size() - b.head < buffer_limit) {
+        b.words.push_back(word);
+        return;
+    }
+    b.staged.push_back(word);
+    if (b.staged.size() == spill_chunk) {
+        flush_spill(b);
+    }
+}
+
+void StreamTraceReader::flush_spill(Buffer &b) {
+    if (b.spill == NULL) {
+        b.spill = tmpfile();
+        if (b.spill == NULL) {
+            throw runtime_error(string("Trace stream: unable to create a temporary file: ") + strerror(errno));
+        }
+    }
+    const char *data = (const char *)b.staged.data();
+    size_t len = b.staged.size() * entry_size;
+    uint64_t pos = b.spill_in * entry_size;
+    while (len > 0) {
+        ssize_t put = pwrite(fileno(b.spill), data, len, pos);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            throw runtime_error(string("Trace stream: unable to write a temporary file: ") + strerror(errno));
+        }
+        data += put;
+        len -= put;
+        pos += put;
+    }
+    b.spill_in += b.staged.size();
+    b.staged.clear();
+}
+
+void StreamTraceReader::unspill(Buffer &b) {
+    if (b.spill_in == b.spill_out && b.staged.empty()) {
+        return;
+    }
+    b.words.erase(b.words.begin(), b.words.begin() + b.head);
+    b.head = 0;
+    size_t room = b.words.size() < buffer_limit ? buffer_limit - b.words.size() : 0;
+
+    if (b.spill_in > b.spill_out && room > 0) {
+        size_t k = b.spill_in - b.spill_out < room ? b.spill_in - b.spill_out : room;
+        size_t old = b.words.size();
+        b.words.resize(old + k);
+        char *data = (char *)&b.words[old];
+        size_t len = k * entry_size;
+        uint64_t pos = b.spill_out * entry_size;
+        while (len > 0) {
+            ssize_t got = pread(fileno(b.spill), data, len, pos);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                throw runtime_error("Trace stream: unable to read a temporary file");
+            }
+            data += got;
+            len -= got;
+            pos += got;
+        }
+        b.spill_out += k;
+        room -= k;
+        // The file is reused from its start once it is read back
+        if (b.spill_out == b.spill_in) {
+            b.spill_out = 0;
+            b.spill_in = 0;
+        }
+    }
+    if (b.spill_in == b.spill_out && room > 0) {
+        b.words.insert(b.words.end(), b.staged.begin(), b.staged.end());
+        b.staged.clear();
+    }
+}
+
+size_t StreamTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    Buffer &b = m_buffers[pid];
+    if (b.ended) {
+        return 0;
+    }
+
+    // Only read on as far as this processor needs, the other processors'
+    // entries beyond buffer_limit are spilled on the way
+    while (available(b) < n && !b.end_read) {
+        if (!read_more()) {
+            break;
+        }
+    }
+    if (b.words.size() - b.head < n) {
+        unspill(b);
+    }
+
+    size_t k = b.words.size() - b.head < n ? b.words.size() - b.head : n;
+    memcpy(&out[0].word, &b.words[b.head], k * entry_size);
+    b.head += k;
+
+    // Drop the fetched entries once they make up half of the buffer
+    if (b.head > b.words.size() / 2) {
+        b.words.erase(b.words.begin(), b.words.begin() + b.head);
+        b.head = 0;
+    }
+
+    ntohll_block(&out[0].word, k);
+    if (!m_has_header) {
+        TraceFile::PackedEntry::check_legacy(out, k);
+    }
+    b.ended = b.end_read && available(b) == 0;
+    return k;
+}
+
+// Decodes the blocks of a transposed 5TRF trace held in image, whose block
+// table starts at start
+static TraceReader *read_transposed(const FileImage &image, const char *filename,
+                                    uint32_t procs, uint64_t start,
+                                    const TraceHeader *header, uint32_t &procs_count) {
+    const unsigned char *data = image.data();
+    uint64_t table_end = start + (uint64_t)procs * 16;
+    if (procs == 0 || table_end > image.size()) {
+        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+    }
+
+    vector<vector<TraceFile::PackedEntry> > traces(procs);
+    for (uint32_t pid = 0; pid < procs; pid++) {
+        uint64_t words[2];
+        memcpy(words, data + start + pid * 16, sizeof(words));
+        ntohll_block(words, 2);
+        if (words[0] < table_end || words[0] > image.size() ||
+            words[1] > (image.size() - words[0]) / 8) {
+            throw runtime_error(string("Damaged block table in tracefile: ") + filename);
+        }
+        if (words[1] > 0) {
+            traces[pid].resize(words[1]);
+            memcpy(traces[pid].data(), data + words[0], words[1] * 8);
+            ntohll_block(&traces[pid][0].word, words[1]);
+            if (header == NULL) {
+                TraceFile::PackedEntry::check_legacy(traces[pid].data(), words[1]);
+            }
+        }
+    }
+
+    procs_count = procs;
+    MemoryTraceReader *rdr = new MemoryTraceReader(traces);
+    if (header != NULL) {
+        rdr->set_header(*header);
+    }
+    return rdr;
+}
+
+// Opens a trace that can only be read front to back
+static TraceReader *open_trace_stream(int fd, TraceFile::ReadMode mode,
+                                      const char *filename, uint32_t &procs_count) {
+    if (mode == TraceFile::READ_MMAP) {
+        ::close(fd);
+        throw runtime_error(string("Unable to map file: ") + filename);
+    }
+
+    char header[8];
+    if (read_fully(fd, header, sizeof(header)) != sizeof(header)) {
+        ::close(fd);
+        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+    }
+
+    if (!strncmp(header, "5TRZ", 4)) {
+        TrzTraceReader *rdr;
+        try {
+            rdr = new TrzTraceReader(fd, header);
+        } catch (exception &e) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        procs_count = rdr->get_proc_count();
+        return rdr;
+    }
+
+    uint32_t flags;
+    memcpy(&flags, header + 4, sizeof(flags));
+    flags = ntohl(flags);
+    uint32_t procs = flags & ~(RawTraceReader::transposed_flag | TraceHeader::header_flag);
+    if (strncmp(header, "5TRF", 4) || procs == 0) {
+        ::close(fd);
+        throw runtime_error(string("Invalid file signature in file: ") + filename);
+    }
+
+    // The version 2 header is read right away, its size comes first
+    vector<char> prefix(header, header + sizeof(header));
+    TraceHeader trace_header;
+    bool has_header = (flags & TraceHeader::header_flag) != 0;
+    if (has_header) {
+        try {
+            prefix.resize(prefix.size() + 4);
+            if (read_fully(fd, &prefix[8], 4) != 4) {
+                throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+            }
+            uint32_t size = TraceHeader::peek_size((const unsigned char *)&prefix[8]);
+            prefix.resize(8 + (uint64_t)size);
+            if (size < 4 || read_fully(fd, &prefix[12], size - 4) != (ssize_t)size - 4) {
+                throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+            }
+            trace_header.parse(procs, (const unsigned char *)&prefix[8], size);
+        } catch (exception &e) {
+            ::close(fd);
+            throw;
+        }
+    }
+
+    // The blocks of a transposed trace follow each other, so all of them
+    // have to be read before the last processor can start
+    if (flags & RawTraceReader::transposed_flag) {
+        FileImage image;
+        try {
+            image.read(fd, prefix.data(), prefix.size());
+        } catch (exception &e) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        return read_transposed(image, filename, procs, prefix.size(),
+                               has_header ? &trace_header : NULL, procs_count);
+    }
+
+    procs_count = procs;
+    return new StreamTraceReader(fd, procs, has_header ? &trace_header : NULL);
+}
+
+MemoryTraceReader::MemoryTraceReader(vector<vector<TraceFile::PackedEntry> > &traces)
+: m_positions(traces.size(), 0), m_has_header(false) {
+    m_traces.swap(traces);
+    for (size_t pid = 0; pid < m_traces.size(); pid++) {
+        vector<TraceFile::PackedEntry> &t = m_traces[pid];
+        for (size_t i = 0; i < t.size(); i++) {
+            if (t[i].type() == TraceFile::ENTRY_TYPE_END) {
+                t.resize(i + 1);
+                break;
+            }
+        }
+    }
+}
+
+MemoryTraceReader::~MemoryTraceReader() {}
+
+MemoryTraceReader *MemoryTraceReader::load(TraceReader *reader, uint32_t procs_count) {
+    vector<vector<TraceFile::PackedEntry> > traces(procs_count);
+
+    // Pipes only buffer a limited part of each processor's trace, so all
+    // processors are decoded side by side
+    const size_t batch_size = 1 << 16;
+    bool more = true;
+    while (more) {
+        more = false;
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            vector<TraceFile::PackedEntry> &t = traces[pid];
+            size_t size = t.size();
+            t.resize(size + batch_size);
+            size_t n = reader->fetch(pid, t.data() + size, batch_size);
+            t.resize(size + n);
+            more |= n > 0;
+        }
+    }
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        traces[pid].shrink_to_fit();
+    }
+    MemoryTraceReader *rdr = new MemoryTraceReader(traces);
+    if (reader->get_header() != NULL) {
+        rdr->set_header(*reader->get_header());
+    }
+    return rdr;
+}
+
+size_t MemoryTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    const vector<TraceFile::PackedEntry> &t = m_traces[pid];
+    size_t pos = m_positions[pid];
+    if (n > t.size() - pos) {
+        n = t.size() - pos;
+    }
+    memcpy(out, t.data() + pos, n * sizeof(TraceFile::PackedEntry));
+    m_positions[pid] = pos + n;
+    return n;
+}
+
+void MemoryTraceReader::seek(const vector<uint64_t> &entries) {
+    for (uint32_t pid = 0; pid < get_proc_count(); pid++) {
+        m_positions[pid] = min<uint64_t>(entries.at(pid), m_traces[pid].size());
+    }
+}
+
+void MemoryTraceReader::checkpoint(uint32_t pid, TraceCheckpoint &cp) const {
+    cp.offset = m_positions.at(pid);
+    cp.state.clear();
+}
+
+uint32_t MemoryTraceReader::get_proc_count() const {
+    return m_traces.size();
+}
+
+const vector<TraceFile::PackedEntry> &MemoryTraceReader::get_entries(uint32_t pid) const {
+    return m_traces.at(pid);
+}
+
+const TraceHeader *MemoryTraceReader::get_header() const {
+    return m_has_header ? &m_header : NULL;
+}
+
+void MemoryTraceReader::set_header(const TraceHeader &header) {
+    m_header = header;
+    m_has_header = true;
+}
+
+static TraceReader *open_memory_source(const char *spec, TraceFile::ReadMode mode,
+                                       uint32_t &procs_count) {
+    TraceReader *reader = open_trace_reader(spec, mode, procs_count);
+    try {
+        MemoryTraceReader *rdr = MemoryTraceReader::load(reader, procs_count);
+        delete reader;
+        return rdr;
+    } catch (exception &e) {
+        delete reader;
+        throw;
+    }
+}
+
+static TraceReader *open_generator_source(const char *spec, TraceFile::ReadMode mode,
+                                          uint32_t &procs_count) {
+    (void)mode;
+    GeneratorTraceReader *rdr = new GeneratorTraceReader(spec);
+    procs_count = rdr->get_proc_count();
+    return rdr;
+}
+
+static TraceReader *open_mix_source(const char *spec, TraceFile::ReadMode mode,
+                                    uint32_t &procs_count) {
+    MixTraceReader *rdr = new MixTraceReader(spec, mode);
+    procs_count = rdr->get_proc_count();
+    return rdr;
+}
+
+static TraceReader *open_shared_source(const char *spec, TraceFile::ReadMode mode,
+                                       uint32_t &procs_count) {
+    (void)mode;
+    SharedTraceReader *rdr = new SharedTraceReader(spec);
+    procs_count = rdr->get_proc_count();
+    return rdr;
+}
+
+// Registered trace sources by scheme, with the built in ones
+static map<string, TraceSourceFactory> &trace_sources() {
+    static map<string, TraceSourceFactory> sources = {
+        { "mem", open_memory_source },
+        { "gen", open_generator_source },
+        { "mix", open_mix_source },
+        { "shm", open_shared_source }
+    };
+    return sources;
+}
+
+void register_trace_source(const char *scheme, TraceSourceFactory factory) {
+    trace_sources()[scheme] = factory;
+}
+
+TraceReader *open_trace_reader(const char *filename, TraceFile::ReadMode mode,
+                               uint32_t &procs_count) {
+    // Trace sources other than files
+    const char *colon = strchr(filename, ':');
+    if (colon != NULL) {
+        map<string, TraceSourceFactory> &sources = trace_sources();
+        map<string, TraceSourceFactory>::iterator it =
+            sources.find(string(filename, colon - filename));
+        if (it != sources.end()) {
+            return it->second(colon + 1, mode, procs_count);
+        }
+    }
+
+    // Pipes and stdin are read front to back
+    bool is_stdin = !strcmp(filename, "-");
+    int fd = is_stdin ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+    struct stat st;
+    if (is_stdin || (fstat(fd, &st) == 0 && !S_ISREG(st.st_mode))) {
+        return open_trace_stream(fd, mode, filename, procs_count);
+    }
+    ::close(fd);
+
+    ifstream input(filename, ios::in | ios::binary);
+    if (!input.is_open() || !input.good()) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+
+    char signature[4];
+    input.read((char *)&signature, 4);
+    if (input.fail()) {
+        throw runtime_error(string("Invalid file signature in file: ") + filename);
+    }
+    input.close();
+
+    if (!strncmp(signature, "5TRZ", 4)) {
+        TrzTraceReader *rdr = new TrzTraceReader(filename, mode);
+        procs_count = rdr->get_proc_count();
+        return rdr;
+    }
+
+    // Anything else is left to the 5TRF reader, which reports bad signatures
+    RawTraceReader *rdr = new RawTraceReader(filename, mode);
+    procs_count = rdr->get_proc_count();
+    return rdr;
+}
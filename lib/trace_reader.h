@@ -0,0 +1,331 @@
+/*
+// Header file for the trace readers used by the TraceFile class.
+// A reader decodes the entries of each processor of one trace file format
+// in program order. The barrier and end bookkeeping is left to TraceFile,
+// so readers only have to deal with the layout of the data.
+//
+// A reader is the source of a trace: besides the file formats it can hold a
+// trace in memory or generate one. Entries are handed over in batches, so
+// the simulation does not make a virtual call per entry.
+*/
+
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include "psa.h"
+#include "trace_header.h"
+#include "trace_index.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <vector>
+
+class TraceReader {
+    public:
+    virtual ~TraceReader() {}
+
+    /*
+     * Decodes up to n entries of processor pid into out, in host byte order,
+     * and returns the number of entries decoded, 0 if none are left.
+     * Decoding stops after an end tag.
+     */
+    virtual size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) = 0;
+
+    /*
+     * Hands out up to n of the next entries of processor pid in place, in
+     * host byte order, and sets n to their number. The entries stay valid
+     * as long as the reader. Returns NULL if the reader cannot do this
+     * without copying, fetch() has to be used then.
+     */
+    virtual const TraceFile::PackedEntry *view(uint32_t pid, size_t &n) {
+        (void)pid;
+        (void)n;
+        return NULL;
+    }
+
+    // Returns true if the trace is read from a memory mapping of the file
+    virtual bool is_mapped() const { return false; }
+
+    // Returns the index of the trace, NULL if the file has none
+    virtual const TraceIndex *get_index() const { return NULL; }
+
+    // Returns the version 2 header of the trace, NULL if it has none
+    virtual const TraceHeader *get_header() const { return NULL; }
+
+    /*
+     * Continues the trace of every processor p at its entry entries[p].
+     * Throws a runtime_error if the reader cannot seek to these entries.
+     */
+    virtual void seek(const std::vector<uint64_t> &entries);
+
+    // Number of decoder state words in a checkpoint of this reader
+    virtual uint32_t get_state_words() const { return 0; }
+
+    // Stores where the next entry of processor pid is read from in cp, all
+    // but cp.entry. Throws a runtime_error if the reader does not support it.
+    virtual void checkpoint(uint32_t pid, TraceCheckpoint &cp) const;
+};
+
+// Read-only view of a whole file, memory mapped when possible and read into
+// memory otherwise.
+class FileImage {
+    public:
+    FileImage();
+    ~FileImage();
+
+    // Maps filename into memory, returns false if this is not possible
+    bool map(const char *filename);
+
+    // Maps or reads filename into memory as allowed by mode, throws a
+    // runtime_error if it cannot be read at all
+    void load(const char *filename, TraceFile::ReadMode mode);
+
+    // Reads everything left in descriptor fd into memory, after the len
+    // bytes in prefix which were already read from it
+    void read(int fd, const char *prefix, size_t len);
+
+    const unsigned char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool is_mapped() const { return m_mapped; }
+
+    private:
+    const unsigned char *m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<unsigned char> m_copy;
+
+    // No copies are allowed.
+    FileImage(const FileImage &img);
+};
+
+/*
+ * Reader for the 5TRF format. The usual layout interleaves the processor
+ * traces entry by entry as 8 byte big endian words after the header:
+ *   "5TRF" | procs_count (32 bit)
+ * The transposed layout stores the trace of every processor in one block,
+ * so a processor's entries are contiguous. It sets transposed_flag in the
+ * processor count and lists the blocks after the header:
+ *   "5TRF" | procs_count | transposed_flag (32 bit)
+ *   per processor: block offset in the file, number of entries (64 bit)
+ * followed by the blocks, each ending with the end tag of its processor.
+ * Readers that do not know the flag reject the file as too short.
+ * Both layouts may start with a version 2 header (see trace_header.h),
+ * which comes before the block table. Its entry counts tell where every
+ * processor's trace ends without looking at the trace data.
+ */
+class RawTraceReader : public TraceReader {
+    public:
+    RawTraceReader(const char *filename, TraceFile::ReadMode mode);
+    ~RawTraceReader();
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+    bool is_mapped() const;
+
+    const TraceIndex *get_index() const;
+    const TraceHeader *get_header() const;
+    void seek(const std::vector<uint64_t> &entries);
+    void checkpoint(uint32_t pid, TraceCheckpoint &cp) const;
+
+    uint32_t get_proc_count() const;
+
+    // Returns true for the transposed layout
+    bool is_transposed() const;
+
+    static const uint32_t transposed_flag = 0x80000000;
+
+    private:
+    const uint32_t entry_size = 8; // Trace element is 8 bytes.
+
+    std::ifstream m_input;
+    std::vector<uint64_t> m_positions; // Byte offset of the next entry, 0 once ended
+    std::vector<uint64_t> m_first;     // Byte offset of the first entry
+    std::vector<uint64_t> m_ends;      // End of the entries of each processor
+    uint64_t m_stride;    // Bytes from one entry of a processor to its next
+    bool m_transposed;
+    uint64_t m_endstream; // End of the trace data, where an index starts
+
+    TraceHeader m_header;
+    bool m_has_header;
+
+    // Reads the version 2 header, returns its size
+    uint64_t read_header(const char *filename);
+
+    // Reads the block table of a transposed trace, which starts at start
+    void read_blocks(const char *filename, uint64_t start);
+
+    // Reads size bytes at byte offset pos of the file into out
+    void read_bytes(uint64_t pos, unsigned char *out, size_t size);
+
+    // Returns the byte offset of entry n of processor pid
+    uint64_t entry_offset(uint32_t pid, uint64_t n) const {
+        return m_first[pid] + n * m_stride;
+    }
+
+    // Returns the number of complete entries stored for processor pid
+    uint64_t stored_entries(uint32_t pid) const;
+
+    TraceIndex m_index;
+    bool m_has_index;
+
+    // Checks that the index matches the trace data
+    void validate_index(const char *filename);
+
+    // Reads the entry at byte offset pos
+    TraceFile::PackedEntry read_entry(uint64_t pos);
+
+    // Mapping of the whole file, only used if the file could be mapped
+    FileImage m_image;
+    const unsigned char *m_map;
+
+    // Staging area for batched reads through the stream reader
+    std::vector<char> m_scratch;
+
+    // No copies are allowed.
+    RawTraceReader(const RawTraceReader &rdr);
+};
+
+/*
+ * Reader for 5TRF traces that can only be read front to back, like pipes and
+ * stdin. The interleaved entries are read on demand and sorted into a buffer
+ * per processor, so the pipe is only read as far as the processor that is
+ * furthest ahead needs it, and a generator writing into the pipe is held up
+ * until then. A processor keeps at most buffer_limit entries in memory, the
+ * entries after them are spilled to an anonymous temporary file and read
+ * back in order once the processor gets to them. So one processor may be
+ * read any distance ahead of another, e.g. all of processor 0 before
+ * processor 1. fetch() throws a runtime_error if the temporary file cannot
+ * be created, written or read.
+ */
+class StreamTraceReader : public TraceReader {
+    public:
+    // Reads the trace from descriptor fd, after the 8 byte header and the
+    // version 2 header (if any) that were already read from it. Takes
+    // ownership of fd.
+    StreamTraceReader(int fd, uint32_t procs_count, const TraceHeader *header = NULL);
+    ~StreamTraceReader();
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+    const TraceHeader *get_header() const;
+
+    private:
+    static const size_t entry_size = 8;
+    static const size_t buffer_limit = 1 << 22; // Entries per processor in memory
+    static const size_t spill_chunk = 1 << 16;  // Entries per write to a spill file
+    static const size_t read_size = 1 << 16;    // Bytes per read
+
+    // Entries of a single processor that were read but not fetched yet, in
+    // order: words from head on, the spill file from spill_out to spill_in,
+    // then staged
+    struct Buffer {
+        std::vector<uint64_t> words;
+        size_t head;
+        FILE *spill;        // Temporary file, NULL until the buffer overflows
+        uint64_t spill_out; // Entries of the spill file read back
+        uint64_t spill_in;  // Entries written to the spill file
+        std::vector<uint64_t> staged; // Entries to be written to the spill file
+        bool end_read;  // The end tag was read, later entries are padding
+        bool ended;     // The end tag was fetched
+    };
+
+    int m_fd;
+    bool m_eof;
+    TraceHeader m_header;
+    bool m_has_header;
+    std::vector<Buffer> m_buffers;
+    uint32_t m_next_pid; // Processor of the next entry in the stream
+    std::vector<unsigned char> m_data; // Bytes read but not sorted yet
+    size_t m_data_len;
+
+    // Reads the next part of the stream and sorts it into the buffers.
+    // Returns false at the end of the stream.
+    bool read_more();
+
+    // Appends word to b, spilling it if b is full or has spilled entries
+    void push(Buffer &b, uint64_t word);
+
+    // Writes the staged entries of b to its spill file
+    void flush_spill(Buffer &b);
+
+    // Moves spilled entries of b back into memory, as many as fit
+    void unspill(Buffer &b);
+
+    // Returns the number of entries b holds, in memory or spilled
+    static uint64_t available(const Buffer &b);
+
+    // No copies are allowed.
+    StreamTraceReader(const StreamTraceReader &rdr);
+};
+
+/*
+ * Holds the whole trace in memory, one vector of entries per processor, so
+ * models can be driven without file I/O, e.g. in benchmarks. Entries after
+ * an end tag are dropped.
+ */
+class MemoryTraceReader : public TraceReader {
+    public:
+    // Takes over the entries in traces, which are left empty
+    MemoryTraceReader(std::vector<std::vector<TraceFile::PackedEntry> > &traces);
+    ~MemoryTraceReader();
+
+    // Decodes everything that is left in reader into memory, and keeps its
+    // header
+    static MemoryTraceReader *load(TraceReader *reader, uint32_t procs_count);
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+
+    const TraceHeader *get_header() const;
+    void set_header(const TraceHeader &header);
+
+    // Returns all entries of processor pid
+    const std::vector<TraceFile::PackedEntry> &get_entries(uint32_t pid) const;
+
+    void seek(const std::vector<uint64_t> &entries);
+    void checkpoint(uint32_t pid, TraceCheckpoint &cp) const;
+
+    uint32_t get_proc_count() const;
+
+    private:
+    std::vector<std::vector<TraceFile::PackedEntry> > m_traces;
+    std::vector<size_t> m_positions; // Index of the next entry
+    TraceHeader m_header;
+    bool m_has_header;
+
+    // No copies are allowed.
+    MemoryTraceReader(const MemoryTraceReader &rdr);
+};
+
+/*
+ * Creates the reader for a trace named scheme:spec, see
+ * register_trace_source(). Stores the number of processors in procs_count
+ * and throws a runtime_error if spec is not valid.
+ */
+typedef TraceReader *(*TraceSourceFactory)(const char *spec, TraceFile::ReadMode mode,
+                                           uint32_t &procs_count);
+
+/*
+ * Makes open_trace_reader() open traces named scheme:spec with factory, so
+ * a program can select any trace source from the command line. The schemes
+ * mem, gen, mix and shm are built in: mem:file decodes file into a
+ * MemoryTraceReader before the simulation starts, gen:spec generates a
+ * synthetic trace (see trace_gen.h), mix:spec runs single processor jobs
+ * side by side (see trace_mix.h) and shm:file shares the decoded trace
+ * with other processes (see trace_shm.h).
+ */
+void register_trace_source(const char *scheme, TraceSourceFactory factory);
+
+/*
+ * Opens a trace and stores the number of processors in procs_count. Names
+ * of the form scheme:spec with a registered scheme are opened by its
+ * factory, anything else is a file opened with the reader matching its file
+ * signature. Throws a runtime_error if the file cannot be read or has an
+ * unknown signature. The name "-" stands for stdin.
+ * Pipes and other files that cannot be seeked are read with the
+ * StreamTraceReader, or read into memory completely for the 5TRZ format.
+ */
+TraceReader *open_trace_reader(const char *filename, TraceFile::ReadMode mode,
+                               uint32_t &procs_count);
+
+// Transforms n consecutive big endian trace words into host byte order
+void ntohll_block(uint64_t *words, size_t n);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+// Source file for the SharedTraceReader class, see trace_shm.h for the
+// layout of a segment.
+*/
+
+#include "trace_shm.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const uint32_t shm_version = 1;
+static const uint64_t byte_order_mark = 0x0102030405060708ULL;
+
+struct SegmentHead {
+    char signature[4];
+    uint32_t version;
+    uint64_t byte_order;
+    uint64_t hash;
+    uint64_t file_size;
+    uint32_t procs_count;
+    uint32_t header_size;
+};
+
+struct SegmentTrace {
+    uint64_t offset;
+    uint64_t entries;
+};
+
+// Directory of the segments
+static string segment_dir() {
+    const char *dir = getenv("PSA_TRACE_SHM_DIR");
+    return dir != NULL && *dir ? dir : "/dev/shm";
+}
+
+// Writes all size bytes of data to fd, returns false on errors
+static bool write_fully(int fd, const void *data, size_t size) {
+    const char *pos = (const char *)data;
+    while (size > 0) {
+        ssize_t n = ::write(fd, pos, size);
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+uint64_t SharedTraceReader::content_hash(const unsigned char *data, size_t size) {
+    // Four independent multiply-xor lanes over 8 byte words, fast enough to
+    // hash the file on every open
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    uint64_t lanes[4] = { size, prime, ~size, ~prime };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t w;
+            memcpy(&w, data + i + k * 8, 8);
+            lanes[k] = (lanes[k] ^ w) * prime;
+            lanes[k] ^= lanes[k] >> 29;
+        }
+    }
+    uint64_t h = 0;
+    for (int k = 0; k < 4; k++) {
+        h = (h ^ lanes[k]) * prime;
+        h ^= h >> 32;
+    }
+    for (; i < size; i++) {
+        h = (h ^ data[i]) * 0x100000001B3ULL;
+    }
+    h ^= h >> 31;
+    h *= prime;
+    h ^= h >> 29;
+    return h;
+}
+
+SharedTraceReader::SharedTraceReader(const char *filename)
+: m_built(false), m_map(NULL), m_map_size(0), m_has_header(false) {
+    uint64_t hash;
+    uint64_t file_size;
+    {
+        FileImage image;
+        image.load(filename, TraceFile::READ_AUTO);
+        hash = content_hash(image.data(), image.size());
+        file_size = image.size();
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/psa-trace-%016llx.shm", (unsigned long long)hash);
+    m_segment = segment_dir() + name;
+
+    if (!attach(hash, file_size)) {
+        build(filename, hash, file_size);
+        m_built = true;
+        if (!attach(hash, file_size)) {
+            throw runtime_error("Unable to map the shared trace segment: " + m_segment);
+        }
+    }
+}
+
+SharedTraceReader::~SharedTraceReader() {
+    if (m_map != NULL) {
+        munmap((void *)m_map, m_map_size);
+    }
+}
+
+bool SharedTraceReader::attach(uint64_t hash, uint64_t file_size) {
+    int fd = open(m_segment.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SegmentHead)) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const unsigned char *data = (const unsigned char *)map;
+    size_t size = st.st_size;
+
+    // Anything unexpected is rebuilt, e.g. a segment of another byte order
+    SegmentHead head;
+    memcpy(&head, data, sizeof(head));
+    uint64_t table_end = sizeof(head) + (uint64_t)head.procs_count * sizeof(SegmentTrace);
+    bool valid = !memcmp(head.signature, "5SHM", 4) && head.version == shm_version &&
+                 head.byte_order == byte_order_mark && head.hash == hash &&
+                 head.file_size == file_size && head.procs_count > 0 &&
+                 table_end + head.header_size <= size;
+    const SegmentTrace *table = (const SegmentTrace *)(data + sizeof(head));
+    for (uint32_t pid = 0; valid && pid < head.procs_count; pid++) {
+        valid = table[pid].offset % 8 == 0 && table[pid].offset <= size &&
+                table[pid].entries <= (size - table[pid].offset) / 8;
+    }
+    if (valid && head.header_size > 0) {
+        try {
+            m_header.parse(head.procs_count, data + table_end, head.header_size);
+            m_has_header = true;
+        } catch (exception &e) {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        munmap(map, size);
+        return false;
+    }
+
+    m_map = data;
+    m_map_size = size;
+    m_traces.resize(head.procs_count);
+    m_counts.resize(head.procs_count);
+    m_positions.assign(head.procs_count, 0);
+    for (uint32_t pid = 0; pid < head.procs_count; pid++) {
+        m_traces[pid] = (const TraceFile::PackedEntry *)(data + table[pid].offset);
+        m_counts[pid] = table[pid].entries;
+    }
+    return true;
+}
+
+void SharedTraceReader::build(const char *filename, uint64_t hash, uint64_t file_size) {
+    uint32_t procs_count;
+    TraceReader *reader = open_trace_reader(filename, TraceFile::READ_AUTO, procs_count);
+    MemoryTraceReader *decoded;
+    try {
+        decoded = MemoryTraceReader::load(reader, procs_count);
+    } catch (exception &e) {
+        delete reader;
+        throw;
+    }
+    delete reader;
+
+    vector<unsigned char> header;
+    if (decoded->get_header() != NULL) {
+        decoded->get_header()->encode(header);
+    }
+
+    SegmentHead head;
+    memcpy(head.signature, "5SHM", 4);
+    head.version = shm_version;
+    head.byte_order = byte_order_mark;
+    head.hash = hash;
+    head.file_size = file_size;
+    head.procs_count = procs_count;
+    head.header_size = header.size();
+    header.resize((header.size() + 7) / 8 * 8, 0);
+
+    vector<SegmentTrace> table(procs_count);
+    uint64_t offset = sizeof(head) + table.size() * sizeof(SegmentTrace) + header.size();
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        table[pid].offset = offset;
+        table[pid].entries = decoded->get_entries(pid).size();
+        offset += table[pid].entries * sizeof(TraceFile::PackedEntry);
+    }
+
+    // Written under a name of its own and renamed once complete
+    string tmp = m_segment + ".tmp." + to_string(getpid());
+    int fd = open(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        delete decoded;
+        throw runtime_error("Unable to create the shared trace segment: " + tmp);
+    }
+    bool ok = write_fully(fd, &head, sizeof(head)) &&
+              write_fully(fd, table.data(), table.size() * sizeof(SegmentTrace)) &&
+              write_fully(fd, header.data(), header.size());
+    for (uint32_t pid = 0; ok && pid < procs_count; pid++) {
+        const vector<TraceFile::PackedEntry> &t = decoded->get_entries(pid);
+        ok = write_fully(fd, t.data(), t.size() * sizeof(TraceFile::PackedEntry));
+    }
+    delete decoded;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), m_segment.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw runtime_error("Unable to write the shared trace segment: " + m_segment);
+    }
+}
+
+size_t SharedTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    const TraceFile::PackedEntry *entries = view(pid, n);
+    memcpy(out, entries, n * sizeof(TraceFile::PackedEntry));
+    return n;
+}
+
+const TraceFile::PackedEntry *SharedTraceReader::view(uint32_t pid, size_t &n) {
+    uint64_t pos = m_positions.at(pid);
+    if (n > m_counts[pid] - pos) {
+        n = m_counts[pid] - pos;
+    }
+    m_positions[pid] = pos + n;
+    return m_traces[pid] + pos;
+}
+
+const TraceHeader *SharedTraceReader::get_header() const {
+    return m_has_header ? &m_header : NULL;
+}
+
+void SharedTraceReader::seek(const vector<uint64_t> &entries) {
+    for (uint32_t pid = 0; pid < get_proc_count(); pid++) {
+        m_positions[pid] = min<uint64_t>(entries.at(pid), m_counts[pid]);
+    }
+}
+
+void SharedTraceReader::checkpoint(uint32_t pid, TraceCheckpoint &cp) const {
+    cp.offset = m_positions.at(pid);
+    cp.state.clear();
+}
+
+uint32_t SharedTraceReader::get_proc_count() const {
+    return m_traces.size();
+}
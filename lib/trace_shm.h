@@ -0,0 +1,83 @@
+/*
+// Header file for the SharedTraceReader class, which shares a decoded trace
+// between simulator processes. The first process that opens a trace as
+// shm:file decodes it into a segment file in shared memory, later processes
+// map that segment read-only and hand its entries to the simulation without
+// decoding or copying them, so a sweep of many runs on one trace holds it in
+// memory once.
+//
+// Segments are named psa-trace-<hash>.shm after a 64 bit hash of the
+// contents of the tracefile, so a changed trace gets a new segment and a
+// stale one is never used. They live in /dev/shm, or the directory given by
+// the environment variable PSA_TRACE_SHM_DIR, until they are removed by hand
+// (rm /dev/shm/psa-trace-*). Layout, all fields in host byte order:
+//   "5SHM" | version (32 bit) | byte order mark 0x0102030405060708
+//   | content hash | size of the tracefile
+//   | procs_count (32 bit) | size of the version 2 header (32 bit)
+//   per processor: byte offset of its entries, number of entries
+//   the encoded version 2 header (see trace_header.h), if the trace has one,
+//   padded to 8 bytes
+//   the entries of every processor, contiguous and ending with its end tag
+// A segment is written to a temporary file and renamed when complete, so
+// processes that build it at the same time do not see each other's halves.
+*/
+
+#ifndef TRACE_SHM_H
+#define TRACE_SHM_H
+
+#include "trace_header.h"
+#include "trace_reader.h"
+
+#include <string>
+#include <vector>
+
+class SharedTraceReader : public TraceReader {
+    public:
+    /*
+     * Maps the segment of filename, and builds it first if there is none
+     * yet. Throws a runtime_error if the file cannot be read or the segment
+     * cannot be written.
+     */
+    SharedTraceReader(const char *filename);
+    ~SharedTraceReader();
+
+    // Returns the hash that names the segment of the size bytes at data
+    static uint64_t content_hash(const unsigned char *data, size_t size);
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+    const TraceFile::PackedEntry *view(uint32_t pid, size_t &n);
+    bool is_mapped() const { return true; }
+
+    const TraceHeader *get_header() const;
+    void seek(const std::vector<uint64_t> &entries);
+    void checkpoint(uint32_t pid, TraceCheckpoint &cp) const;
+
+    uint32_t get_proc_count() const;
+
+    // Returns the path of the segment, and whether this reader built it
+    const std::string &get_segment() const { return m_segment; }
+    bool built_segment() const { return m_built; }
+
+    private:
+    std::string m_segment;
+    bool m_built;
+    const unsigned char *m_map;
+    size_t m_map_size;
+    std::vector<const TraceFile::PackedEntry *> m_traces;
+    std::vector<uint64_t> m_counts;
+    std::vector<uint64_t> m_positions; // Index of the next entry
+    TraceHeader m_header;
+    bool m_has_header;
+
+    // Maps the segment if it exists and belongs to a file of file_size
+    // bytes with hash. Returns false otherwise.
+    bool attach(uint64_t hash, uint64_t file_size);
+
+    // Decodes filename into a new segment
+    void build(const char *filename, uint64_t hash, uint64_t file_size);
+
+    // No copies are allowed.
+    SharedTraceReader(const SharedTraceReader &rdr);
+};
+
+#endif
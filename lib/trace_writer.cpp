@@ -0,0 +1,236 @@
+/*
+// Source file for the TraceWriter class.
+*/
+
+#include "trace_writer.h"
+#include "trace_reader.h"
+
+#include <arpa/inet.h>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+static const size_t buffer_size = 1 << 20;
+
+TraceWriter::TraceWriter(const char *filename, uint32_t procs_count, bool transposed)
+: m_output(filename, ios::out | ios::binary | ios::trunc),
+  m_pending(procs_count), m_ended(procs_count, false),
+  m_num_empty(procs_count), m_written(0), m_transposed(transposed),
+  m_header(procs_count), m_header_written(false), m_entries(procs_count, 0),
+  m_barriers(procs_count, 0), m_addr_mask(0) {
+    if (!m_output.is_open() || procs_count == 0) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+}
+
+void TraceWriter::set_workload(const string &workload) {
+    if (m_header_written) {
+        throw runtime_error("The trace header was already written");
+    }
+    m_header.set_workload(workload);
+}
+
+void TraceWriter::set_params(const string &params) {
+    if (m_header_written) {
+        throw runtime_error("The trace header was already written");
+    }
+    m_header.set_params(params);
+}
+
+void TraceWriter::set_line_size(uint32_t line_size) {
+    if (m_header_written) {
+        throw runtime_error("The trace header was already written");
+    }
+    m_header.set_line_size(line_size);
+}
+
+void TraceWriter::set_description(const TraceHeader &header) {
+    set_workload(header.get_workload());
+    set_params(header.get_params());
+    set_line_size(header.get_line_size());
+}
+
+void TraceWriter::write_header() {
+    // File signature and number of processors
+    uint32_t flags = TraceHeader::header_flag | (m_transposed ? RawTraceReader::transposed_flag : 0);
+    uint32_t procs = htonl((uint32_t)m_pending.size() | flags);
+    vector<unsigned char> data(8);
+    memcpy(data.data(), "5TRF", 4);
+    memcpy(data.data() + 4, &procs, sizeof(procs));
+    m_header.encode(data);
+    m_output.write((const char *)data.data(), data.size());
+    m_header_written = true;
+}
+
+TraceWriter::~TraceWriter() {
+    if (m_output.is_open()) {
+        try {
+            close();
+        } catch (exception &e) {
+            // Nothing left to do, the file is incomplete
+        }
+    }
+}
+
+void TraceWriter::add(uint32_t pid, TraceFile::EntryType type, uint64_t addr, uint32_t size) {
+    if (addr > TraceFile::PackedEntry::addr_mask) {
+        throw runtime_error("Address " + to_string(addr) + " does not fit in the 55 bits of a trace entry");
+    }
+    add(pid, TraceFile::PackedEntry::make(type, addr, size));
+}
+
+void TraceWriter::add(uint32_t pid, TraceFile::PackedEntry pe) {
+    add(pid, &pe, 1);
+}
+
+void TraceWriter::add(uint32_t pid, const TraceFile::PackedEntry *entries, size_t n) {
+    size_t i;
+    uint64_t barriers = 0;
+    for (i = 0; i < n; i++) {
+        // Nothing is read after the end tag of a trace
+        if (m_ended.at(pid)) {
+            break;
+        }
+        m_ended[pid] = (entries[i].type() == TraceFile::ENTRY_TYPE_END);
+        barriers += entries[i].type() == TraceFile::ENTRY_TYPE_BARRIER;
+        if (entries[i].type() != TraceFile::ENTRY_TYPE_NOP) {
+            m_addr_mask |= entries[i].addr(); // NOPs hold idle cycles
+        }
+
+        if (m_pending[pid].empty()) {
+            m_num_empty--;
+        }
+        m_pending[pid].push_back(entries[i].word);
+    }
+    if (i > 0) {
+        m_entries[pid] += i;
+        m_barriers[pid] += barriers;
+    }
+    if (!m_transposed) {
+        flush_rounds();
+    }
+}
+
+void TraceWriter::flush_rounds() {
+    // Ended processors are padded with NOPs, so they never hold up a round
+    while (true) {
+        for (size_t i = 0; i < m_pending.size(); i++) {
+            if (m_pending[i].empty() && !m_ended[i]) {
+                return;
+            }
+        }
+        if (m_num_empty == m_pending.size()) {
+            return;
+        }
+        write_round();
+    }
+}
+
+void TraceWriter::write_round() {
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        uint64_t word = 0; // NOP
+        if (!m_pending[i].empty()) {
+            word = m_pending[i].front();
+            m_pending[i].pop_front();
+            if (m_pending[i].empty()) {
+                m_num_empty++;
+            }
+        }
+        // Entries are stored big endian
+        for (int j = 0; j < 8; j++) {
+            m_buffer.push_back((unsigned char)(word >> (56 - j * 8)));
+        }
+        m_written++;
+    }
+    if (m_buffer.size() >= buffer_size) {
+        flush_buffer();
+    }
+}
+
+void TraceWriter::write_blocks() {
+    // Block table, the blocks follow it in processor order
+    uint64_t offset = 8 + m_header.get_size() + m_pending.size() * 16;
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        uint64_t words[2] = { offset, m_pending[i].size() };
+        for (int w = 0; w < 2; w++) {
+            for (int j = 0; j < 8; j++) {
+                m_buffer.push_back((unsigned char)(words[w] >> (56 - j * 8)));
+            }
+        }
+        offset += m_pending[i].size() * 8;
+    }
+
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        std::deque<uint64_t> &block = m_pending[i];
+        for (size_t k = 0; k < block.size(); k++) {
+            for (int j = 0; j < 8; j++) {
+                m_buffer.push_back((unsigned char)(block[k] >> (56 - j * 8)));
+            }
+            if (m_buffer.size() >= buffer_size) {
+                flush_buffer();
+            }
+        }
+        m_written += block.size();
+        block.clear();
+    }
+    m_num_empty = m_pending.size();
+}
+
+void TraceWriter::flush_buffer() {
+    if (!m_header_written) {
+        write_header();
+    }
+    m_output.write((const char *)m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+}
+
+void TraceWriter::close() {
+    if (!m_output.is_open()) {
+        return;
+    }
+
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        add(i, TraceFile::ENTRY_TYPE_END, 0);
+    }
+
+    // The counts are final now
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        m_header.add_entries(i, m_entries[i], m_barriers[i]);
+    }
+    uint32_t bits = 0;
+    while (bits < 64 && (m_addr_mask >> bits) != 0) {
+        bits++;
+    }
+    m_header.set_address_bits(bits);
+    bool rewrite = m_header_written;
+
+    if (m_transposed) {
+        write_blocks();
+    }
+    while (m_num_empty < m_pending.size()) {
+        write_round();
+    }
+    flush_buffer();
+
+    // Fill in the header that went out with the first entries, which is not
+    // possible if the file is a pipe
+    if (rewrite) {
+        m_output.seekp(0);
+        if (m_output.fail()) {
+            m_output.clear();
+        } else {
+            write_header();
+        }
+    }
+
+    m_output.close();
+    if (m_output.fail()) {
+        throw runtime_error("Unable to write tracefile");
+    }
+}
+
+uint64_t TraceWriter::get_entry_count() const {
+    return m_written;
+}
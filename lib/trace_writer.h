@@ -0,0 +1,118 @@
+/*
+// Header file for the TraceWriter class, which writes traces in the 5TRF
+// format read by the TraceFile class.
+*/
+
+#ifndef TRACE_WRITER_H
+#define TRACE_WRITER_H
+
+#include "psa.h"
+#include "trace_header.h"
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Entries can be added for the processors in any order. The 5TRF format
+ * interleaves the processor traces entry by entry, so entries are held back
+ * until every processor has an entry for the next round. After a processor's
+ * trace has ended its slots are filled with NOPs.
+ *
+ * The transposed layout (see RawTraceReader) stores every processor's trace
+ * in one block. Its entries are kept in memory and written by close().
+ *
+ * Files start with the version 2 header (see trace_header.h). It is written
+ * with the first entries and filled in by close() once the counts are known,
+ * which needs a file that can be seeked.
+ */
+class TraceWriter {
+    public:
+    // Creates filename, throws a runtime_error if this is not possible
+    TraceWriter(const char *filename, uint32_t procs_count, bool transposed = false);
+    ~TraceWriter();
+
+    void add(uint32_t pid, TraceFile::PackedEntry pe);
+
+    // Adds an entry, throws a runtime_error if addr needs more than the 55
+    // bits of the encoding (see PackedEntry in psa.h)
+    void add(uint32_t pid, TraceFile::EntryType type, uint64_t addr, uint32_t size = 1);
+
+    // Adds n consecutive entries of processor pid
+    void add(uint32_t pid, const TraceFile::PackedEntry *entries, size_t n);
+
+    /*
+     * Describe the trace in the header: the workload, the parameters it was
+     * generated with and the cache line size it was made for. Throws a
+     * runtime_error once the header was written.
+     */
+    void set_workload(const std::string &workload);
+    void set_params(const std::string &params);
+    void set_line_size(uint32_t line_size);
+
+    // Takes over the description of a trace from its header
+    void set_description(const TraceHeader &header);
+
+    void read(uint32_t pid, uint64_t addr, uint32_t size = 1) {
+        add(pid, TraceFile::ENTRY_TYPE_READ, addr, size);
+    }
+    void write(uint32_t pid, uint64_t addr, uint32_t size = 1) {
+        add(pid, TraceFile::ENTRY_TYPE_WRITE, addr, size);
+    }
+    void rmw(uint32_t pid, uint64_t addr, uint32_t size = 1) {
+        add(pid, TraceFile::ENTRY_TYPE_RMW, addr, size);
+    }
+    void fence(uint32_t pid) { add(pid, TraceFile::ENTRY_TYPE_FENCE, 0); }
+    void barrier(uint32_t pid) { add(pid, TraceFile::ENTRY_TYPE_BARRIER, 0); }
+    // A NOP of more than one cycle stores its idle cycles, see
+    // TraceFile::Entry
+    void nop(uint32_t pid, uint64_t cycles = 1) {
+        add(pid, TraceFile::ENTRY_TYPE_NOP, cycles > 1 ? cycles : 0);
+    }
+
+    /*
+     * Ends the trace of every processor that did not end yet, writes all
+     * pending entries and closes the file. Throws a runtime_error if the file
+     * could not be written.
+     */
+    void close();
+
+    // Returns the number of entries written so far, NOP padding included
+    uint64_t get_entry_count() const;
+
+    private:
+    std::ofstream m_output;
+    std::vector<std::deque<uint64_t> > m_pending;
+    std::vector<bool> m_ended;
+    size_t m_num_empty; // Number of processors without pending entries
+    uint64_t m_written;
+    std::vector<unsigned char> m_buffer; // Written rounds not in the file yet
+    bool m_transposed;
+
+    TraceHeader m_header; // Counts are only added by close()
+    bool m_header_written;
+    std::vector<uint64_t> m_entries;  // Entries per processor, no padding
+    std::vector<uint64_t> m_barriers; // Barriers per processor
+    uint64_t m_addr_mask;             // All addresses or'ed together
+
+    // Writes the signature, the processor count and the header
+    void write_header();
+
+    // Writes the blocks of a transposed trace
+    void write_blocks();
+
+    // Writes all rounds for which every processor has an entry
+    void flush_rounds();
+
+    // Writes a single round, NOP for processors without pending entry
+    void write_round();
+
+    // Writes the buffered rounds to the file
+    void flush_buffer();
+
+    // No copies are allowed.
+    TraceWriter(const TraceWriter &wr);
+};
+
+#endif
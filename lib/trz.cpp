@@ -0,0 +1,458 @@
+/*
+// Source file for the compressed trace format (5TRZ), see trz.h for a
+// description of the format.
+*/
+
+#include "trz.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+// Entries of a symbol kind
+enum SymbolKind {
+    KIND_READ = 0,
+    KIND_WRITE = 1,
+    KIND_OTHER = 2,
+    KIND_RUN = 3
+};
+
+// A predictor that is further away than this starts a new stream
+static const uint64_t stream_distance = 512;
+
+// Strides up to this size are remembered by a predictor
+static const int64_t max_stride = 4096;
+
+// Everything but the type, the access size is encoded along with the address
+static const uint64_t addr_mask = ~(0b111ULL << 61);
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void put_varint(vector<unsigned char> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+static inline uint64_t get_varint(const unsigned char *&pos, const unsigned char *end) {
+    // Most symbols fit in a single byte
+    if (pos < end && *pos < 0x80) {
+        return *pos++;
+    }
+
+    uint64_t v = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        unsigned char b = *pos++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (b < 0x80) {
+            return v;
+        }
+    }
+    throw runtime_error("Corrupt compressed tracefile");
+}
+
+static void put_be64(vector<unsigned char> &out, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        out.push_back((unsigned char)(v >> (i * 8)));
+    }
+}
+
+static uint64_t get_be64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Moves predictor p of a processor to address addr. Shared by the encoder
+// and the reader, which have to stay in lock-step.
+static inline void train(uint64_t *base, int64_t *stride, int p, uint64_t addr) {
+    int64_t d = (int64_t)(addr - base[p]);
+    stride[p] = (d > -max_stride && d < max_stride) ? d : 0;
+    base[p] = addr;
+}
+
+TrzEncoder::TrzEncoder(uint32_t procs_count)
+: m_streams(procs_count), m_header(procs_count), m_addr_mask(0) {
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        Stream &s = m_streams[i];
+        s.count = 0;
+        s.barriers = 0;
+        s.ended = false;
+        for (int p = 0; p < num_predictors; p++) {
+            s.base[p] = 0;
+            s.stride[p] = 0;
+            s.lru[p] = p;
+        }
+        s.run_length = 0;
+        s.run_type = 0;
+    }
+}
+
+void TrzEncoder::flush_run(Stream &s) {
+    if (s.run_length > 0) {
+        put_varint(s.data, ((s.run_length << 3 | s.run_type) << 2) | KIND_RUN);
+        s.run_length = 0;
+    }
+}
+
+void TrzEncoder::add(uint32_t pid, TraceFile::PackedEntry pe) {
+    Stream &s = m_streams.at(pid);
+    if (s.ended) {
+        return;
+    }
+
+    uint32_t type = pe.type();
+    uint64_t addr = pe.word & addr_mask;
+    s.count++;
+    s.barriers += type == TraceFile::ENTRY_TYPE_BARRIER;
+    s.ended = (type == TraceFile::ENTRY_TYPE_END);
+    if (type != TraceFile::ENTRY_TYPE_NOP) {
+        m_addr_mask |= pe.addr(); // NOPs hold idle cycles
+    }
+
+    // Entries without an address are run-length encoded
+    if (addr == 0) {
+        if (s.run_length > 0 && s.run_type != type) {
+            flush_run(s);
+        }
+        s.run_type = type;
+        s.run_length++;
+        return;
+    }
+    flush_run(s);
+
+    // Pick the predictor closest to the address
+    int best = 0;
+    uint64_t best_dist = UINT64_MAX;
+    for (int p = 0; p < num_predictors; p++) {
+        int64_t res = (int64_t)(addr - (s.base[p] + s.stride[p]));
+        uint64_t dist = res < 0 ? -(uint64_t)res : (uint64_t)res;
+        if (dist < best_dist) {
+            best = p;
+            best_dist = dist;
+        }
+    }
+
+    // A far away address starts a new stream, which takes over the least
+    // recently used predictor.
+    if (best_dist >= stream_distance) {
+        best = s.lru[num_predictors - 1];
+    }
+
+    uint64_t res = zigzag((int64_t)(addr - (s.base[best] + s.stride[best])));
+    uint32_t kind = KIND_OTHER;
+    if (type == TraceFile::ENTRY_TYPE_READ) {
+        kind = KIND_READ;
+    } else if (type == TraceFile::ENTRY_TYPE_WRITE) {
+        kind = KIND_WRITE;
+    }
+
+    // Residuals that do not fit in a symbol are stored as absolute address
+    bool absolute = res >= (1ULL << 58);
+    if (absolute) {
+        kind = KIND_OTHER;
+        res = 0;
+    }
+
+    put_varint(s.data, ((res << 2 | best) << 2) | kind);
+    if (kind == KIND_OTHER) {
+        s.data.push_back((unsigned char)(type | (absolute ? 0x80 : 0)));
+        if (absolute) {
+            put_varint(s.data, addr);
+        }
+    }
+
+    train(s.base, s.stride, best, addr);
+
+    // Move the predictor to the front of the LRU order
+    int i = 0;
+    while (s.lru[i] != best) {
+        i++;
+    }
+    for (; i > 0; i--) {
+        s.lru[i] = s.lru[i - 1];
+    }
+    s.lru[0] = best;
+}
+
+uint64_t TrzEncoder::get_entry_count(uint32_t pid) const {
+    return m_streams.at(pid).count;
+}
+
+void TrzEncoder::set_description(const TraceHeader &header) {
+    m_header.set_workload(header.get_workload());
+    m_header.set_params(header.get_params());
+    m_header.set_line_size(header.get_line_size());
+}
+
+uint64_t TrzEncoder::write(const char *filename) {
+    // The counts are final once every trace has its end tag
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        add(i, TraceFile::PackedEntry::make(TraceFile::ENTRY_TYPE_END, 0));
+        m_header.add_entries(i, m_streams[i].count, m_streams[i].barriers);
+    }
+    uint32_t bits = 0;
+    while (bits < 64 && (m_addr_mask >> bits) != 0) {
+        bits++;
+    }
+    m_header.set_address_bits(bits);
+
+    vector<unsigned char> header(8);
+    memcpy(header.data(), "5TRZ", 4);
+    uint32_t flags = m_streams.size() | TraceHeader::header_flag;
+    for (int i = 0; i < 4; i++) {
+        header[4 + i] = (unsigned char)(flags >> (24 - i * 8));
+    }
+    m_header.encode(header);
+
+    uint64_t offset = header.size() + (uint64_t)m_streams.size() * 24;
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        flush_run(m_streams[i]);
+        put_be64(header, m_streams[i].count);
+        put_be64(header, offset);
+        put_be64(header, m_streams[i].data.size());
+        offset += m_streams[i].data.size();
+    }
+
+    ofstream output(filename, ios::out | ios::binary | ios::trunc);
+    if (!output.is_open()) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+    output.write((const char *)header.data(), header.size());
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        output.write((const char *)m_streams[i].data.data(), m_streams[i].data.size());
+    }
+    output.close();
+    if (output.fail()) {
+        throw runtime_error(string("Unable to write file: ") + filename);
+    }
+    return offset;
+}
+
+TrzTraceReader::TrzTraceReader(const char *filename, TraceFile::ReadMode mode) {
+    m_image.load(filename, mode);
+    init(filename);
+}
+
+TrzTraceReader::TrzTraceReader(int fd, const char *header) {
+    m_image.read(fd, header, 8);
+    init("-");
+}
+
+void TrzTraceReader::init(const char *filename) {
+    const unsigned char *data = m_image.data();
+    size_t size = m_image.size();
+
+    if (size < 8 || strncmp((const char *)data, "5TRZ", 4)) {
+        throw runtime_error(string("Invalid file signature in file: ") + filename);
+    }
+
+    // An index at the end of the file is not part of the trace data
+    uint64_t data_end = size;
+    m_has_index = m_index.read(data, size, data_end);
+
+    uint32_t procs_count = (uint32_t)data[4] << 24 | (uint32_t)data[5] << 16 |
+                           (uint32_t)data[6] << 8 | (uint32_t)data[7];
+    m_has_header = (procs_count & TraceHeader::header_flag) != 0;
+    procs_count &= ~TraceHeader::header_flag;
+
+    // The version 2 header comes before the stream table
+    uint64_t table = 8;
+    if (m_has_header) {
+        if (data_end < table + 4 || TraceHeader::peek_size(data + 8) > data_end - table) {
+            throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+        }
+        uint32_t size = TraceHeader::peek_size(data + 8);
+        m_header.parse(procs_count, data + 8, size);
+        table += size;
+    }
+    if (procs_count == 0 || table + (uint64_t)procs_count * 24 > data_end) {
+        throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+    }
+
+    m_cursors.resize(procs_count);
+    for (uint32_t i = 0; i < procs_count; i++) {
+        const unsigned char *hdr = data + table + i * 24;
+        uint64_t offset = get_be64(hdr + 8);
+        uint64_t length = get_be64(hdr + 16);
+        if (offset > data_end || length > data_end - offset) {
+            throw runtime_error(string("Unexpected end of tracefile: ") + filename);
+        }
+
+        Cursor &c = m_cursors[i];
+        c.start = data + offset;
+        c.end = data + offset + length;
+        c.count = get_be64(hdr);
+        rewind(i);
+    }
+
+    if (!m_has_index) {
+        return;
+    }
+
+    // Check that the index was made for this trace
+    string error = string("Index does not match the trace in file: ") + filename;
+    if (m_index.get_proc_count() != procs_count || m_index.get_state_words() != get_state_words()) {
+        throw runtime_error(error);
+    }
+    for (uint32_t i = 0; i < procs_count; i++) {
+        const Cursor &c = m_cursors[i];
+        const TraceCheckpoint *cp = m_index.find_checkpoint(i, UINT64_MAX);
+        if (m_index.get_entry_count(i) != c.count ||
+            (cp != NULL && cp->offset > (uint64_t)(c.end - c.start))) {
+            throw runtime_error(error);
+        }
+    }
+}
+
+void TrzTraceReader::rewind(uint32_t pid) {
+    Cursor &c = m_cursors[pid];
+    c.pos = c.start;
+    c.ended = false;
+    for (int p = 0; p < TrzEncoder::num_predictors; p++) {
+        c.base[p] = 0;
+        c.stride[p] = 0;
+    }
+    c.run_length = 0;
+    c.run_type = 0;
+}
+
+const TraceIndex *TrzTraceReader::get_index() const {
+    return m_has_index ? &m_index : NULL;
+}
+
+uint32_t TrzTraceReader::get_state_words() const {
+    return 2 * TrzEncoder::num_predictors + 3;
+}
+
+void TrzTraceReader::checkpoint(uint32_t pid, TraceCheckpoint &cp) const {
+    const Cursor &c = m_cursors.at(pid);
+    cp.offset = c.pos - c.start;
+    cp.state.clear();
+    for (int p = 0; p < TrzEncoder::num_predictors; p++) {
+        cp.state.push_back(c.base[p]);
+        cp.state.push_back(c.stride[p]);
+    }
+    cp.state.push_back(c.run_length);
+    cp.state.push_back(c.run_type);
+    cp.state.push_back(c.ended);
+}
+
+void TrzTraceReader::seek(const vector<uint64_t> &entries) {
+    vector<TraceFile::PackedEntry> skipped(4096);
+
+    for (uint32_t pid = 0; pid < m_cursors.size(); pid++) {
+        Cursor &c = m_cursors[pid];
+        uint64_t n = entries.at(pid);
+        const TraceCheckpoint *cp = m_has_index ? m_index.find_checkpoint(pid, n) : NULL;
+
+        // Continue from the checkpoint, or decode the trace from the start
+        uint64_t entry = 0;
+        rewind(pid);
+        if (cp != NULL) {
+            entry = cp->entry;
+            c.pos = c.start + cp->offset;
+            for (int p = 0; p < TrzEncoder::num_predictors; p++) {
+                c.base[p] = cp->state[2 * p];
+                c.stride[p] = cp->state[2 * p + 1];
+            }
+            c.run_length = cp->state[2 * TrzEncoder::num_predictors];
+            c.run_type = cp->state[2 * TrzEncoder::num_predictors + 1];
+            c.ended = cp->state[2 * TrzEncoder::num_predictors + 2] != 0;
+        }
+
+        while (entry < n) {
+            size_t want = n - entry < skipped.size() ? n - entry : skipped.size();
+            size_t got = fetch(pid, skipped.data(), want);
+            if (got == 0) {
+                break;
+            }
+            entry += got;
+        }
+    }
+}
+
+bool TrzTraceReader::is_mapped() const {
+    return m_image.is_mapped();
+}
+
+uint32_t TrzTraceReader::get_proc_count() const {
+    return m_cursors.size();
+}
+
+const TraceHeader *TrzTraceReader::get_header() const {
+    return m_has_header ? &m_header : NULL;
+}
+
+size_t TrzTraceReader::fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n) {
+    // Work on a local copy of the cursor, the output entries could alias it
+    Cursor c = m_cursors[pid];
+    size_t k = 0;
+
+    while (k < n && !c.ended) {
+        // Continue a run of entries without address
+        if (c.run_length > 0) {
+            uint64_t word = (uint64_t)c.run_type << 61;
+            size_t m = c.run_length < n - k ? c.run_length : n - k;
+            if (c.run_type == TraceFile::ENTRY_TYPE_END) {
+                m = 1;
+                c.ended = true;
+            }
+            for (size_t i = 0; i < m; i++) {
+                out[k + i].word = word;
+            }
+            k += m;
+            c.run_length -= m;
+            continue;
+        }
+
+        if (c.pos >= c.end) {
+            break;
+        }
+
+        uint64_t sym = get_varint(c.pos, c.end);
+        uint32_t kind = sym & 3;
+        uint64_t payload = sym >> 2;
+
+        if (kind == KIND_RUN) {
+            c.run_type = payload & 7;
+            c.run_length = payload >> 3;
+            continue;
+        }
+
+        int p = payload & 3;
+        uint64_t addr = c.base[p] + c.stride[p] + unzigzag(payload >> 2);
+        uint64_t type = kind + 1; // KIND_READ/KIND_WRITE to the entry type
+
+        if (kind == KIND_OTHER) {
+            if (c.pos >= c.end) {
+                throw runtime_error("Corrupt compressed tracefile");
+            }
+            unsigned char b = *c.pos++;
+            type = b & 7;
+            if (b & 0x80) {
+                addr = get_varint(c.pos, c.end);
+            }
+        }
+
+        train(c.base, c.stride, p, addr);
+        out[k++].word = (type << 61) | (addr & addr_mask);
+        c.ended = (type == TraceFile::ENTRY_TYPE_END);
+    }
+
+    m_cursors[pid] = c;
+    return k;
+}
@@ -0,0 +1,145 @@
+/*
+// Header file for the compressed trace format (5TRZ).
+//
+// Every processor's trace is stored as its own stream of varint symbols, in
+// program order. Entries with a zero address (NOPs, barriers, end tags) are
+// run-length encoded, NOPs that store idle cycles are encoded like accesses.
+// Entries with an address are delta encoded against one of four stride
+// predictors kept per processor: each symbol holds the zigzag encoded
+// difference between the address and the prediction of the chosen
+// predictor. Interleaved streams, like the rows and columns of a
+// matrix multiplication, end up in separate predictors, so most entries take
+// a single byte. The access size bits count as part of the address, so a
+// stream keeps small residuals as long as its access size stays the same.
+//
+// Layout, all header fields big endian like in 5TRF:
+//   "5TRZ" | procs_count | header_flag (32 bit)
+//   the version 2 header, see trace_header.h
+//   per processor: entry count, stream offset, stream length (64 bit each)
+//   the processor streams
+// Files written before the header was added lack the flag and the header.
+// Their entries carry access sizes all the same, as 5TRZ was only ever
+// written from traces that have them.
+//
+// Symbol: varint(payload << 2 | kind)
+//   kind 0/1: READ/WRITE, payload = zigzag(residual) << 2 | predictor
+//   kind 2:   other type, payload as for kind 0/1, followed by a type byte.
+//             If bit 7 of the type byte is set the residual is 0 and the
+//             absolute address follows as a varint.
+//   kind 3:   run of zero address entries, payload = length << 3 | type
+*/
+
+#ifndef TRZ_H
+#define TRZ_H
+
+#include "psa.h"
+#include "trace_header.h"
+#include "trace_reader.h"
+
+#include <vector>
+
+// Compresses traces into the 5TRZ format
+class TrzEncoder {
+    public:
+    TrzEncoder(uint32_t procs_count);
+
+    /*
+     * Appends an entry to the trace of processor pid. Entries after an end
+     * tag are not part of a trace and are dropped.
+     */
+    void add(uint32_t pid, TraceFile::PackedEntry pe);
+
+    // Takes the workload, the generator parameters and the line size of
+    // header, like TraceWriter::set_description()
+    void set_description(const TraceHeader &header);
+
+    /*
+     * Writes the compressed trace to filename, throws a runtime_error on
+     * failure. Traces without an end tag get one first, then the counts
+     * and the address bits of the header are filled in. Returns the size
+     * of the written file in bytes.
+     */
+    uint64_t write(const char *filename);
+
+    // Returns the number of entries added to the trace of processor pid
+    uint64_t get_entry_count(uint32_t pid) const;
+
+    // Number of stride predictors per processor
+    static const int num_predictors = 4;
+
+    private:
+    struct Stream {
+        std::vector<unsigned char> data;
+        uint64_t count;
+        uint64_t barriers;
+        bool ended;
+        uint64_t base[num_predictors];
+        int64_t stride[num_predictors];
+        int lru[num_predictors]; // Predictors, most recently used first
+        uint64_t run_length;
+        uint32_t run_type;
+    };
+
+    std::vector<Stream> m_streams;
+    TraceHeader m_header;
+    uint64_t m_addr_mask; // All addresses or'ed together
+
+    void flush_run(Stream &s);
+};
+
+// Reader for the 5TRZ format
+class TrzTraceReader : public TraceReader {
+    public:
+    TrzTraceReader(const char *filename, TraceFile::ReadMode mode);
+
+    // Reads the trace from descriptor fd, after the 8 byte header that was
+    // already read from it
+    TrzTraceReader(int fd, const char *header);
+
+    size_t fetch(uint32_t pid, TraceFile::PackedEntry *out, size_t n);
+    bool is_mapped() const;
+
+    /*
+     * Seeking decodes from the closest checkpoint of the index before the
+     * entry, or from the start of the trace if the file has no index.
+     */
+    const TraceIndex *get_index() const;
+    void seek(const std::vector<uint64_t> &entries);
+    uint32_t get_state_words() const;
+    void checkpoint(uint32_t pid, TraceCheckpoint &cp) const;
+
+    uint32_t get_proc_count() const;
+
+    // NULL for files written before 5TRZ stored the header
+    const TraceHeader *get_header() const;
+
+    private:
+    struct Cursor {
+        const unsigned char *start;
+        const unsigned char *pos;
+        const unsigned char *end;
+        bool ended;
+        uint64_t base[TrzEncoder::num_predictors];
+        int64_t stride[TrzEncoder::num_predictors];
+        uint64_t run_length;
+        uint32_t run_type;
+        uint64_t count; // Number of entries in the stream
+    };
+
+    FileImage m_image;
+    std::vector<Cursor> m_cursors;
+
+    TraceIndex m_index;
+    bool m_has_index;
+
+    TraceHeader m_header;
+    bool m_has_header;
+
+    // Sets up the cursors from the loaded image
+    void init(const char *filename);
+
+    // Moves the cursor of pid back to the start of its stream
+    void rewind(uint32_t pid);
+};
+
+#endif
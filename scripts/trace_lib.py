@@ -1,16 +1,18 @@
 import struct
 
 class Trace:
-    (TYPE_NOP, TYPE_READ, TYPE_WRITE, TYPE_END, TYPE_BARRIER) = range(5)
+    (TYPE_NOP, TYPE_READ, TYPE_WRITE, TYPE_END, TYPE_BARRIER, TYPE_IFETCH, TYPE_RMW,
+     TYPE_FENCE) = range(8)
 
     # use type_to_enum.index("R") to get the enum TYPE_READ value
-    type_to_enum = "NRWEB"
+    type_to_enum = "NRWEBIAF"
 
     def __init__(self, filename, num_procs):
         self.num_procs = num_procs
         self.f = open(filename, "wb")
         self.f.write(b"5TRF") # trace file signature
-        self.write32(self.num_procs)
+        self.write32(self.num_procs | Trace_reader.header_flag)
+        self.write_header()
 
     def write32(self, n):
         self.f.write(struct.pack('>I', n))
@@ -18,24 +20,49 @@ class Trace:
     def write64(self, n):
         self.f.write(struct.pack('>Q', n))
 
-    def entry(self, t, addr):
-        self.write64((t << 61) | (addr & ~(0b111 << 61)))
+    # the version 2 header, see lib/trace_header.h, without entry counts,
+    # address bits and line size. It marks the entries as having a size.
+    def write_header(self):
+        self.write32(16 + self.num_procs * 16 + 8) # header size
+        self.write32(2) # version
+        self.write32(0) # address bits
+        self.write32(0) # line size
+        for _ in range(self.num_procs):
+            self.write64(0) # entry count
+            self.write64(0) # barrier count
+        self.write32(0) # workload name length
+        self.write32(0) # generator parameters length
+
+    # size is the number of bytes accessed, 1 to 64, see PackedEntry in lib/psa.h
+    def entry(self, t, addr, size=1):
+        size = min(max(size, 1), 64)
+        self.write64((t << 61) | ((size - 1) << 55) | (addr & ((1 << 55) - 1)))
 
-    def entry_str_type(self, str_type, addr):
+    def entry_str_type(self, str_type, addr, size=1):
         t = Trace.type_to_enum.index(str_type)
-        self.entry(t, addr)
+        self.entry(t, addr, size)
+
+    def read(self, addr, size=1):
+        self.entry(Trace.TYPE_READ, addr, size)
+
+    def write(self, addr, size=1):
+        self.entry(Trace.TYPE_WRITE, addr, size)
 
-    def read(self, addr):
-        self.entry(Trace.TYPE_READ, addr)
+    def ifetch(self, addr, size=4):
+        self.entry(Trace.TYPE_IFETCH, addr, size)
 
-    def write(self, addr):
-        self.entry(Trace.TYPE_WRITE, addr)
+    def rmw(self, addr, size=1):
+        self.entry(Trace.TYPE_RMW, addr, size)
+
+    def fence(self):
+        self.entry(Trace.TYPE_FENCE, 0x0)
 
     def barrier(self):
         self.entry(Trace.TYPE_BARRIER, 0x0)
 
-    def nop(self):
-        self.entry(Trace.TYPE_NOP, 0x0)
+    # a NOP of more than one cycle stores its idle cycles in the address field
+    def nop(self, cycles=1):
+        self.entry(Trace.TYPE_NOP, cycles if cycles > 1 else 0x0)
 
     def close(self):
         for _ in range(self.num_procs):
@@ -47,9 +74,11 @@ class Trace:
 
 
 class Trace_reader:
-    address_mask = ~(0b111 << 61)   # type stored in upper three bits.
-    map_type_to_char = "NRWEB"
-    map_type_to_string = ["NOP", "READ", "WRITE", "END", "BARRIER"]
+    address_mask = (1 << 55) - 1    # type and access size stored in upper nine bits.
+    map_type_to_char = "NRWEBIAF"
+    map_type_to_string = ["NOP", "READ", "WRITE", "END", "BARRIER", "IFETCH", "RMW", "FENCE"]
+    transposed_flag = 0x80000000
+    header_flag = 0x40000000
 
     def __init__(self, filename):
         self.f = open(filename, "rb")
@@ -59,6 +88,18 @@ class Trace_reader:
             exit(1)
         self.num_procs = struct.unpack_from(">I", self.read32())[0]
         self.proc_id = 0
+        self.size = 1   # access size of the last entry returned by next()
+
+        # Skip the version 2 header, see lib/trace_header.h. Traces without
+        # it have no size field, see PackedEntry in lib/psa.h
+        self.sized = (self.num_procs & Trace_reader.header_flag) != 0
+        if self.sized:
+            self.num_procs &= ~Trace_reader.header_flag
+            size = struct.unpack_from(">I", self.read32())[0]
+            self.f.seek(size - 4, 1)
+        if self.num_procs & Trace_reader.transposed_flag:
+            print("transposed traces are not supported, convert with trf_convert --to=trf")
+            exit(1)
 
     def read32(self): return self.f.read(4)
 
@@ -71,10 +112,16 @@ class Trace_reader:
         current_proc_id = self.proc_id
         self.proc_id = (self.proc_id + 1) % self.num_procs
 
-        # Unpack type (3 upper bit) and address (lower 61 bits).
+        # Unpack type (3 upper bits), access size minus one (next 6 bits)
+        # and address (lower 55 bits).
         value = struct.unpack_from(">Q", e)[0]
         e_type = value >> 61
         e_addr = value & Trace_reader.address_mask
+        self.size = ((value >> 55) & 0x3F) + 1
+        if not self.sized and self.size > 1:
+            print(f"address {value & ((1 << 61) - 1):#x} of a trace without the version 2 header "
+                  "does not fit in 55 bits")
+            exit(1)
 
         return (current_proc_id, e_type, e_addr)
 
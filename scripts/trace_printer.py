@@ -22,10 +22,11 @@ def main():
         if not e:
             break
         (proc_id, e_type, e_addr) = e
+        size = f' ({trace.size} B)' if trace.size > 1 else ''
         if args.hex:
-            print(f'P{proc_id} {Trace_reader.type_to_string(e_type)} 0x{e_addr:x}')
+            print(f'P{proc_id} {Trace_reader.type_to_string(e_type)} 0x{e_addr:x}{size}')
         else:
-            print(f'P{proc_id} {Trace_reader.type_to_string(e_type)} {e_addr}')
+            print(f'P{proc_id} {Trace_reader.type_to_string(e_type)} {e_addr}{size}')
 
     trace.close()
 
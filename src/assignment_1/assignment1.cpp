@@ -8,21 +8,15 @@
 #define SC_ALLOW_DEPRECATED_IEEE_API
 
 #include "psa.h"
+#include "cache_config.h"
+#include "cache_kernel.h"
 
 using namespace std;
 using namespace sc_core; // This pollutes namespace, better: only import what you need.
 
-struct CacheLine {
-    uint64_t tag; // Stores the block adress
-    double lu_time; // least recently used time for cache eviction 
-    bool valid;
-    bool dirty; 
-};
+// The geometry of the data and instruction cache and the latencies are set
+// at startup, see cache_config.h
 
-static const size_t CACHE_SIZE = 32768; // Byte 
-static const size_t SET_ASSOC = 8;
-static const size_t LINE_SIZE = 32; // Byte 
-static const size_t N_SETS = (CACHE_SIZE / LINE_SIZE) / SET_ASSOC; 
 static bool VERBOSE = true; // Toggle logging  
 
 SC_MODULE(Cache) {
@@ -36,112 +30,103 @@ SC_MODULE(Cache) {
     sc_in<bool> Port_CLK;
     sc_in<Function> Port_Func;
     sc_in<uint64_t> Port_Addr;
+    sc_in<uint32_t> Port_Size; // Bytes accessed from Port_Addr on
     sc_out<RetCode> Port_Done;
     sc_inout_rv<64> Port_Data;
     sc_out<RetStatusCode> Port_Status; // Wire for the hit/miss status code 
 
-    SC_CTOR(Cache) {
+    // Path to main memory, shared by the instruction and data cache
+    sc_mutex *memory_port;
+
+    SC_HAS_PROCESS(Cache);
+
+    Cache(sc_module_name name, const CacheGeometry &geometry, const string &policy)
+    : sc_module(name), memory_port(NULL), geometry(geometry), cache_size(geometry.size),
+      set_assoc(geometry.set_assoc), line_size(geometry.line_size), n_sets(geometry.n_sets) {
         SC_THREAD(execute);
         sensitive << Port_CLK.pos();
         dont_initialize();
 
-        line_table = (CacheLine **)malloc(sizeof(CacheLine *) * N_SETS); // Initialite the cache line 
-        for (size_t i = 0; i < N_SETS; i++) {
-            line_table[i] = (CacheLine *)malloc(sizeof(CacheLine) * SET_ASSOC);
-
-            for(size_t j = 0; j < SET_ASSOC; j++) {
-                line_table[i][j] = (CacheLine) {.tag = 0, .lu_time = 0.0, .valid = false, .dirty = false};
-            }
-        }
+        lines.init(geometry, policy);
+        lines.print_memory(cout, this->name());
 
         VERBOSE && cout << "---------- Cache Specs --------" << endl;
-        VERBOSE && cout << "Cache size: " << CACHE_SIZE << " B" << endl;
-        VERBOSE && cout << "Line size: " << LINE_SIZE << " B" << endl;
-        VERBOSE && cout << "Set associativity: " << SET_ASSOC << endl;
-        VERBOSE && cout << "Number of Sets: " << N_SETS << endl;
+        VERBOSE && cout << "Cache: " << this->name() << endl;
+        VERBOSE && cout << "Cache size: " << cache_size << " B" << endl;
+        VERBOSE && cout << "Line size: " << line_size << " B" << endl;
+        VERBOSE && cout << "Set associativity: " << set_assoc << endl;
+        VERBOSE && cout << "Number of Sets: " << n_sets << endl;
+        VERBOSE && cout << "Replacement policy: " << lines.get_policy_name() << endl;
         VERBOSE && cout << "-------------------------------" << endl;
     } 
 
     void dump() {
-        for (size_t i = 0; i < N_SETS; i++) {
+        for (size_t i = 0; i < n_sets; i++) {
             cout << "Cache set: " << i << endl;    
-            for(size_t j = 0; j < SET_ASSOC; j++) {
-                cout << "   Cache Line: " << j << " {tag=" << line_table[i][j].tag << ", lu_time=" << line_table[i][j].lu_time << ", valid=" << line_table[i][j].valid << ", dirty=" << line_table[i][j].dirty << "}" << endl;    
+            for(size_t j = 0; j < set_assoc; j++) {
+                cout << "   Cache Line: " << j << " {tag=" << lines.get_tag(i, j) << ", valid=" << lines.is_valid(i, j) << ", dirty=" << lines.is_dirty(i, j) << "}" << endl;    
             }
         }
     }
 
     private:
-    CacheLine **line_table; // Array of Sets with size SET_ASSOC (e.g. 8 for an 8-way set-associative cache)
-
-    // Returns the index in a cache set into which a new address should be inserted to and informs the cpu about a hit/miss
-    uint64_t probe_cache(CacheLine *c_set, uint64_t block_addr) {
-        double min_lu_time = UINT64_MAX;
-        double min_lu_index = 0;
-        int i = 0;
-
-        while (i < SET_ASSOC) {
-            if(!c_set[i].valid) { // Find an empty cache line for insertion
-               min_lu_index = i;
-               min_lu_time = 0;
-            }
-            else if(c_set[i].tag == block_addr) { // If a cache hit is found return immidiately  
-                VERBOSE && cout << sc_time_stamp() << ": Cache hit" << endl;
-                Port_Status.write(RET_CACHE_HIT);
-                return i;
-            }
-
-            else if (c_set[i].lu_time < min_lu_time) { // Find a cache line to evict for insertion
-                min_lu_index = i;
-                min_lu_time = c_set[i].lu_time;
-            }
-
-            i++;
+    CacheGeometry geometry; // Computes the block address and set of an address
+    size_t cache_size; // Byte
+    size_t set_assoc;
+    size_t line_size; // Byte
+    size_t n_sets;
+    CacheArray lines; // Tags, valid and dirty bits and the replacement state of the n_sets sets of set_assoc lines, see cache_kernel.h
+
+    // Returns the way of the set into which a new address should be inserted to and sets hit on a cache hit
+    uint64_t probe_cache(uint64_t set, uint64_t block_addr, bool &hit) {
+        uint64_t way = lines.probe(set, block_addr, hit);
+        if (hit) {
+            VERBOSE && cout << sc_time_stamp() << ": Cache hit" << endl;
+        } else {
+            VERBOSE && cout << sc_time_stamp() << ": Cache miss, fetching from main" << endl;
         }
-
-        // Cache miss 
-        VERBOSE && cout << sc_time_stamp() << ": Cache miss, fetching from main" << endl;
-        Port_Status.write(RET_CACHE_MISS);
-        return min_lu_index;
+        return way;
     }
 
-    // Refreshes the last recently used time
-    void refresh_lu_time(CacheLine *c_set, uint64_t block_addr, uint64_t index) {
-        c_set[index].lu_time = sc_time_stamp().to_double(); // Refresh last used time
-        VERBOSE && cout << sc_time_stamp() << ": Cache refreshes last used time of " << block_addr << " to " << sc_time_stamp() << endl;
+    // Tells the replacement policy about a hit
+    void refresh_line(uint64_t set, uint64_t block_addr, uint64_t way) {
+        lines.refresh(set, way);
+        VERBOSE && cout << sc_time_stamp() << ": Cache refreshes the replacement state of " << block_addr << endl;
     }
 
 
-    // Inserts a CacheLine into a set and evicts a coliding cache line if necessary
-    void allocate(CacheLine *c_set, uint64_t block_addr, uint64_t index, bool is_write) {
-        if(c_set[index].tag != block_addr && c_set[index].valid) { // evict element
-            VERBOSE && cout << sc_time_stamp() << ": Cache evicts " << c_set[index].tag << endl;
-            if(c_set[index].dirty) { // writeback if dirty
-                wait(100); 
-                VERBOSE && cout << sc_time_stamp() << ": Cache write back dirty block_addr " << c_set[index].tag << " to main" << endl;
+    // Inserts a line into a set and evicts a coliding cache line if necessary
+    void allocate(uint64_t set, uint64_t block_addr, uint64_t way, bool is_write) {
+        memory_port->lock(); // Wait for the other cache to finish with main memory
+        if(lines.is_valid(set, way)) { // evict element
+            VERBOSE && cout << sc_time_stamp() << ": Cache evicts " << lines.get_tag(set, way) << endl;
+            if(lines.is_dirty(set, way)) { // writeback if dirty
+                wait(cache_config.mem_latency);
+                VERBOSE && cout << sc_time_stamp() << ": Cache write back dirty block_addr " << lines.get_tag(set, way) << " to main" << endl;
             }
         }
-        wait(100); 
-        c_set[index] = (CacheLine) {.tag = block_addr, .lu_time = sc_time_stamp().to_double(), .valid = true, .dirty = is_write};
-        VERBOSE && cout << sc_time_stamp() << ": Cache writes " << c_set[index].tag << endl;
+        wait(cache_config.mem_latency);
+        memory_port->unlock();
+        lines.fill(set, way, block_addr, is_write);
+        VERBOSE && cout << sc_time_stamp() << ": Cache writes " << block_addr << endl;
     }
 
-    void write_cache(CacheLine *c_set, uint64_t block_addr, uint64_t index) {
-        if (c_set[index].tag == block_addr && c_set[index].valid) { // Cache hit 
-            refresh_lu_time(c_set, block_addr, index);
-            c_set[index].dirty = true;
-            wait(1);
+    void write_cache(uint64_t set, uint64_t block_addr, uint64_t way, bool hit) {
+        if (hit) { // Cache hit 
+            refresh_line(set, block_addr, way);
+            lines.set_dirty(set, way);
+            wait(cache_config.hit_latency);
         } else { // Load block_addr from main memory and evict if necessary 
-            allocate(c_set, block_addr, index, true);
+            allocate(set, block_addr, way, true);
         }
     }
 
-    void read_cache(CacheLine *c_set, uint64_t block_addr, uint64_t index) {
-        if (c_set[index].tag == block_addr && c_set[index].valid) { // Cache hit 
-            refresh_lu_time(c_set, block_addr, index);
-            wait(1);
+    void read_cache(uint64_t set, uint64_t block_addr, uint64_t way, bool hit) {
+        if (hit) { // Cache hit 
+            refresh_line(set, block_addr, way);
+            wait(cache_config.hit_latency);
         } else { // Load block_addr from main memory and evict if necessary 
-            allocate(c_set, block_addr, index, false);
+            allocate(set, block_addr, way, false);
         }
     }
 
@@ -152,22 +137,32 @@ SC_MODULE(Cache) {
             // Receive function from CPU
             Function f = Port_Func.read();
             uint64_t addr = Port_Addr.read();
-            uint64_t block_addr = addr / LINE_SIZE;
+            uint32_t size = max(Port_Size.read(), 1u);
             uint64_t data = 0;
-
-            // Determine cache set for block_addr
-            size_t set_index = block_addr % N_SETS;
-            CacheLine *c_set = line_table[set_index];
-
-            // Find the index in the c_set at which cache line should be manipulated (in case of a hit) / inserted (in case of a miss)
-            uint64_t index = probe_cache(c_set, block_addr); 
             if (f == FUNC_WRITE) {
                 data = Port_Data.read().to_uint64();
-                write_cache(c_set, block_addr, index);
-            } else {
-                read_cache(c_set, block_addr, index);
             }
 
+            // An access that crosses a line boundary looks up every line it
+            // covers, one after the other. It is a hit only if all lines hit.
+            bool hit = true;
+            uint64_t last_block_addr = geometry.block_addr(addr + size - 1);
+            for (uint64_t block_addr = geometry.block_addr(addr); block_addr <= last_block_addr; block_addr++) {
+                // Determine cache set for block_addr
+                uint64_t set = geometry.set_index(block_addr);
+
+                // Find the way of the set at which cache line should be manipulated (in case of a hit) / inserted (in case of a miss)
+                bool line_hit;
+                uint64_t way = probe_cache(set, block_addr, line_hit);
+                hit = hit && line_hit;
+                if (f == FUNC_WRITE) {
+                    write_cache(set, block_addr, way, line_hit);
+                } else {
+                    read_cache(set, block_addr, way, line_hit);
+                }
+            }
+            Port_Status.write(hit ? RET_CACHE_HIT : RET_CACHE_MISS);
+
             if (f == FUNC_READ) {
                 Port_Data.write(0); // Data is never stored in the simulated cache, so we can just send 0 
                 Port_Done.write(RET_READ_DONE);
@@ -189,9 +184,19 @@ SC_MODULE(CPU) {
     sc_in<Cache::RetStatusCode> Port_cacheStatus;
     sc_out<Cache::Function> Port_cacheFunc;
     sc_out<uint64_t> Port_cacheAddr;
+    sc_out<uint32_t> Port_cacheSize;
     sc_inout_rv<64> Port_cacheData;
 
-    SC_CTOR(CPU) {
+    // Ports to the instruction cache, which never returns data to the CPU
+    sc_in<Cache::RetCode> Port_icacheDone;
+    sc_in<Cache::RetStatusCode> Port_icacheStatus;
+    sc_out<Cache::Function> Port_icacheFunc;
+    sc_out<uint64_t> Port_icacheAddr;
+    sc_out<uint32_t> Port_icacheSize;
+
+    sc_time period; // Of the clock, turns idle cycles into time
+
+    SC_CTOR(CPU) : period(1, SC_NS) {
         SC_THREAD(execute);
         sensitive << Port_CLK.pos();
         dont_initialize();
@@ -200,13 +205,15 @@ SC_MODULE(CPU) {
     private:
     void execute() {
         TraceFile::Entry tr_data;
+        TraceBuffer trace(tracefile_ptr, 0); // Decodes this CPU's trace in batches
         Cache::Function f;
+        sc_time due = SC_ZERO_TIME; // Issue time of the next entry with --trace-timed
 
 
         // Loop until end of tracefile
         while (!tracefile_ptr->eof()) {
             // Get the next action for the processor in the trace
-            if (!tracefile_ptr->next(0, tr_data)) {
+            if (!trace.next(tr_data)) {
                 cerr << "Error reading trace for CPU" << endl;
                 break;
             }
@@ -216,16 +223,46 @@ SC_MODULE(CPU) {
                     f = Cache::FUNC_READ; 
                     break;
                 case TraceFile::ENTRY_TYPE_WRITE:
+                case TraceFile::ENTRY_TYPE_RMW: // A single CPU needs no atomicity
                     f = Cache::FUNC_WRITE;
                     break;
+                case TraceFile::ENTRY_TYPE_IFETCH:
+                    f = Cache::FUNC_READ; // Instruction fetches read from the I-cache
+                    break;
                 case TraceFile::ENTRY_TYPE_NOP: 
+                case TraceFile::ENTRY_TYPE_FENCE: // Accesses complete in order
                     break;
                 default: cerr << "Error, got invalid data from Trace" << endl; exit(0);
             }
-            
 
-            if (tr_data.type != TraceFile::ENTRY_TYPE_NOP) {
+            // With --trace-timed NOPs add their idle cycles to the time since
+            // the last issue, and the CPU waits until the next entry is due
+            if (trace_timed) {
+                bool nop = tr_data.type == TraceFile::ENTRY_TYPE_NOP;
+                if (nop) {
+                    due += period * (double)tr_data.cycles();
+                }
+                while (sc_time_stamp() < due) {
+                    wait();
+                }
+                if (nop) {
+                    continue;
+                }
+                due = sc_time_stamp();
+            }
+
+            bool fetch = tr_data.type == TraceFile::ENTRY_TYPE_IFETCH;
+            if (fetch) {
+                Port_icacheAddr.write(tr_data.addr);
+                Port_icacheSize.write(tr_data.size);
+                Port_icacheFunc.write(f);
+                VERBOSE && cout << sc_time_stamp() << ": CPU fetches " << tr_data.addr << endl;
+
+                wait(Port_icacheDone.value_changed_event());
+            } else if (tr_data.type != TraceFile::ENTRY_TYPE_NOP &&
+                       tr_data.type != TraceFile::ENTRY_TYPE_FENCE) {
                 Port_cacheAddr.write(tr_data.addr);
+                Port_cacheSize.write(tr_data.size);
                 Port_cacheFunc.write(f);
 
                 if (f == Cache::FUNC_WRITE) {
@@ -251,7 +288,7 @@ SC_MODULE(CPU) {
             }
 
             // Log cache hit 
-            int j = Port_cacheStatus.read();
+            int j = fetch ? Port_icacheStatus.read() : Port_cacheStatus.read();
 
             switch (tr_data.type) {
                 case TraceFile::ENTRY_TYPE_READ:
@@ -261,11 +298,18 @@ SC_MODULE(CPU) {
                         stats_readmiss(0);
                     break;
                 case TraceFile::ENTRY_TYPE_WRITE:
+                case TraceFile::ENTRY_TYPE_RMW:
                     if (j)
                         stats_writehit(0);
                     else
                         stats_writemiss(0);
                     break;
+                case TraceFile::ENTRY_TYPE_IFETCH:
+                    if (j)
+                        stats_ifetchhit(0);
+                    else
+                        stats_ifetchmiss(0);
+                    break;
                 default: break;
             }
 
@@ -283,50 +327,82 @@ int sc_main(int argc, char *argv[]) {
     try {
         // Get the tracefile argument and create Tracefile object
         // This function sets tracefile_ptr and num_cpus
-
-
-        if (argc == 3) {   
-            VERBOSE = std::stoi(argv[2]) != 0;
-        } else if (argc != 2) {
-            throw std::invalid_argument("Usage: ./assignment_1.bin [trace_file] [verbose (0 or 1)] or \n ./assignment_1.bin [trace_file]");
-        }
-
-    
+        // The cache options go first, so none of them is taken for the
+        // tracefile
+        init_cache_config(&argc, &argv);
         init_tracefile(&argc, &argv);
 
+        if (argc == 2) {
+            VERBOSE = std::stoi(argv[1]) != 0;
+        } else if (argc != 1) {
+            throw std::invalid_argument("Usage: ./assignment_1.bin [cache options] [trace_file] [verbose (0 or 1)] or \n ./assignment_1.bin [cache options] [trace_file]\n"
+                                        "The cache options are listed in lib/cache_config.h");
+        }
+        print_cache_config(cout);
 
         // Initialize statistics counters
         stats_init();
 
-        // Instantiate Modules
-        Cache cache("cache");
+        // Instantiate Modules, the CPU has separate instruction and data caches
+        Cache cache("cache", cache_config.dcache, cache_config.dcache_policy);
+        Cache icache("icache", cache_config.icache, cache_config.icache_policy);
         CPU cpu("cpu");
 
+        // Both caches share the path to main memory
+        sc_mutex memory_port("memory_port");
+        cache.memory_port = &memory_port;
+        icache.memory_port = &memory_port;
+
         // Signals
         sc_buffer<Cache::Function> sigcacheFunc;
         sc_buffer<Cache::RetCode> sigcacheDone;
         sc_buffer<Cache::RetStatusCode> sigcacheStatus;
         sc_signal<uint64_t> sigcacheAddr;
+        sc_signal<uint32_t> sigcacheSize;
         sc_signal_rv<64> sigcacheData;
 
+        sc_buffer<Cache::Function> sigicacheFunc;
+        sc_buffer<Cache::RetCode> sigicacheDone;
+        sc_buffer<Cache::RetStatusCode> sigicacheStatus;
+        sc_signal<uint64_t> sigicacheAddr;
+        sc_signal<uint32_t> sigicacheSize;
+        sc_signal_rv<64> sigicacheData;
+
         // The clock that will drive the CPU and cacheory
         sc_clock clk;
 
         // Connecting module ports with signals
         cache.Port_Func(sigcacheFunc);
         cache.Port_Addr(sigcacheAddr);
+        cache.Port_Size(sigcacheSize);
         cache.Port_Data(sigcacheData);
         cache.Port_Done(sigcacheDone);
         cache.Port_Status(sigcacheStatus);
 
         cpu.Port_cacheFunc(sigcacheFunc);
         cpu.Port_cacheAddr(sigcacheAddr);
+        cpu.Port_cacheSize(sigcacheSize);
         cpu.Port_cacheData(sigcacheData);
         cpu.Port_cacheDone(sigcacheDone);
         cpu.Port_cacheStatus(sigcacheStatus);
 
+        icache.Port_Func(sigicacheFunc);
+        icache.Port_Addr(sigicacheAddr);
+        icache.Port_Size(sigicacheSize);
+        icache.Port_Data(sigicacheData);
+        icache.Port_Done(sigicacheDone);
+        icache.Port_Status(sigicacheStatus);
+
+        cpu.Port_icacheFunc(sigicacheFunc);
+        cpu.Port_icacheAddr(sigicacheAddr);
+        cpu.Port_icacheSize(sigicacheSize);
+        cpu.Port_icacheDone(sigicacheDone);
+        cpu.Port_icacheStatus(sigicacheStatus);
+
         cache.Port_CLK(clk);
+        icache.Port_CLK(clk);
         cpu.Port_CLK(clk);
+        cpu.period = clk.period();
 
         cout << "Running (press CTRL+C to interrupt)... " << endl;
 
@@ -27,6 +27,9 @@ class Memory : public bus_slave_if, public sc_module {
     int totalwritereq = 0;
     int totalreadreq = 0;
     int totalinv = 0;
+
+    // Contention of atomic read-modify-writes, by line address
+    map<uint64_t, LineContention> contention;
     
     sc_in<bool> Port_CLK;
     // Connections to caches
@@ -100,6 +103,19 @@ class Memory : public bus_slave_if, public sc_module {
         request_queue.push((request) {.addr = addr, .func = FUNC_WRITE, .trans_id = trans_id, .cache_id = cache_id});
     } 
 
+    // Records an atomic read-modify-write of cache cache_id to the line at
+    // line_addr that waited for the bus for wait. The RMW is contended if
+    // the last RMW to the line came from another cache, so the line moved
+    // between the caches. Misses of the same cache, e.g. after the line was
+    // evicted, do not count.
+    void record_rmw(uint64_t line_addr, uint64_t cache_id, sc_time wait) {
+        LineContention &c = contention[line_addr];
+        c.contended += (c.rmws > 0 && c.owner != cache_id) ? 1 : 0;
+        c.owner = cache_id;
+        c.rmws++;
+        c.wait += wait;
+    }
+
     void stats_print() {
         cout << "Memory reads: " << totalreadreq << endl;
         cout << "Memory writes: " << totalwritereq << endl;
@@ -107,6 +123,7 @@ class Memory : public bus_slave_if, public sc_module {
         cout << "Total aquisitions: " << totalacq << endl;
         cout << "Total aquisition wait time: " << totalacqtime << endl;
         cout << "Average aquisition wait time: " << (totalacqtime / totalacq) << endl;
+        print_contention(contention, 10);
     }
 };
 #endif
@@ -8,24 +8,18 @@
  #define SC_ALLOW_DEPRECATED_IEEE_API
  
  #include "psa.h"
+ #include "cache_config.h"
+ #include "cache_kernel.h"
  #include "Memory.h"
  #include "helpers.h"
  
  using namespace std;
  using namespace sc_core; // This pollutes namespace, better: only import what you need.
 
-
-struct CacheLine {
-    uint64_t tag; // Stores the block adress
-    double lu_time; // least recently used time for cache eviction 
-    bool valid;
-    bool dirty; 
-};
-
-static const size_t CACHE_SIZE = 32768; // Byte 
-static const size_t SET_ASSOC = 8;
-static const size_t LINE_SIZE = 32; // Byte 
-static const size_t N_SETS = (CACHE_SIZE / LINE_SIZE) / SET_ASSOC; 
+// The geometry of the data cache and of the instruction cache, which shares
+// the bus with the data cache, is set at startup, see cache_config.h
+static const CacheGeometry &DCACHE = cache_config.dcache;
+static const CacheGeometry &ICACHE = cache_config.icache;
 
 static int bus_lock = 0; // A lock that gives exclusive access to the bus 
 static uint64_t trans_id = 1; // Unique ID for each bus request 
@@ -45,6 +39,7 @@ SC_MODULE(Cache) {
     //Ports to the CPU  
     sc_in<Function> Port_Func;
     sc_in<uint64_t> Port_Addr;
+    sc_in<uint32_t> Port_Size; // Bytes accessed from Port_Addr on
     sc_out<RetCode> Port_Done;
     sc_inout_rv<64> Port_Data;
 
@@ -59,76 +54,57 @@ SC_MODULE(Cache) {
         sensitive << Port_CLK.pos();
         dont_initialize();
 
-        line_table = (CacheLine **)malloc(sizeof(CacheLine *) * N_SETS); // Initialite the cache line 
-        for (size_t i = 0; i < N_SETS; i++) {
-            line_table[i] = (CacheLine *)malloc(sizeof(CacheLine) * SET_ASSOC);
-
-            for(size_t j = 0; j < SET_ASSOC; j++) {
-                line_table[i][j] = (CacheLine) {.tag = 0, .lu_time = 0.0, .valid = false, .dirty = false};
-            }
-        }
+        lines.init(DCACHE, cache_config.dcache_policy);
+        i_lines.init(ICACHE, cache_config.icache_policy);
+        lines.print_memory(cout, string(this->name()) + " D-cache");
+        i_lines.print_memory(cout, string(this->name()) + " I-cache");
 
         VERBOSE && cout << "---------- Cache Specs --------" << endl;
-        VERBOSE && cout << "Cache size: " << CACHE_SIZE << " B" << endl;
-        VERBOSE && cout << "Line size: " << LINE_SIZE << " B" << endl;
-        VERBOSE && cout << "Set associativity: " << SET_ASSOC << endl;
-        VERBOSE && cout << "Number of Sets: " << N_SETS << endl;
+        VERBOSE && cout << "Cache size: " << DCACHE.size << " B" << endl;
+        VERBOSE && cout << "Line size: " << DCACHE.line_size << " B" << endl;
+        VERBOSE && cout << "Set associativity: " << DCACHE.set_assoc << endl;
+        VERBOSE && cout << "Number of Sets: " << DCACHE.n_sets << endl;
+        VERBOSE && cout << "I-cache size: " << ICACHE.size << " B, line size: " << ICACHE.line_size
+                        << " B, set associativity: " << ICACHE.set_assoc << endl;
+        VERBOSE && cout << "Replacement policy: " << lines.get_policy_name() << ", I-cache: "
+                        << i_lines.get_policy_name() << endl;
         VERBOSE && cout << "-------------------------------" << endl;
     } 
 
     void dump() {
-        for (size_t i = 0; i < N_SETS; i++) {
+        for (size_t i = 0; i < DCACHE.n_sets; i++) {
             cout << "Cache set: " << i << endl;    
-            for(size_t j = 0; j < SET_ASSOC; j++) {
-                cout << "   Cache Line: " << j << " {tag=" << line_table[i][j].tag << ", lu_time=" << line_table[i][j].lu_time << ", valid=" << line_table[i][j].valid << ", dirty=" << line_table[i][j].dirty << "}" << endl;    
+            for(size_t j = 0; j < DCACHE.set_assoc; j++) {
+                cout << "   Cache Line: " << j << " {tag=" << lines.get_tag(i, j) << ", valid=" << lines.is_valid(i, j) << ", dirty=" << lines.is_dirty(i, j) << "}" << endl;    
             }
         }
     }
 
     private:
-    CacheLine **line_table; // Array of Sets with size SET_ASSOC (e.g. 8 for an 8-way set-associative cache)
+    CacheArray lines; // Tags, valid and dirty bits and the replacement state of the data cache, see cache_kernel.h
+    CacheArray i_lines; // Instruction cache
     uint64_t prev_trans_id = 0;
 
-    // Returns the index in a cache set into which a new address should be inserted to and informs the cpu about a hit/miss
-    uint64_t probe_cache(CacheLine *c_set, uint64_t block_addr) {
-        double min_lu_time = UINT64_MAX;
-        double min_lu_index = 0;
-        int i = 0;
-
-        while (i < SET_ASSOC) {
-            if(!c_set[i].valid) { // Find an empty cache line for insertion
-               min_lu_index = i;
-               min_lu_time = 0;
-            }
-            else if(c_set[i].tag == block_addr) { // If a cache hit is found return immidiately  
-                return i;
-            }
-
-            else if (c_set[i].lu_time < min_lu_time) { // Find a cache line to evict for insertion
-                min_lu_index = i;
-                min_lu_time = c_set[i].lu_time;
-            }
-
-            i++;
-        }
-
-        // Cache miss 
-        return min_lu_index;
+    // Returns the way of a set of the data cache, or of the instruction cache if icache is set, into which a new address should be inserted to
+    uint64_t probe_cache(uint64_t set, uint64_t block_addr, bool icache = false) {
+        bool hit;
+        return (icache ? i_lines : lines).probe(set, block_addr, hit);
     }
 
-    // Refreshes the last recently used time
-    void refresh_lu_time(CacheLine *c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
-        c_set[index].lu_time = sc_time_stamp().to_double(); // Refresh last used time
-        VERBOSE ? log(name(), "refresh last used time of addr", addr) : (void)0;
+    // Tells the replacement policy about a hit
+    void refresh_line(uint64_t set, uint64_t addr, uint64_t way, bool icache = false) {
+        (icache ? i_lines : lines).refresh(set, way);
+        VERBOSE ? log(name(), "refresh the replacement state of addr", addr) : (void)0;
     }
 
 
-    // Inserts a CacheLine into a set and evicts a colliding cache line if necessary
-    void allocate(CacheLine *c_set, uint64_t block_addr, uint64_t addr, uint64_t index, bool is_write) {
-        if(c_set[index].tag != block_addr && c_set[index].valid) { // evict element
-            VERBOSE ? log(name(), "evict block_addr: ", c_set[index].tag) : (void)0;
+    // Inserts a line into a set and evicts a colliding cache line if necessary
+    void allocate(uint64_t set, uint64_t block_addr, uint64_t way, bool is_write, bool icache = false) {
+        CacheArray &c = icache ? i_lines : lines;
+        if(c.is_valid(set, way)) { // evict element
+            VERBOSE ? log(name(), "evict block_addr: ", c.get_tag(set, way)) : (void)0;
         }
-        c_set[index] = (CacheLine) {.tag = block_addr, .lu_time = sc_time_stamp().to_double(), .valid = true, .dirty = is_write};
+        c.fill(set, way, block_addr, is_write);
     }
 
     // Invalidate an address after snooping 
@@ -138,18 +114,17 @@ SC_MODULE(Cache) {
         
         VERBOSE ? log(name(), "Snooped bus addr", addr_bus) : (void)0;
 
-        uint64_t block_addr = addr_bus / LINE_SIZE;
+        uint64_t block_addr = DCACHE.block_addr(addr_bus);
 
         // Determine cache set for block_addr
-        size_t set_index = block_addr % N_SETS;
-        CacheLine *c_set = line_table[set_index];
+        uint64_t set = DCACHE.set_index(block_addr);
 
-        // Find the index in the c_set at which cache line should be manipulated (in case of a hit) / inserted (in case of a miss)
-        uint64_t index = probe_cache(c_set, block_addr); 
+        // Find the way of the set at which cache line should be manipulated (in case of a hit) / inserted (in case of a miss)
+        uint64_t way = probe_cache(set, block_addr); 
 
         //Invalidate block if it is present in cache 
-        if(c_set[index].tag == block_addr && c_set[index].valid && func_bus == FUNC_WRITE) {
-            c_set[index].valid = false;
+        if(lines.holds(set, way, block_addr) && func_bus == FUNC_WRITE) {
+            lines.invalidate(set, way);
             VERBOSE ? log(name(), "Invalidated addr", addr_bus) : (void)0;
             memory->totalinv += 1;
         }
@@ -192,34 +167,43 @@ SC_MODULE(Cache) {
         }
     }
 
-    void write_cache(CacheLine *c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
+    // Returns true on a cache hit. Stores how long the cache waited for the
+    // bus in waited, if given. An rmw takes a cycle more for the modify.
+    bool write_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way,
+                     sc_time *waited = NULL, bool rmw = false) {
+        sc_time start = sc_time_stamp();
         while (bus_lock != my_id) {
             wait_and_invalidate();
         }
+        if (waited != NULL) {
+            *waited = sc_time_stamp() - start;
+        }
         memory->totalacqtime += sc_time(num_requests_before_me, SC_NS); 
         memory->totalacq += 1;
 
         VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
-        if (c_set[index].tag == block_addr && c_set[index].valid) { // Cache hit 
+        bool hit = lines.holds(set, way, block_addr);
+        if (hit) { // Cache hit 
             VERBOSE ? log(name(), "Cache write hit") : (void)0;
-            stats_writehit(my_id);
-            wait(1); // a local cache access takes 1 cycle 
-            refresh_lu_time(c_set, block_addr, addr, index);
+            wait(cache_config.hit_latency); // a local cache access takes the hit latency
+            refresh_line(set, addr, way);
         } else {
             wait(1); // It takes 1 cycle to write on the bus 
             VERBOSE ? log(name(), "Cache miss, request read from bus for addr", addr) : (void)0;
-            stats_writemiss(my_id);
             mem_read(addr);
             wait(Port_BusTransId.value_changed_event());
-            wait(100); // It takes 100 for a bus reqeust to be served
+            wait(cache_config.mem_latency); // The memory latency for a bus request to be served
             VERBOSE ? log(name(), "reads on bus addr", addr) : (void)0;
-            allocate(c_set, block_addr, addr, index, true);
+            allocate(set, block_addr, way, true);
+        }
+        if (rmw) {
+            wait(1); // The modify step, with the bus still held
         }
         
         wait(1); // It takes 1 cycle to write on the bus 
         VERBOSE ? log(name(), "finished write to cache", addr) : (void)0;
         VERBOSE ? log(name(), "request bus to write back to memory", addr) : (void)0;
-        wait(100); // It takes 100 for a bus reqeust to be served
+        wait(cache_config.mem_latency); // The memory latency for a bus request to be served
         mem_write(addr);
         wait(Port_BusTransId.value_changed_event());
         VERBOSE ? log(name(), "finished write back to memory of addr", addr) : (void)0;
@@ -231,31 +215,83 @@ SC_MODULE(Cache) {
         while(bus_lock != 0) {
             wait_and_invalidate();
         }
+        return hit;
     }
 
-    void read_cache(CacheLine *c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
+    // Returns true on a cache hit
+    bool read_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way) {
         num_requests_before_me = 0;
         while (bus_lock != my_id) {
             wait_and_invalidate();
         }
 
         VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
-        if (c_set[index].tag == block_addr && c_set[index].valid) { // Cache hit 
+        bool hit = lines.holds(set, way, block_addr);
+        if (hit) { // Cache hit 
             VERBOSE ? log(name(), "Cache read hit") : (void)0;
-            stats_readhit(my_id);
-            wait(1); // A local cache access takes 1 cycle 
-            refresh_lu_time(c_set, block_addr, addr, index);
+            wait(cache_config.hit_latency); // A local cache access takes the hit latency
+            refresh_line(set, addr, way);
         } else { // Load block_addr from main memory and evict if necessary 
             wait(1); // It takes 1 cycle to write on the bus
             VERBOSE ? log(name(), "Cache miss, request read from bus for addr", addr) : (void)0;
-            stats_readmiss(my_id);
             memory->totalacq += 1;
             memory->totalacqtime += sc_time(num_requests_before_me, SC_NS);
             mem_read(addr);
             wait(Port_BusTransId.value_changed_event());
-            wait(100); // It takes 100 for a bus reqeust to be served
+            wait(cache_config.mem_latency); // The memory latency for a bus request to be served
             VERBOSE ? log(name(), "reads on bus addr", addr) : (void)0;
-            allocate(c_set, block_addr, addr, index, false);
+            allocate(set, block_addr, way, false);
+        }
+
+        bus_lock = (bus_lock + 1) % num_cpus; // Release the lock 
+
+        while(bus_lock != 0) {
+            wait_and_invalidate();
+        }
+        return hit;
+    }
+
+    // Atomic read-modify-write, returns true on a cache hit. A write already
+    // keeps the bus from the read of the line until its write is on the bus,
+    // and the write invalidates the copies of all other caches, so the RMW
+    // is a write that takes one more cycle for the modify. Every RMW is
+    // recorded in the contention statistics of the bus.
+    bool rmw_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way) {
+        VERBOSE ? log(name(), "Atomic read-modify-write of addr", addr) : (void)0;
+        sc_time waited;
+        bool hit = write_cache(set, block_addr, addr, way, &waited, true);
+        memory->record_rmw(block_addr * DCACHE.line_size, my_id, waited);
+        return hit;
+    }
+
+    // Fetches an instruction through the instruction cache, returns true on a
+    // cache hit. Instructions are never written, so snooped writes leave the
+    // instruction cache alone.
+    bool fetch_cache(uint64_t addr) {
+        uint64_t block_addr = ICACHE.block_addr(addr);
+        uint64_t set = ICACHE.set_index(block_addr);
+        uint64_t way = probe_cache(set, block_addr, true);
+
+        num_requests_before_me = 0;
+        while (bus_lock != my_id) {
+            wait_and_invalidate();
+        }
+
+        VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
+        bool hit = i_lines.holds(set, way, block_addr);
+        if (hit) {
+            VERBOSE ? log(name(), "I-cache hit") : (void)0;
+            wait(cache_config.hit_latency); // A local cache access takes the hit latency
+            refresh_line(set, addr, way, true);
+        } else {
+            wait(1); // It takes 1 cycle to write on the bus
+            VERBOSE ? log(name(), "I-cache miss, request read from bus for addr", addr) : (void)0;
+            memory->totalacq += 1;
+            memory->totalacqtime += sc_time(num_requests_before_me, SC_NS);
+            mem_read(addr);
+            wait(Port_BusTransId.value_changed_event());
+            wait(cache_config.mem_latency); // The memory latency for a bus request to be served
+            allocate(set, block_addr, way, false, true);
         }
 
         bus_lock = (bus_lock + 1) % num_cpus; // Release the lock 
@@ -263,6 +299,7 @@ SC_MODULE(Cache) {
         while(bus_lock != 0) {
             wait_and_invalidate();
         }
+        return hit;
     }
 
     void execute() {
@@ -273,22 +310,53 @@ SC_MODULE(Cache) {
             // Receive function from CPU
             Function f = Port_Func.read();
             uint64_t addr = Port_Addr.read();
-            uint64_t block_addr = addr / LINE_SIZE;
+            uint32_t size = max(Port_Size.read(), 1u);
             uint64_t data = 0;
-
-            // Determine cache set for block_addr
-            size_t set_index = block_addr % N_SETS;
-            CacheLine *c_set = line_table[set_index];
-
-            // Find the index in the c_set at which cache line should be manipulated (in case of a hit) / inserted (in case of a miss)
-            uint64_t index = probe_cache(c_set, block_addr); 
-            if (f == FUNC_WRITE) {
+            if (f == FUNC_WRITE || f == FUNC_RMW) {
                 data = Port_Data.read().to_uint64();
-                write_cache(c_set, block_addr, addr, index);
-            } else if (f == FUNC_READ) {
-                read_cache(c_set, block_addr, addr, index);
-            } else {
+            }
+
+            if (f == FUNC_NOP || f == FUNC_FENCE) {
+                // Accesses complete in order before the next one is issued,
+                // so a fence has nothing to wait for
                 nop_cache();
+            } else if (f == FUNC_IFETCH) {
+                // An instruction that crosses a line boundary is fetched line
+                // by line like the data accesses below
+                bool hit = true;
+                uint64_t last_block_addr = ICACHE.block_addr(addr + size - 1);
+                for (uint64_t block_addr = ICACHE.block_addr(addr); block_addr <= last_block_addr; block_addr++) {
+                    hit = fetch_cache(max(addr, block_addr * ICACHE.line_size)) && hit;
+                }
+                hit ? stats_ifetchhit(my_id) : stats_ifetchmiss(my_id);
+            } else {
+                // An access that crosses a line boundary looks up every line
+                // it covers, each in its own bus turn. It counts as a single
+                // access, a hit only if all lines hit.
+                bool hit = true;
+                uint64_t last_block_addr = DCACHE.block_addr(addr + size - 1);
+                for (uint64_t block_addr = DCACHE.block_addr(addr); block_addr <= last_block_addr; block_addr++) {
+                    // Determine cache set for block_addr
+                    uint64_t set = DCACHE.set_index(block_addr);
+                    uint64_t line_addr = max(addr, block_addr * DCACHE.line_size);
+
+                    // Find the way of the set at which cache line should be manipulated (in case of a hit) / inserted (in case of a miss)
+                    uint64_t way = probe_cache(set, block_addr); 
+                    if (f == FUNC_WRITE) {
+                        hit = write_cache(set, block_addr, line_addr, way) && hit;
+                    } else if (f == FUNC_RMW) {
+                        hit = rmw_cache(set, block_addr, line_addr, way) && hit;
+                    } else {
+                        hit = read_cache(set, block_addr, line_addr, way) && hit;
+                    }
+                }
+
+                // An RMW counts as a write
+                if (f == FUNC_WRITE || f == FUNC_RMW) {
+                    hit ? stats_writehit(my_id) : stats_writemiss(my_id);
+                } else {
+                    hit ? stats_readhit(my_id) : stats_readmiss(my_id);
+                }
             }
 
             if (f == FUNC_READ) {
@@ -313,11 +381,13 @@ SC_MODULE(CPU) {
     sc_in<Cache::RetCode> Port_cacheDone;
     sc_out<Function> Port_cacheFunc;
     sc_out<uint64_t> Port_cacheAddr;
+    sc_out<uint32_t> Port_cacheSize;
     sc_inout_rv<64> Port_cacheData;
 
     int my_id;
+    sc_time period; // Of the clock, turns idle cycles into time
 
-    SC_CTOR(CPU) {
+    SC_CTOR(CPU) : period(1, SC_NS) {
         SC_THREAD(execute);
         sensitive << Port_CLK.pos();
         dont_initialize();
@@ -326,13 +396,16 @@ SC_MODULE(CPU) {
     private:
     void execute() {
         TraceFile::Entry tr_data;
+        TraceBuffer trace(tracefile_ptr, my_id); // Decodes this CPU's trace in batches
         Function f;
+        sc_time due = SC_ZERO_TIME; // Issue time of the next entry with --trace-timed
+        const TraceFile::Entry idle = {TraceFile::ENTRY_TYPE_NOP, 0, 1};
 
         // Loop until end of tracefile
         while (!tracefile_ptr->eof()) {
 
             // Get the next action for the processor in the trace
-            if (!tracefile_ptr->next(my_id, tr_data)) {
+            if (!trace.next(tr_data)) {
                 cerr << "Error reading trace for CPU" << endl;
                 break;
             }
@@ -348,49 +421,89 @@ SC_MODULE(CPU) {
                 case TraceFile::ENTRY_TYPE_WRITE:
                     f = FUNC_WRITE;
                     break;
+                case TraceFile::ENTRY_TYPE_IFETCH:
+                    f = FUNC_IFETCH;
+                    break;
+                case TraceFile::ENTRY_TYPE_RMW:
+                    f = FUNC_RMW;
+                    break;
+                case TraceFile::ENTRY_TYPE_FENCE:
+                    f = FUNC_FENCE;
+                    break;
                 case TraceFile::ENTRY_TYPE_NOP:
                     f = FUNC_NOP;
                     break;
                 default: cerr << "Error, got invalid data from Trace" << endl; exit(0);
             }
 
-            Port_cacheAddr.write(tr_data.addr);
-            Port_cacheFunc.write(f);
-
-            if (f == FUNC_WRITE) {
-                VERBOSE ? log(name(), "(*) sends write for addr", tr_data.addr) : (void)0;
-                // Don't have data, we write the address as the data value.
-                Port_cacheData.write(tr_data.addr);
-                wait();
-                // Now float the data wires with 64 "Z"'s
-                Port_cacheData.write(float_64_bit_wire);
-
-            } else if (f == FUNC_READ) {
-                VERBOSE ? log(name(), "(*) sends read for addr", tr_data.addr) : (void)0;
-            } else {
-                VERBOSE ? log(name(), "(*) CPU executes NOP") : (void)0;
-                Port_cacheFunc.write(f);
+            // With --trace-timed NOPs add their idle cycles to the time since
+            // the last issue. Until the next entry is due the CPU passes its
+            // turns on the bus with NOPs, the other caches wait for them.
+            if (trace_timed) {
+                if (f == FUNC_NOP) {
+                    due += period * (double)tr_data.cycles();
+                }
+                while (sc_time_stamp() < due) {
+                    issue(FUNC_NOP, idle);
+                }
+                if (f == FUNC_NOP) {
+                    continue;
+                }
+                due = sc_time_stamp();
             }
-            wait(Port_cacheDone.value_changed_event());
 
-            wait();
+            issue(f, tr_data);
         }
         
         // Finished the Tracefile, now stop the simulation
         sc_stop();
     }
+
+    // Sends entry e to the cache as function f and waits until it is done
+    void issue(Function f, const TraceFile::Entry &e) {
+        Port_cacheAddr.write(e.addr);
+        Port_cacheSize.write(e.type == TraceFile::ENTRY_TYPE_NOP ? 1 : e.size);
+        Port_cacheFunc.write(f);
+
+        if (f == FUNC_WRITE || f == FUNC_RMW) {
+            VERBOSE ? log(name(), f == FUNC_RMW ? "(*) sends rmw for addr" : "(*) sends write for addr", e.addr) : (void)0;
+            // Don't have data, we write the address as the data value.
+            Port_cacheData.write(e.addr);
+            wait();
+            // Now float the data wires with 64 "Z"'s
+            Port_cacheData.write(float_64_bit_wire);
+
+        } else if (f == FUNC_READ) {
+            VERBOSE ? log(name(), "(*) sends read for addr", e.addr) : (void)0;
+        } else if (f == FUNC_IFETCH) {
+            VERBOSE ? log(name(), "(*) sends fetch for addr", e.addr) : (void)0;
+        } else {
+            VERBOSE ? log(name(), "(*) CPU executes NOP") : (void)0;
+            Port_cacheFunc.write(f);
+        }
+        wait(Port_cacheDone.value_changed_event());
+
+        wait();
+    }
 };
 
 int sc_main(int argc, char *argv[]) {
     try {
-        if (argc == 3) {   
-            VERBOSE = std::stoi(argv[2]) != 0;
-        } else if (argc != 2) {
-            throw std::invalid_argument("Usage: ./assignment_1.bin [trace_file] [verbose (0 or 1)] or \n ./assignment_1.bin [trace_file]");
-        }
-    
+        // Get the tracefile argument and create Tracefile object
+        // This function sets tracefile_ptr and num_cpus
+        // The cache options go first, so none of them is taken for the
+        // tracefile
+        init_cache_config(&argc, &argv);
         init_tracefile(&argc, &argv);
 
+        if (argc == 2) {
+            VERBOSE = std::stoi(argv[1]) != 0;
+        } else if (argc != 1) {
+            throw std::invalid_argument("Usage: ./assignment_2.bin [cache options] [trace_file] [verbose (0 or 1)] or \n ./assignment_2.bin [cache options] [trace_file]\n"
+                                        "The cache options are listed in lib/cache_config.h");
+        }
+        print_cache_config(cout);
+
         NUM_CPUS = tracefile_ptr->get_proc_count();
         cout << "Executing with " << NUM_CPUS << " CPUS" << endl;
 
@@ -403,6 +516,7 @@ int sc_main(int argc, char *argv[]) {
         std::vector<sc_buffer<Function>*> sigcacheFunc(NUM_CPUS);
         std::vector<sc_buffer<Cache::RetCode>*> sigcacheDone(NUM_CPUS);
         std::vector<sc_signal<uint64_t>*> sigcacheAddr(NUM_CPUS);
+        std::vector<sc_signal<uint32_t>*> sigcacheSize(NUM_CPUS);
         std::vector<sc_signal_rv<64>*> sigcacheData(NUM_CPUS);
 
         // Declare vectors to store pointers to caches and CPUs
@@ -434,12 +548,14 @@ int sc_main(int argc, char *argv[]) {
             cpus[i] = new CPU(cpu_name.c_str());
 
             cpus[i]->my_id = i;
+            cpus[i]->period = clk.period();
             caches[i]->my_id = i;
 
             // Allocate signals
             sigcacheFunc[i] = new sc_buffer<Function>();
             sigcacheDone[i] = new sc_buffer<Cache::RetCode>();
             sigcacheAddr[i] = new sc_signal<uint64_t>();
+            sigcacheSize[i] = new sc_signal<uint32_t>();
             sigcacheData[i] = new sc_signal_rv<64>();
             sigbusFunc[i] = new sc_buffer<Function>();
             sigbusAddr[i] = new sc_signal<uint64_t>();
@@ -449,6 +565,7 @@ int sc_main(int argc, char *argv[]) {
             // Connecting ports of Cache and CPU with the corresponding signals
             caches[i]->Port_Func(*sigcacheFunc[i]);
             caches[i]->Port_Addr(*sigcacheAddr[i]);
+            caches[i]->Port_Size(*sigcacheSize[i]);
             caches[i]->Port_Data(*sigcacheData[i]);
             caches[i]->Port_Done(*sigcacheDone[i]);
 
@@ -464,6 +581,7 @@ int sc_main(int argc, char *argv[]) {
 
             cpus[i]->Port_cacheFunc(*sigcacheFunc[i]);
             cpus[i]->Port_cacheAddr(*sigcacheAddr[i]);
+            cpus[i]->Port_cacheSize(*sigcacheSize[i]);
             cpus[i]->Port_cacheData(*sigcacheData[i]);
             cpus[i]->Port_cacheDone(*sigcacheDone[i]);
 
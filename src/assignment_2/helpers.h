@@ -1,16 +1,21 @@
 #ifndef _HELPERS_H_
 #define _HELPERS_H_
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <systemc.h>
+#include <vector>
+
+#include "line_contention.h"
 
 const int t_width = 7;
 const int n_width = 7;
 
 using namespace std;
 
-enum Function {FUNC_READ, FUNC_WRITE, FUNC_NOP};
+enum Function {FUNC_READ, FUNC_WRITE, FUNC_NOP, FUNC_IFETCH, FUNC_RMW, FUNC_FENCE};
 
 static bool VERBOSE = true; // Toggle logging  
 
@@ -8,56 +8,44 @@ Cache::Cache(sc_module_name name) : sc_module(name) {
     sensitive << Port_CLK.pos();
     dont_initialize();
 
-    line_table = (CacheLine**)malloc(sizeof(CacheLine*) * N_SETS);
-    for (size_t i = 0; i < N_SETS; i++) {
-        line_table[i] = (CacheLine*)malloc(sizeof(CacheLine) * SET_ASSOC);
-        for (size_t j = 0; j < SET_ASSOC; j++) {
-            line_table[i][j] = {0, 0.0, false, false};
-        }
-    }
+    lines.init(DCACHE, cache_config.dcache_policy);
+    i_lines.init(ICACHE, cache_config.icache_policy);
+    lines.print_memory(cout, string(this->name()) + " D-cache");
+    i_lines.print_memory(cout, string(this->name()) + " I-cache");
 
     VERBOSE && cout << "---------- Cache Specs --------" << endl;
-    VERBOSE && cout << "Cache size: " << CACHE_SIZE << " B" << endl;
-    VERBOSE && cout << "Line size: " << LINE_SIZE << " B" << endl;
-    VERBOSE && cout << "Set associativity: " << SET_ASSOC << endl;
-    VERBOSE && cout << "Number of Sets: " << N_SETS << endl;
+    VERBOSE && cout << "Cache size: " << DCACHE.size << " B" << endl;
+    VERBOSE && cout << "Line size: " << DCACHE.line_size << " B" << endl;
+    VERBOSE && cout << "Set associativity: " << DCACHE.set_assoc << endl;
+    VERBOSE && cout << "Number of Sets: " << DCACHE.n_sets << endl;
+    VERBOSE && cout << "I-cache size: " << ICACHE.size << " B, line size: " << ICACHE.line_size
+                    << " B, set associativity: " << ICACHE.set_assoc << endl;
+    VERBOSE && cout << "Replacement policy: " << lines.get_policy_name() << ", I-cache: "
+                    << i_lines.get_policy_name() << endl;
     VERBOSE && cout << "-------------------------------" << endl;
 }
 
 void Cache::dump() {
-    for (size_t i = 0; i < N_SETS; i++) {
+    for (size_t i = 0; i < DCACHE.n_sets; i++) {
         cout << "Cache set: " << i << endl;
-        for (size_t j = 0; j < SET_ASSOC; j++) {
-            cout << "   Cache Line: " << j << " {tag=" << line_table[i][j].tag 
-                 << ", lu_time=" << line_table[i][j].lu_time 
-                 << ", valid=" << line_table[i][j].valid 
-                 << ", dirty=" << line_table[i][j].dirty << "}" << endl;
+        for (size_t j = 0; j < DCACHE.set_assoc; j++) {
+            cout << "   Cache Line: " << j << " {tag=" << lines.get_tag(i, j) 
+                 << ", valid=" << lines.is_valid(i, j) 
+                 << ", dirty=" << lines.is_dirty(i, j) << "}" << endl;
         }
     }
 }
 
-uint64_t Cache::probe_cache(CacheLine* c_set, uint64_t block_addr) {
-    double min_lu_time = UINT64_MAX;
-    uint64_t min_lu_index = 0;
-
-    for (size_t i = 0; i < SET_ASSOC; i++) {
-        if (!c_set[i].valid) { // Find an empty cache line
-            return i;
-        }
-        if (c_set[i].tag == block_addr) { // Cache hit
-            return i;
-        }
-        if (c_set[i].lu_time < min_lu_time) { // Find least recently used
-            min_lu_index = i;
-            min_lu_time = c_set[i].lu_time;
-        }
-    }
-    return min_lu_index; // Cache miss
+// Returns the way of the set that holds block_addr, or else the first empty
+// way, or else the line the replacement policy picks
+uint64_t Cache::probe_cache(uint64_t set, uint64_t block_addr, bool icache) {
+    bool hit;
+    return (icache ? i_lines : lines).probe(set, block_addr, hit);
 }
 
-bool Cache::is_cache_hit(CacheLine* c_set, uint64_t block_addr) {
-    uint64_t index = probe_cache(c_set, block_addr);
-    if((c_set[index].tag == block_addr && c_set[index].valid)) {
+bool Cache::is_cache_hit(uint64_t set, uint64_t block_addr) {
+    uint64_t way = probe_cache(set, block_addr);
+    if(lines.holds(set, way, block_addr)) {
         VERBOSE ? log(name(), "Cache hit") : (void)0;
         return true;
     } else {
@@ -67,36 +55,40 @@ bool Cache::is_cache_hit(CacheLine* c_set, uint64_t block_addr) {
 }
 
 
-void Cache::allocate(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index, bool is_write) {
-    if (c_set[index].tag != block_addr && c_set[index].valid) { // Evict element
-        VERBOSE ? log(name(), "evict block_addr: ", c_set[index].tag) : (void)0;
+void Cache::allocate(uint64_t set, uint64_t block_addr, uint64_t way, bool is_write, bool icache) {
+    CacheArray& c = icache ? i_lines : lines;
+    if (c.is_valid(set, way)) { // Evict element
+        VERBOSE ? log(name(), "evict block_addr: ", c.get_tag(set, way)) : (void)0;
     }
-    c_set[index] = {block_addr, sc_time_stamp().to_double(), true, is_write};
+    c.fill(set, way, block_addr, is_write);
 }
 
 
-void Cache::refresh_lu_time(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
-    c_set[index].lu_time = sc_time_stamp().to_double();
-    VERBOSE ? log(name(), "refresh last used time of addr", addr) : (void)0;
+void Cache::refresh_line(uint64_t set, uint64_t addr, uint64_t way, bool icache) {
+    (icache ? i_lines : lines).refresh(set, way);
+    VERBOSE ? log(name(), "refresh the replacement state of addr", addr) : (void)0;
 }
 
-void Cache::insert(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
-    c_set[index] = {block_addr, sc_time_stamp().to_double(), true, false};
+void Cache::insert(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way, bool icache) {
+    (icache ? i_lines : lines).fill(set, way, block_addr, false);
     VERBOSE ? log(name(), "inserted address", addr) : (void)0;
 }
 
 void Cache::invalidate(uint64_t addr) {
-    uint64_t block_addr = addr / LINE_SIZE;
-    size_t set_index = block_addr % N_SETS;
-    CacheLine* c_set = line_table[set_index];
-    uint64_t index = probe_cache(c_set, block_addr);
+    uint64_t block_addr = DCACHE.block_addr(addr);
+    uint64_t set = DCACHE.set_index(block_addr);
+    uint64_t way = probe_cache(set, block_addr);
 
-    c_set[index].valid = false;
+    // The line may be gone already, then the probe points at another line
+    if (!lines.holds(set, way, block_addr)) {
+        return;
+    }
+    lines.invalidate(set, way);
     VERBOSE ? log(name(), "invalidated address", addr) : (void)0;
 }
 
-void Cache::set_dirty(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
-    c_set[index].dirty = true;
+void Cache::set_dirty(uint64_t set, uint64_t addr, uint64_t way) {
+    lines.set_dirty(set, way);
     VERBOSE ? log(name(), "set dirty address", addr) : (void)0;
 }
 
@@ -127,23 +119,27 @@ void Cache::nop_cache() {
     }
 }
 
-void Cache::write_cache(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
+// Returns true on a cache hit
+bool Cache::write_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way) {
     while (bus_lock != my_id) {
         wait_and_invalidate();
     }
 
     VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
 
-    bool cache_hit = is_cache_hit(c_set, block_addr);
+    bool cache_hit = is_cache_hit(set, block_addr);
     cacheController->update(addr, my_id, FUNC_WRITE, cache_hit, trans_id_ctr);
 
     wait(Port_CCTransId.value_changed_event());
 
     if(!cache_hit) {
-        wait(100);
-        insert(c_set, block_addr, addr, index);
-    } 
-    set_dirty(c_set, block_addr, addr, index);
+        wait(cache_config.mem_latency);
+        insert(set, block_addr, addr, way);
+    } else {
+        wait(cache_config.hit_latency); // A local cache access takes the hit latency
+        refresh_line(set, addr, way);
+    }
+    set_dirty(set, addr, way);
 
     trans_id_ctr++;
     bus_lock = (bus_lock + 1) % num_cpus; //  Release the lock
@@ -153,9 +149,11 @@ void Cache::write_cache(CacheLine* c_set, uint64_t block_addr, uint64_t addr, ui
     while (bus_lock != 0) {
         wait_and_invalidate();
     }
+    return cache_hit;
 }
 
-void Cache::read_cache(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index) {
+// Returns true on a cache hit
+bool Cache::read_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way) {
     while (bus_lock != my_id) {
         wait_and_invalidate();
     }
@@ -163,26 +161,104 @@ void Cache::read_cache(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uin
 
     VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
 
-    bool cache_hit = is_cache_hit(c_set, block_addr);
+    bool cache_hit = is_cache_hit(set, block_addr);
     cacheController->update(addr, my_id, FUNC_READ, cache_hit, trans_id_ctr);
 
     wait(Port_CCTransId.value_changed_event());
 
     if(!cache_hit) {
-        wait(100);
-        insert(c_set, block_addr, addr, index);
+        wait(cache_config.mem_latency);
+        insert(set, block_addr, addr, way);
+    } else {
+        wait(cache_config.hit_latency); // A local cache access takes the hit latency
+        refresh_line(set, addr, way);
+    }
+
+    trans_id_ctr++;
+    bus_lock = (bus_lock + 1) % num_cpus; // Release the lock
+    num_requests_before_me = 0;
+
+
+    while (bus_lock != 0) {
+        wait_and_invalidate();
+    }
+    return cache_hit;
+}
+
+// Atomic read-modify-write, returns true on a cache hit. The controller gives
+// this cache the line exclusively and the cache holds the bus until the
+// modified line is written, so no other cache sees the line in between.
+bool Cache::rmw_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way) {
+    sc_time start = sc_time_stamp();
+    while ((uint64_t)bus_lock != my_id) {
+        wait_and_invalidate();
+    }
+    sc_time waited = sc_time_stamp() - start;
+
+    VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
+
+    bool cache_hit = is_cache_hit(set, block_addr);
+    cacheController->rmw(addr, block_addr * DCACHE.line_size, my_id, cache_hit, trans_id_ctr, waited);
+
+    wait(Port_CCTransId.value_changed_event());
+
+    if (!cache_hit) {
+        wait(cache_config.mem_latency);
+        insert(set, block_addr, addr, way);
     } else {
-        refresh_lu_time(c_set, block_addr, addr, index);
+        wait(cache_config.hit_latency); // A local cache access takes the hit latency
+        refresh_line(set, addr, way);
     }
+    wait(1); // The modify step, with the bus still held
+    set_dirty(set, addr, way);
 
     trans_id_ctr++;
     bus_lock = (bus_lock + 1) % num_cpus; // Release the lock
     num_requests_before_me = 0;
 
+    while (bus_lock != 0) {
+        wait_and_invalidate();
+    }
+    return cache_hit;
+}
+
+// Fetches an instruction through the instruction cache, returns true on a
+// cache hit. Instructions are never written, so the controller only puts the
+// fetch on the bus and does not track the line.
+bool Cache::fetch_cache(uint64_t addr) {
+    uint64_t block_addr = ICACHE.block_addr(addr);
+    uint64_t set = ICACHE.set_index(block_addr);
+    uint64_t way = probe_cache(set, block_addr, true);
+
+    while ((uint64_t)bus_lock != my_id) {
+        wait_and_invalidate();
+    }
+
+    VERBOSE && cout << "--------- Cache id " << my_id << " acquired the bus ---------" << endl;
+
+    bool cache_hit = i_lines.holds(set, way, block_addr);
+    cacheController->fetch(addr, my_id, cache_hit, trans_id_ctr);
+
+    wait(Port_CCTransId.value_changed_event());
+
+    if (!cache_hit) {
+        VERBOSE ? log(name(), "I-cache miss") : (void)0;
+        wait(cache_config.mem_latency);
+        insert(set, block_addr, addr, way, true);
+    } else {
+        VERBOSE ? log(name(), "I-cache hit") : (void)0;
+        wait(cache_config.hit_latency); // Charged like a data cache hit
+        refresh_line(set, addr, way, true);
+    }
+
+    trans_id_ctr++;
+    bus_lock = (bus_lock + 1) % num_cpus; // Release the lock
+    num_requests_before_me = 0;
 
     while (bus_lock != 0) {
         wait_and_invalidate();
     }
+    return cache_hit;
 }
 
 void Cache::execute() {
@@ -191,21 +267,52 @@ void Cache::execute() {
 
         Function f = Port_Func.read();
         uint64_t addr = Port_Addr.read();
-        uint64_t block_addr = addr / LINE_SIZE;
+        uint32_t size = max(Port_Size.read(), 1u);
         uint64_t data = 0;
-
-        size_t set_index = block_addr % N_SETS;
-        CacheLine* c_set = line_table[set_index];
-
-        uint64_t index = probe_cache(c_set, block_addr);
-
-        if (f == FUNC_WRITE) {
+        if (f == FUNC_WRITE || f == FUNC_RMW) {
             data = Port_Data.read().to_uint64();
-            write_cache(c_set, block_addr, addr, index);
-        } else if (f == FUNC_READ) {
-            read_cache(c_set, block_addr, addr, index);
-        } else {
+        }
+
+        if (f == FUNC_NOP || f == FUNC_FENCE) {
+            // Accesses complete in order before the next one is issued, so a
+            // fence has nothing to wait for
             nop_cache();
+        } else if (f == FUNC_IFETCH) {
+            // An instruction that crosses a line boundary is fetched line by
+            // line like the data accesses below
+            bool hit = true;
+            uint64_t last_block_addr = ICACHE.block_addr(addr + size - 1);
+            for (uint64_t block_addr = ICACHE.block_addr(addr); block_addr <= last_block_addr; block_addr++) {
+                hit = fetch_cache(max(addr, block_addr * ICACHE.line_size)) && hit;
+            }
+            hit ? stats_ifetchhit(my_id) : stats_ifetchmiss(my_id);
+        } else {
+            // An access that crosses a line boundary sends one request per
+            // line to the controller, each in its own bus turn. It counts as
+            // a single access, a hit only if all lines hit.
+            bool hit = true;
+            uint64_t last_block_addr = DCACHE.block_addr(addr + size - 1);
+            for (uint64_t block_addr = DCACHE.block_addr(addr); block_addr <= last_block_addr; block_addr++) {
+                uint64_t set = DCACHE.set_index(block_addr);
+                uint64_t line_addr = max(addr, block_addr * DCACHE.line_size);
+
+                uint64_t way = probe_cache(set, block_addr);
+
+                if (f == FUNC_WRITE) {
+                    hit = write_cache(set, block_addr, line_addr, way) && hit;
+                } else if (f == FUNC_RMW) {
+                    hit = rmw_cache(set, block_addr, line_addr, way) && hit;
+                } else {
+                    hit = read_cache(set, block_addr, line_addr, way) && hit;
+                }
+            }
+
+            // An RMW counts as a write
+            if (f == FUNC_WRITE || f == FUNC_RMW) {
+                hit ? stats_writehit(my_id) : stats_writemiss(my_id);
+            } else {
+                hit ? stats_readhit(my_id) : stats_readmiss(my_id);
+            }
         }
 
         if (f == FUNC_READ) {
@@ -5,6 +5,7 @@
 #include <iomanip>
 #include <systemc>
 #include "psa.h"
+#include "cache_kernel.h"
 #include "helpers.h"
 
 #define SC_ALLOW_DEPRECATED_IEEE_API
@@ -31,6 +32,7 @@ public:
     // Ports to the CPU  
     sc_in<Function> Port_Func;
     sc_in<uint64_t> Port_Addr;
+    sc_in<uint32_t> Port_Size; // Bytes accessed from Port_Addr on
     sc_out<RetCode> Port_Done;
     sc_inout_rv<64> Port_Data;
 
@@ -42,21 +44,24 @@ public:
     void dump();
 
     void invalidate(uint64_t addr);
-    void write_cache(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index);
+    bool write_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way);
 private:
-    CacheLine** line_table; // Cache structure (Set-Associative Cache)
+    CacheArray lines; // Tags, valid and dirty bits and the replacement state (Set-Associative Cache), see cache_kernel.h
+    CacheArray i_lines; // Instruction cache, never written so not kept coherent
     uint64_t prev_trans_id = 0;
 
     // Private helper functions
-    uint64_t probe_cache(CacheLine* c_set, uint64_t block_addr);
-    bool is_cache_hit(CacheLine* c_set, uint64_t block_addr);
-    void allocate(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index, bool is_write);
+    uint64_t probe_cache(uint64_t set, uint64_t block_addr, bool icache = false);
+    bool is_cache_hit(uint64_t set, uint64_t block_addr);
+    void allocate(uint64_t set, uint64_t block_addr, uint64_t way, bool is_write, bool icache = false);
     void wait_and_invalidate();
-    void insert(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index);
-    void refresh_lu_time(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index);
-    void set_dirty(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index);
+    void insert(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way, bool icache = false);
+    void refresh_line(uint64_t set, uint64_t addr, uint64_t way, bool icache = false);
+    void set_dirty(uint64_t set, uint64_t addr, uint64_t way);
     void nop_cache();
-    void read_cache(CacheLine* c_set, uint64_t block_addr, uint64_t addr, uint64_t index);
+    bool read_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way);
+    bool fetch_cache(uint64_t addr);
+    bool rmw_cache(uint64_t set, uint64_t block_addr, uint64_t addr, uint64_t way);
     void execute();
 };
 
@@ -100,6 +100,67 @@ public:
         Port_CacheCacheId.write(cache_id);
     }
 
+    /*
+     * Atomic read-modify-write of cache cache_id. Like a write the line ends
+     * up modified in cache_id only, but an RMW also takes the line from a
+     * cache that holds it modified. Records the RMW and the time it waited
+     * for the bus for the line at line_addr. The RMW works on the whole line:
+     * every group of an address in the line gives it up to cache_id, so RMWs
+     * to different words of one line, like adjacent locks, invalidate each
+     * other. The RMW is contended if another cache held the line.
+     */
+    void rmw(uint64_t addr, uint64_t line_addr, uint64_t cache_id, bool is_hit, uint64_t trans_id,
+             sc_time waited) {
+        CONTROLLER_VERBOSE && cout << "Cache controller received rmw: cache: " << cache_id << " | addr: " << addr << " | cache hit: " << is_hit << endl;
+
+        AddrGroup *group = nullptr;
+        bool contended = false;
+        for (auto it = system_states.begin(); it != system_states.end();) {
+            if (DCACHE.block_addr(it->addr) != DCACHE.block_addr(line_addr)) {
+                ++it;
+                continue;
+            }
+            for (auto s = it->cacheStates.begin(); s != it->cacheStates.end(); ++s) {
+                contended = contended || (*s)->cache_id != cache_id;
+            }
+            invalidate_members(&(*it), cache_id);
+            if (it->addr == line_addr) {
+                group = &(*it);
+                ++it;
+            } else {
+                it = system_states.erase(it);
+            }
+        }
+        if (group == nullptr) {
+            std::list<CacheState*> cacheStateList = {new CacheState{cache_id}};
+            AddrGroup newGroup{line_addr, cache_id, INVALID_CACHE_ID, Modified, cacheStateList};
+            system_states.push_back(newGroup);
+        } else {
+            make_modified(group, cache_id, FUNC_RMW);
+        }
+
+        LineContention &c = contention[line_addr];
+        c.rmws++;
+        c.contended += contended ? 1 : 0;
+        c.owner = cache_id;
+        c.wait += waited;
+
+        Port_CacheTransId.write(trans_id);
+        Port_CacheCacheId.write(cache_id);
+    }
+
+    void print_contention() {
+        ::print_contention(contention, 10);
+    }
+
+    // Puts an instruction fetch of cache cache_id on the bus. Instruction
+    // lines are never written, so no coherence state is kept for them.
+    void fetch(uint64_t addr, uint64_t cache_id, bool is_hit, uint64_t trans_id) {
+        CONTROLLER_VERBOSE && cout << "Cache controller received fetch: cache: " << cache_id << " | addr: " << addr << " | cache hit: " << is_hit << endl;
+        Port_CacheTransId.write(trans_id);
+        Port_CacheCacheId.write(cache_id);
+    }
+
     void handle_shared(AddrGroup *group, uint64_t cache_id, Function func, bool is_hit) {
         // Read miss -> append cache_id to the shared group 
         if (func == FUNC_READ) {
@@ -215,6 +276,9 @@ public:
 private:
     list<AddrGroup> system_states; 
 
+    // Contention of atomic read-modify-writes, by line address
+    std::map<uint64_t, LineContention> contention;
+
     std::string func_to_str(uint64_t op) {
         return op ? "write" : "read";
     }
@@ -18,11 +18,13 @@ SC_MODULE(CPU) {
     sc_in<Cache::RetCode> Port_cacheDone;
     sc_out<Function> Port_cacheFunc;
     sc_out<uint64_t> Port_cacheAddr;
+    sc_out<uint32_t> Port_cacheSize;
     sc_inout_rv<64> Port_cacheData;
 
     int my_id;
+    sc_time period; // Of the clock, turns idle cycles into time
 
-    SC_CTOR(CPU) {
+    SC_CTOR(CPU) : period(1, SC_NS) {
         SC_THREAD(execute);
         sensitive << Port_CLK.pos();
         dont_initialize();
@@ -31,13 +33,16 @@ SC_MODULE(CPU) {
     private:
     void execute() {
         TraceFile::Entry tr_data;
+        TraceBuffer trace(tracefile_ptr, my_id); // Decodes this CPU's trace in batches
         Function f;
+        sc_time due = SC_ZERO_TIME; // Issue time of the next entry with --trace-timed
+        const TraceFile::Entry idle = {TraceFile::ENTRY_TYPE_NOP, 0, 1};
 
         // Loop until end of tracefile
         while (!tracefile_ptr->eof()) {
 
             // Get the next action for the processor in the trace
-            if (!tracefile_ptr->next(my_id, tr_data)) {
+            if (!trace.next(tr_data)) {
                 cerr << "Error reading trace for CPU" << endl;
                 break;
             }
@@ -53,49 +58,88 @@ SC_MODULE(CPU) {
                 case TraceFile::ENTRY_TYPE_WRITE:
                     f = FUNC_WRITE;
                     break;
+                case TraceFile::ENTRY_TYPE_IFETCH:
+                    f = FUNC_IFETCH;
+                    break;
+                case TraceFile::ENTRY_TYPE_RMW:
+                    f = FUNC_RMW;
+                    break;
+                case TraceFile::ENTRY_TYPE_FENCE:
+                    f = FUNC_FENCE;
+                    break;
                 case TraceFile::ENTRY_TYPE_NOP:
                     f = FUNC_NOP;
                     break;
                 default: cerr << "Error, got invalid data from Trace" << endl; exit(0);
             }
 
-            Port_cacheAddr.write(tr_data.addr);
-            Port_cacheFunc.write(f);
-
-            if (f == FUNC_WRITE) {
-                VERBOSE ? log(name(), "(*) sends write for addr", tr_data.addr) : (void)0;
-                // Don't have data, we write the address as the data value.
-                Port_cacheData.write(tr_data.addr);
-                wait();
-                // Now float the data wires with 64 "Z"'s
-                Port_cacheData.write(float_64_bit_wire);
-
-            } else if (f == FUNC_READ) {
-                VERBOSE ? log(name(), "(*) sends read for addr", tr_data.addr) : (void)0;
-            } else {
-                VERBOSE ? log(name(), "(*) CPU executes NOP") : (void)0;
-                Port_cacheFunc.write(f);
+            // With --trace-timed NOPs add their idle cycles to the time since
+            // the last issue. Until the next entry is due the CPU passes its
+            // turns on the bus with NOPs, the other caches wait for them.
+            if (trace_timed) {
+                if (f == FUNC_NOP) {
+                    due += period * (double)tr_data.cycles();
+                }
+                while (sc_time_stamp() < due) {
+                    issue(FUNC_NOP, idle);
+                }
+                if (f == FUNC_NOP) {
+                    continue;
+                }
+                due = sc_time_stamp();
             }
-            wait(Port_cacheDone.value_changed_event());
 
-            wait();
+            issue(f, tr_data);
         }
         
         // Finished the Tracefile, now stop the simulation
     }
+
+    // Sends entry e to the cache as function f and waits until it is done
+    void issue(Function f, const TraceFile::Entry &e) {
+        Port_cacheAddr.write(e.addr);
+        Port_cacheSize.write(e.type == TraceFile::ENTRY_TYPE_NOP ? 1 : e.size);
+        Port_cacheFunc.write(f);
+
+        if (f == FUNC_WRITE || f == FUNC_RMW) {
+            VERBOSE ? log(name(), f == FUNC_RMW ? "(*) sends rmw for addr" : "(*) sends write for addr", e.addr) : (void)0;
+            // Don't have data, we write the address as the data value.
+            Port_cacheData.write(e.addr);
+            wait();
+            // Now float the data wires with 64 "Z"'s
+            Port_cacheData.write(float_64_bit_wire);
+
+        } else if (f == FUNC_READ) {
+            VERBOSE ? log(name(), "(*) sends read for addr", e.addr) : (void)0;
+        } else if (f == FUNC_IFETCH) {
+            VERBOSE ? log(name(), "(*) sends fetch for addr", e.addr) : (void)0;
+        } else {
+            VERBOSE ? log(name(), "(*) CPU executes NOP") : (void)0;
+            Port_cacheFunc.write(f);
+        }
+        wait(Port_cacheDone.value_changed_event());
+
+        wait();
+    }
 };
 
 
 int sc_main(int argc, char *argv[]) {
     try {
-        if (argc == 3) {   
-            VERBOSE = std::stoi(argv[2]) != 0;
-        } else if (argc != 2) {
-            throw std::invalid_argument("Usage: ./assignment_1.bin [trace_file] [verbose (0 or 1)] or \n ./assignment_1.bin [trace_file]");
-        }
-    
+        // Get the tracefile argument and create Tracefile object
+        // This function sets tracefile_ptr and num_cpus. The cache options
+        // go first, so none of them is taken for the tracefile.
+        init_cache_config(&argc, &argv);
         init_tracefile(&argc, &argv);
 
+        if (argc == 2) {
+            VERBOSE = std::stoi(argv[1]) != 0;
+        } else if (argc != 1) {
+            throw std::invalid_argument("Usage: ./assignment_3.bin [cache options] [trace_file] [verbose (0 or 1)] or \n ./assignment_3.bin [cache options] [trace_file]\n"
+                                        "The cache options are listed in lib/cache_config.h");
+        }
+        print_cache_config(cout);
+
         NUM_CPUS = tracefile_ptr->get_proc_count();
         cout << "Executing with " << NUM_CPUS << " CPUS" << endl;
 
@@ -106,6 +150,7 @@ int sc_main(int argc, char *argv[]) {
         std::vector<sc_buffer<Function>*> sigcacheFunc(NUM_CPUS);
         std::vector<sc_buffer<Cache::RetCode>*> sigcacheDone(NUM_CPUS);
         std::vector<sc_signal<uint64_t>*> sigcacheAddr(NUM_CPUS);
+        std::vector<sc_signal<uint32_t>*> sigcacheSize(NUM_CPUS);
         std::vector<sc_signal_rv<64>*> sigcacheData(NUM_CPUS);
 
         // Declare signals for the CC
@@ -129,6 +174,7 @@ int sc_main(int argc, char *argv[]) {
             sigcacheFunc[i] = new sc_buffer<Function>();
             sigcacheDone[i] = new sc_buffer<Cache::RetCode>();
             sigcacheAddr[i] = new sc_signal<uint64_t>();
+            sigcacheSize[i] = new sc_signal<uint32_t>();
             sigcacheData[i] = new sc_signal_rv<64>();
 
             //Init cache 
@@ -140,6 +186,7 @@ int sc_main(int argc, char *argv[]) {
             caches[i]->cacheController = &cacheController;
             caches[i]->Port_Func(*sigcacheFunc[i]);
             caches[i]->Port_Addr(*sigcacheAddr[i]);
+            caches[i]->Port_Size(*sigcacheSize[i]);
             caches[i]->Port_Data(*sigcacheData[i]);
             caches[i]->Port_Done(*sigcacheDone[i]);
             caches[i]->Port_CLK(clk);
@@ -148,8 +195,10 @@ int sc_main(int argc, char *argv[]) {
             std::string cpu_name = "cpu_" + std::to_string(i);
             cpus[i] = new CPU(cpu_name.c_str());
             cpus[i]->my_id = i;
+            cpus[i]->period = clk.period();
             cpus[i]->Port_cacheFunc(*sigcacheFunc[i]);
             cpus[i]->Port_cacheAddr(*sigcacheAddr[i]);
+            cpus[i]->Port_cacheSize(*sigcacheSize[i]);
             cpus[i]->Port_cacheData(*sigcacheData[i]);
             cpus[i]->Port_cacheDone(*sigcacheDone[i]);
             cpus[i]->Port_CLK(clk);
@@ -161,6 +210,7 @@ int sc_main(int argc, char *argv[]) {
         sc_start();
 
         stats_print();
+        cacheController.print_contention();
 
         cout << "controller simulation complete.\n";
 
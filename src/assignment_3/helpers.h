@@ -1,32 +1,31 @@
 #ifndef _HELPERS_H_
 #define _HELPERS_H_
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <systemc.h>
+#include <vector>
+
+#include "cache_config.h"
+#include "line_contention.h"
 
 const int t_width = 7;
 const int n_width = 7;
 
 using namespace std;
 
-enum Function {FUNC_READ, FUNC_WRITE, FUNC_NOP};
+enum Function {FUNC_READ, FUNC_WRITE, FUNC_NOP, FUNC_IFETCH, FUNC_RMW, FUNC_FENCE};
 
 static bool VERBOSE = true; // Toggle logging  
 
 static size_t NUM_CPUS = 2; 
 
-struct CacheLine {
-    uint64_t tag; // Stores the block adress
-    double lu_time; // least recently used time for cache eviction 
-    bool valid;
-    bool dirty; 
-};
-
-static const size_t CACHE_SIZE = 32768; // Byte 
-static const size_t SET_ASSOC = 8;
-static const size_t LINE_SIZE = 32; // Byte 
-static const size_t N_SETS = (CACHE_SIZE / LINE_SIZE) / SET_ASSOC; 
+// The geometry of the data cache and of the instruction cache, which shares
+// the bus with the data cache, is set at startup, see cache_config.h
+static const CacheGeometry &DCACHE = cache_config.dcache;
+static const CacheGeometry &ICACHE = cache_config.icache;
 
 inline void log_rest() {
     cout << endl;
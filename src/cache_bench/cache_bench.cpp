@@ -0,0 +1,161 @@
+/*
+ * File: cache_bench.cpp
+ *
+ * Compares the specialized cache kernels with the generic one (see
+ * lib/cache_kernel.h): runs the data accesses of a trace through the data
+ * cache of the cache options (see lib/cache_config.h) with both kernels and
+ * prints the time per access, e.g.
+ *   ./cache_bench.bin --cache-size=64K --cache-assoc=4 tracefiles/fft_1024_p4-O2.trf
+ *   ./cache_bench.bin --all "gen:uniform(len=4M,size=8M)"
+ * The reads, writes and RMWs of all processors run through one cache, one
+ * line access per entry. --all runs every geometry that has a specialized
+ * kernel, --policies every replacement policy (see lib/cache_policy.h) on
+ * the cache of the options, so their miss rates can be compared.
+ * --repeat=N runs the accesses N times per kernel (5 by default). Both
+ * kernels have to see the same misses, or the benchmark fails.
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "cache_config.h"
+#include "cache_kernel.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+// Reads the data accesses of all processors of the trace name
+static void read_accesses(const char *name, vector<uint64_t> &addrs, vector<bool> &writes) {
+    uint32_t procs_count;
+    TraceReader *reader = open_trace_reader(name, TraceFile::READ_AUTO, procs_count);
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+    for (uint32_t pid = 0; pid < procs_count; pid++) {
+        size_t n;
+        while ((n = reader->fetch(pid, batch.data(), batch.size())) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                TraceFile::EntryType type = batch[i].type();
+                if (type == TraceFile::ENTRY_TYPE_READ || type == TraceFile::ENTRY_TYPE_WRITE ||
+                    type == TraceFile::ENTRY_TYPE_RMW) {
+                    addrs.push_back(batch[i].addr());
+                    writes.push_back(type != TraceFile::ENTRY_TYPE_READ);
+                }
+            }
+        }
+    }
+    delete reader;
+}
+
+// Runs the accesses repeat times through an empty cache, returns the
+// nanoseconds per access of the fastest run
+static double time_kernel(const CacheGeometry &g, const string &policy, bool specialize,
+                          const vector<uint64_t> &addrs, const bool *writes, uint32_t repeat,
+                          uint64_t &misses) {
+    double best = 0;
+    for (uint32_t r = 0; r < repeat; r++) {
+        CacheArray cache;
+        cache.init(g, policy, specialize);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        misses = cache.run(addrs.data(), writes, addrs.size());
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / addrs.size();
+        best = r == 0 || ns < best ? ns : best;
+    }
+    return best;
+}
+
+static void bench(const CacheGeometry &g, const string &policy, const vector<uint64_t> &addrs,
+                  const bool *writes, uint32_t repeat) {
+    uint64_t generic_misses;
+    uint64_t specialized_misses;
+    double generic = time_kernel(g, policy, false, addrs, writes, repeat, generic_misses);
+    double specialized = time_kernel(g, policy, true, addrs, writes, repeat, specialized_misses);
+    if (generic_misses != specialized_misses) {
+        throw runtime_error("The kernels disagree for " + to_string(g.size) + " B: " +
+                            to_string(generic_misses) + " and " + to_string(specialized_misses) + " misses");
+    }
+
+    CacheArray cache;
+    cache.init(g, policy);
+    cout << setw(10) << g.size << setw(6) << g.set_assoc << setw(6) << g.line_size << setw(7) << g.n_sets
+         << setw(8) << policy << setw(8) << fixed << setprecision(2) << 100.0 * generic_misses / addrs.size()
+         << setw(10) << generic << setw(13) << specialized << setw(9) << generic / specialized
+         << (cache.is_specialized() ? "" : "  no specialized kernel") << endl;
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        init_cache_config(&argc, &argv);
+        bool all = false;
+        bool policies = false;
+        uint32_t repeat = 5;
+        vector<const char *> files;
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "--all")) {
+                all = true;
+            } else if (!strcmp(argv[i], "--policies")) {
+                policies = true;
+            } else if (!strncmp(argv[i], "--repeat=", 9)) {
+                repeat = stoul(argv[i] + 9);
+            } else {
+                files.push_back(argv[i]);
+            }
+        }
+        if (files.size() != 1 || repeat == 0) {
+            throw invalid_argument("Usage: ./cache_bench.bin [cache options] [--all | --policies] [--repeat=N] trace\n"
+                "Times the specialized and generic cache kernels on the data accesses of trace");
+        }
+
+        vector<uint64_t> addrs;
+        vector<bool> write_flags;
+        read_accesses(files[0], addrs, write_flags);
+        if (addrs.empty()) {
+            throw runtime_error("The trace has no data accesses");
+        }
+        // vector<bool> has no data(), the kernels take a plain array
+        bool *writes = new bool[addrs.size()];
+        for (size_t i = 0; i < addrs.size(); i++) {
+            writes[i] = write_flags[i];
+        }
+
+        cout << addrs.size() << " accesses, fastest of " << repeat << " runs" << endl;
+        cout << setw(10) << "Size" << setw(6) << "Ways" << setw(6) << "Line" << setw(7) << "Sets"
+             << setw(8) << "Policy" << setw(8) << "Miss%" << setw(10) << "Generic" << setw(13) << "Specialized"
+             << setw(9) << "Speedup" << endl;
+        if (all) {
+            size_t n;
+            const CacheArray::Kernel *kernels = CacheArray::get_kernels(n);
+            for (size_t i = 0; i < n; i++) {
+                CacheGeometry g;
+                g.init("cache", kernels[i].line_size * kernels[i].n_sets * kernels[i].set_assoc,
+                       kernels[i].set_assoc, kernels[i].line_size);
+                bench(g, cache_config.dcache_policy, addrs, writes, repeat);
+            }
+        } else if (policies) {
+            const char *names[] = { "lru", "plru", "srrip", "brrip", "fifo", "random", "dip" };
+            for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+                try {
+                    bench(cache_config.dcache, names[i], addrs, writes, repeat);
+                } catch (runtime_error &e) { // A policy that does not fit the cache
+                    cout << setw(45) << names[i] << "  " << e.what() << endl;
+                }
+            }
+        } else {
+            bench(cache_config.dcache, cache_config.dcache_policy, addrs, writes, repeat);
+        }
+        cout << "Times in ns per access" << endl;
+        delete[] writes;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -16,6 +16,7 @@
 #define SC_ALLOW_DEPRECATED_IEEE_API
 
 #include "psa.h"
+#include "cache_config.h"
 
 using namespace std;
 using namespace sc_core; // This pollutes namespace, better: only import what you need.
@@ -76,7 +77,7 @@ SC_MODULE(Memory) {
             VERBOSE && cout << sc_time_stamp() << ": MEM address " << addr << endl;
 
             // This simulates memory read/write delay
-            wait(100);
+            wait(cache_config.mem_latency);
 
             if (f == FUNC_READ) {
                 Port_Data.write((addr < MEM_SIZE) ? m_data[addr] : 0);
@@ -101,7 +102,9 @@ SC_MODULE(CPU) {
     sc_out<uint64_t> Port_MemAddr;
     sc_inout_rv<64> Port_MemData;
 
-    SC_CTOR(CPU) {
+    sc_time period; // Of the clock, turns idle cycles into time
+
+    SC_CTOR(CPU) : period(1, SC_NS) {
         SC_THREAD(execute);
         sensitive << Port_CLK.pos();
         dont_initialize();
@@ -111,6 +114,7 @@ SC_MODULE(CPU) {
     void execute() {
         TraceFile::Entry tr_data;
         Memory::Function f;
+        sc_time due = SC_ZERO_TIME; // Issue time of the next entry with --trace-timed
 
         // Loop until end of tracefile
         while (!tracefile_ptr->eof()) {
@@ -135,6 +139,7 @@ SC_MODULE(CPU) {
                 break;
 
             case TraceFile::ENTRY_TYPE_WRITE:
+            case TraceFile::ENTRY_TYPE_RMW: // A single CPU needs no atomicity
                 f = Memory::FUNC_WRITE;
                 if (j)
                     stats_writehit(0);
@@ -142,14 +147,40 @@ SC_MODULE(CPU) {
                     stats_writemiss(0);
                 break;
 
-            case TraceFile::ENTRY_TYPE_NOP: break;
+            case TraceFile::ENTRY_TYPE_IFETCH:
+                f = Memory::FUNC_READ;
+                if (j)
+                    stats_ifetchhit(0);
+                else
+                    stats_ifetchmiss(0);
+                break;
+
+            case TraceFile::ENTRY_TYPE_NOP:
+            case TraceFile::ENTRY_TYPE_FENCE: break;
 
             default:
                 cerr << "Error, got invalid data from Trace" << endl;
                 exit(0);
             }
 
-            if (tr_data.type != TraceFile::ENTRY_TYPE_NOP) {
+            // With --trace-timed NOPs add their idle cycles to the time since
+            // the last issue, and the CPU waits until the next entry is due
+            if (trace_timed) {
+                bool nop = tr_data.type == TraceFile::ENTRY_TYPE_NOP;
+                if (nop) {
+                    due += period * (double)tr_data.cycles();
+                }
+                while (sc_time_stamp() < due) {
+                    wait();
+                }
+                if (nop) {
+                    continue;
+                }
+                due = sc_time_stamp();
+            }
+
+            if (tr_data.type != TraceFile::ENTRY_TYPE_NOP &&
+                tr_data.type != TraceFile::ENTRY_TYPE_FENCE) {
                 Port_MemAddr.write(tr_data.addr);
                 Port_MemFunc.write(f);
 
@@ -188,7 +219,9 @@ SC_MODULE(CPU) {
 int sc_main(int argc, char *argv[]) {
     try {
         // Get the tracefile argument and create Tracefile object
-        // This function sets tracefile_ptr and num_cpus
+        // This function sets tracefile_ptr and num_cpus. Only the memory
+        // latency of the cache options applies here.
+        init_cache_config(&argc, &argv);
         init_tracefile(&argc, &argv);
 
         // Initialize statistics counters
@@ -220,6 +253,7 @@ int sc_main(int argc, char *argv[]) {
 
         mem.Port_CLK(clk);
         cpu.Port_CLK(clk);
+        cpu.period = clk.period();
 
         cout << "Running (press CTRL+C to interrupt)... " << endl;
 
@@ -0,0 +1,116 @@
+/*
+ * File: trf_capture.cpp
+ *
+ * Traces a multithreaded matrix multiplication C = A * B of N x N doubles
+ * with the trace capture library (see lib/trace_capture.h), the kernel of
+ * the matrix_mult traces, at any size, e.g.
+ *   ./trf_capture.bin --threads=8 1000 matrix_mult_1000_1000_p8.trf
+ * Thread p computes the rows p, p + P, ... of C: it reads A[i][k] and
+ * B[k][j] for every k and then writes C[i][j]. The kernel also runs once
+ * without tracing, the difference is the cost of recording.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_capture.h"
+
+using namespace std;
+
+struct Matrices {
+    size_t n;
+    vector<double> a;
+    vector<double> b;
+    vector<double> c;
+};
+
+template <bool traced>
+static void multiply(Matrices &m, uint32_t pid, uint32_t threads) {
+    size_t n = m.n;
+    for (size_t i = pid; i < n; i += threads) {
+        for (size_t j = 0; j < n; j++) {
+            double sum = 0;
+            for (size_t k = 0; k < n; k++) {
+                if (traced) {
+                    trace_read(&m.a[i * n + k], sizeof(double));
+                    trace_read(&m.b[k * n + j], sizeof(double));
+                }
+                sum += m.a[i * n + k] * m.b[k * n + j];
+            }
+            if (traced) {
+                trace_write(&m.c[i * n + j], sizeof(double));
+            }
+            m.c[i * n + j] = sum;
+        }
+    }
+}
+
+// Runs the kernel on threads threads, returns the time it took
+template <bool traced>
+static double run(Matrices &m, uint32_t threads) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (uint32_t pid = 0; pid < threads; pid++) {
+        workers.push_back(thread([&m, pid, threads]() {
+            if (traced) {
+                trace_thread(pid);
+            }
+            multiply<traced>(m, pid, threads);
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        uint32_t threads = 1;
+        vector<const char *> args;
+        for (int i = 1; i < argc; i++) {
+            if (!strncmp(argv[i], "--threads=", 10)) {
+                threads = stoul(argv[i] + 10);
+            } else {
+                args.push_back(argv[i]);
+            }
+        }
+        if (args.size() != 2 || threads == 0) {
+            throw invalid_argument("Usage: ./trf_capture.bin [--threads=P] N output\n"
+                "Traces the multiplication of two N x N matrices on P threads");
+        }
+        Matrices m;
+        m.n = stoull(args[0]);
+        const char *output = args[1];
+        m.a.assign(m.n * m.n, 1.0);
+        m.b.assign(m.n * m.n, 2.0);
+        m.c.assign(m.n * m.n, 0.0);
+
+        double plain = run<false>(m, threads);
+
+        string params = to_string(m.n) + "_" + to_string(m.n) + "_p" + to_string(threads);
+        trace_start(output, "matrix_mult", params, 64);
+        double traced = run<true>(m, threads);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        trace_stop();
+        double written = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        uint64_t records = (2 * m.n + 1) * m.n * m.n;
+        cout << "Recorded " << records << " accesses on " << threads << " threads in " << traced
+             << " s (" << plain << " s without tracing, "
+             << (traced - plain) * 1e9 * threads / records << " ns per access and thread)" << endl;
+        cout << "Wrote " << output << " in another " << written << " s" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
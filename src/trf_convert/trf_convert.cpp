@@ -0,0 +1,278 @@
+/*
+ * File: trf_convert.cpp
+ *
+ * Converts tracefiles between the 5TRF format, its transposed layout and the
+ * compressed 5TRZ format. Without --to the direction follows from the
+ * signature of the input file: 5TRZ is decompressed, anything else is
+ * compressed. The output is read back and compared against the input, its
+ * entries and its version 2 header (the workload, the generator parameters
+ * and the line size, and the counts if the input has them), and the sizes and the decode throughput of both files are reported, both per
+ * processor and in the order a simulation reads them. Both files are read
+ * several times, so neither can be - (stdin or stdout).
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_reader.h"
+#include "trace_writer.h"
+#include "trz.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+// Takes the checksums of the timed loops, so they are not optimized away
+static volatile uint64_t checksum_sink;
+
+static uint64_t file_size(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        throw runtime_error(string("Unable to open file: ") + filename);
+    }
+    return st.st_size;
+}
+
+// Decodes every entry of every processor, returns the number of entries.
+// A checksum of the entries is stored in sum. A trace that stops without end
+// tag is counted as if it had one, since decompressing adds the tag.
+static uint64_t decode_all(const char *filename, uint64_t &sum) {
+    TraceFile trace(filename);
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+    uint64_t entries = 0;
+    sum = 0;
+
+    for (uint32_t pid = 0; pid < trace.get_proc_count(); pid++) {
+        uint64_t last = 0;
+        size_t n;
+        while ((n = trace.next_batch(pid, batch.data(), batch.size())) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                sum = sum * 31 + batch[i].word;
+            }
+            entries += n;
+            last = batch[n - 1].word;
+        }
+        TraceFile::PackedEntry pe = { last };
+        if (pe.type() != TraceFile::ENTRY_TYPE_END) {
+            sum = sum * 31 + ((uint64_t)TraceFile::ENTRY_TYPE_END << 61);
+            entries++;
+        }
+        sum = sum * 31 + pid;
+    }
+    return entries;
+}
+
+// Times decode_all, best of three runs, in seconds
+static double time_decode(const char *filename, uint64_t &entries, uint64_t &sum) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        auto start = chrono::steady_clock::now();
+        entries = decode_all(filename, sum);
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (run == 0 || secs < best) {
+            best = secs;
+        }
+    }
+    return best;
+}
+
+// Reads every processor's trace through a TraceBuffer, round-robin one
+// entry at a time like the simulators do. Returns the best of three runs in
+// seconds.
+static double time_simulation(const char *filename) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        auto start = chrono::steady_clock::now();
+        TraceFile trace(filename);
+        vector<TraceBuffer *> buffers;
+        for (uint32_t pid = 0; pid < trace.get_proc_count(); pid++) {
+            buffers.push_back(new TraceBuffer(&trace, pid));
+        }
+
+        TraceFile::Entry e;
+        uint64_t sum = 0;
+        while (!trace.eof()) {
+            for (size_t pid = 0; pid < buffers.size(); pid++) {
+                buffers[pid]->next(e);
+                sum += e.addr;
+            }
+        }
+        for (size_t pid = 0; pid < buffers.size(); pid++) {
+            delete buffers[pid];
+        }
+
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (run == 0 || secs < best) {
+            best = secs;
+        }
+        checksum_sink = sum;
+    }
+    return best;
+}
+
+// Returns the name of the format of filename
+static string format_name(const char *filename) {
+    unsigned char header[8] = {0};
+    ifstream input(filename, ios::in | ios::binary);
+    input.read((char *)header, sizeof(header));
+    if (!memcmp(header, "5TRZ", 4)) {
+        return "5TRZ";
+    }
+    string name = header[4] & (TraceHeader::header_flag >> 24) ? "5TRF v2" : "5TRF";
+    return header[4] & (RawTraceReader::transposed_flag >> 24) ? name + " transposed" : name;
+}
+
+static void compress(const char *in, const char *out) {
+    TraceFile trace(in);
+    TrzEncoder encoder(trace.get_proc_count());
+    if (trace.get_header() != NULL) {
+        encoder.set_description(*trace.get_header());
+    }
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+
+    for (uint32_t pid = 0; pid < trace.get_proc_count(); pid++) {
+        size_t n;
+        while ((n = trace.next_batch(pid, batch.data(), batch.size())) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                encoder.add(pid, batch[i]);
+            }
+        }
+    }
+    encoder.write(out);
+}
+
+static void decompress(const char *in, const char *out, bool transposed) {
+    TraceFile trace(in);
+    TraceWriter writer(out, trace.get_proc_count(), transposed);
+    if (trace.get_header() != NULL) {
+        writer.set_description(*trace.get_header());
+    }
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+
+    // Go round-robin over the processors to keep the writer's backlog small
+    bool more = true;
+    while (more) {
+        more = false;
+        for (uint32_t pid = 0; pid < trace.get_proc_count(); pid++) {
+            size_t n = trace.next_batch(pid, batch.data(), batch.size());
+            writer.add(pid, batch.data(), n);
+            more = more || n > 0;
+        }
+    }
+    writer.close();
+}
+
+// Checks that the output kept the version 2 header of the input. Traces
+// without counts in the header get them on conversion.
+static void check_header(const char *in, const char *out) {
+    TraceFile in_trace(in);
+    TraceFile out_trace(out);
+    const TraceHeader *a = in_trace.get_header();
+    const TraceHeader *b = out_trace.get_header();
+    if (a == NULL) {
+        return;
+    }
+
+    bool same = b != NULL && a->get_workload() == b->get_workload() &&
+                a->get_params() == b->get_params() && a->get_line_size() == b->get_line_size();
+    for (uint32_t pid = 0; same && a->has_counts() && pid < a->get_proc_count(); pid++) {
+        same = a->get_entry_count(pid) == b->get_entry_count(pid) &&
+               a->get_barrier_count(pid) == b->get_barrier_count(pid);
+    }
+    if (!same) {
+        throw runtime_error(string("Verification of the header of ") + out + " failed");
+    }
+}
+
+static void print_rate(const string &name, uint64_t entries, double secs) {
+    cout << "  " << left << setw(22) << name << right << ": " << fixed << setprecision(1)
+         << entries / secs / 1e6 << " M entries/s ("
+         << entries * 8 / secs / 1e6 << " MB/s of 5TRF data)" << endl;
+}
+
+static void usage(const char *name) {
+    throw invalid_argument(string("Usage: ") + name + " [--to=FORMAT] [input_file] [output_file]\n"
+        "Converts a trace to FORMAT: trf (5TRF), transposed (5TRF with a block\n"
+        "per processor) or trz (5TRZ). By default a 5TRZ trace is decompressed\n"
+        "to 5TRF and any other trace is compressed to 5TRZ");
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        const char *in = NULL;
+        const char *out = NULL;
+        string to;
+        for (int i = 1; i < argc; i++) {
+            if (!strncmp(argv[i], "--to=", 5)) {
+                to = argv[i] + 5;
+                if (to != "trf" && to != "transposed" && to != "trz") {
+                    usage(argv[0]);
+                }
+            } else if (in == NULL) {
+                in = argv[i];
+            } else if (out == NULL) {
+                out = argv[i];
+            } else {
+                usage(argv[0]);
+            }
+        }
+        if (in == NULL || out == NULL) {
+            usage(argv[0]);
+        }
+        if (!strcmp(in, "-") || !strcmp(out, "-")) {
+            throw invalid_argument("trf_convert reads the input and the output several times to verify and "
+                                   "time them, so neither can be - (stdin or stdout)");
+        }
+
+        if (to.empty()) {
+            to = format_name(in) == "5TRZ" ? "trf" : "trz";
+        }
+        if (to == "trz") {
+            compress(in, out);
+        } else {
+            decompress(in, out, to == "transposed");
+        }
+
+        // Read both traces back and make sure they hold the same entries
+        uint64_t in_entries, in_sum, out_entries, out_sum;
+        double in_secs = time_decode(in, in_entries, in_sum);
+        double out_secs = time_decode(out, out_entries, out_sum);
+        if (in_entries != out_entries || in_sum != out_sum) {
+            throw runtime_error(string("Verification of ") + out + " failed");
+        }
+        check_header(in, out);
+        double in_sim_secs = time_simulation(in);
+        double out_sim_secs = time_simulation(out);
+
+        string in_format = format_name(in);
+        string out_format = format_name(out);
+        uint64_t in_size = file_size(in);
+        uint64_t out_size = file_size(out);
+
+        cout << "Entries:       " << in_entries << " (verified)" << endl;
+        cout << "Input:         " << in_size << " B, " << in_format << endl;
+        cout << "Output:        " << out_size << " B, " << out_format << endl;
+        cout << "Size ratio:    " << fixed << setprecision(2)
+             << (double)in_size / out_size << "x" << endl;
+        cout << "Decode throughput per processor (best of 3, file in page cache)" << endl;
+        print_rate("in: " + in_format, in_entries, in_secs);
+        print_rate("out: " + out_format, in_entries, out_secs);
+        cout << "Decode throughput in simulation order (TraceBuffer round-robin)" << endl;
+        print_rate("in: " + in_format, in_entries, in_sim_secs);
+        print_rate("out: " + out_format, in_entries, out_sim_secs);
+        cout << "Speedup:       " << fixed << setprecision(2) << in_sim_secs / out_sim_secs
+             << "x in simulation order" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
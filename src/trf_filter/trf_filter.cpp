@@ -0,0 +1,148 @@
+/*
+ * File: trf_filter.cpp
+ *
+ * Runs the private L1 caches over a trace and writes the entries that reach
+ * the level below, the misses and dirty write backs, as a 5TRF trace (see
+ * lib/l1_filter.h). Experiments with a different bus, shared cache or
+ * memory can run on the filtered trace instead of the full one, e.g.
+ *   ./trf_filter.bin tracefiles/fft_1024_p4-O2.trf fft_p4_l2.trf
+ * Run the filtered trace with --trace-timed to keep the time the processors
+ * spent on the entries that hit.
+ *
+ * Next to the output, output.orig tags every entry of the filtered trace
+ * with the index of its entry in the original trace, so results can be
+ * mapped back onto it. Layout, all fields big endian:
+ *   "5ORG" | procs_count (32 bit)
+ *   per processor: entry count (64 bit)
+ *   per processor: original entry index of every entry (64 bit)
+ * The caches take the options of the simulators (see lib/cache_config.h),
+ * e.g. --cache-size=64K --cache-assoc=4 or --cache-config=FILE, so a
+ * filtered trace is made for the caches a simulation runs with. Their
+ * replacement policies (--cache-policy and --icache-policy, LRU by
+ * default) can be compared on the miss rates.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "cache_config.h"
+#include "l1_filter.h"
+#include "trace_reader.h"
+#include "trace_writer.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+static void put_be64(ostream &output, uint64_t v) {
+    unsigned char data[8];
+    for (int i = 0; i < 8; i++) {
+        data[i] = (unsigned char)(v >> (56 - i * 8));
+    }
+    output.write((const char *)data, sizeof(data));
+}
+
+static void put_be32(ostream &output, uint32_t v) {
+    unsigned char data[4];
+    for (int i = 0; i < 4; i++) {
+        data[i] = (unsigned char)(v >> (24 - i * 8));
+    }
+    output.write((const char *)data, sizeof(data));
+}
+
+// Describes a cache of the configuration as SIZE:ASSOC:LINE
+static string describe(const CacheGeometry &g) {
+    return to_string(g.size) + ":" + to_string(g.set_assoc) + ":" + to_string(g.line_size);
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        init_cache_config(&argc, &argv);
+        if (argc != 3) {
+            throw invalid_argument("Usage: ./trf_filter.bin [cache options] input output\n"
+                "Writes the L1 misses and write backs of input to output and the\n"
+                "original entry index of every entry of output to output.orig.\n"
+                "The caches take the --cache-* and --icache-* options of the\n"
+                "simulators, see lib/cache_config.h");
+        }
+        const char *input = argv[1];
+        const char *output = argv[2];
+        const CacheConfig &config = cache_config;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        uint32_t procs_count;
+        TraceReader *reader = open_trace_reader(input, TraceFile::READ_AUTO, procs_count);
+        L1Filter filter(reader, procs_count, config);
+
+        TraceWriter writer(output, procs_count);
+        const TraceHeader *header = reader->get_header();
+        if (header != NULL) {
+            writer.set_description(*header);
+        }
+        writer.set_params((header != NULL && !header->get_params().empty() ? header->get_params() + " " : "") +
+                          "l1filter dcache=" + describe(config.dcache) + " icache=" + describe(config.icache) +
+                          (config.dcache_policy != "lru" ? " policy=" + config.dcache_policy : "") +
+                          (config.icache_policy != config.dcache_policy ? " icache-policy=" + config.icache_policy : ""));
+        writer.set_line_size(config.dcache.line_size);
+
+        // The filtered trace is short, so the original indices are kept in
+        // memory until the counts for the head of the file are known
+        vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+        vector<uint64_t> orig(BATCH_SIZE);
+        vector<vector<uint64_t> > indices(procs_count);
+        bool more = true;
+        while (more) {
+            more = false;
+            for (uint32_t pid = 0; pid < procs_count; pid++) {
+                size_t n = filter.fetch(pid, batch.data(), orig.data(), batch.size());
+                writer.add(pid, batch.data(), n);
+                indices[pid].insert(indices[pid].end(), orig.begin(), orig.begin() + n);
+                more |= !filter.done(pid);
+            }
+        }
+        writer.close();
+        delete reader;
+
+        string orig_name = string(output) + ".orig";
+        ofstream orig_file(orig_name.c_str(), ios::binary);
+        orig_file.write("5ORG", 4);
+        put_be32(orig_file, procs_count);
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            put_be64(orig_file, indices[pid].size());
+        }
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            for (size_t i = 0; i < indices[pid].size(); i++) {
+                put_be64(orig_file, indices[pid][i]);
+            }
+        }
+        orig_file.close();
+        if (!orig_file) {
+            throw runtime_error("Could not write " + orig_name);
+        }
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        uint64_t total_in = 0;
+        uint64_t total_out = 0;
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            const L1Filter::Stats &s = filter.get_stats(pid);
+            cout << "CPU " << pid << ": " << s.entries << " entries, " << s.accesses << " line accesses, "
+                 << s.misses << " misses (" << (s.accesses ? 100.0 * s.misses / s.accesses : 0.0)
+                 << "%), " << s.writebacks << " write backs, " << s.kept << " entries kept" << endl;
+            total_in += s.entries;
+            total_out += s.kept;
+        }
+        cout << "Wrote " << total_out << " entries to " << output << ", "
+             << (total_out ? (double)total_in / total_out : 0.0) << "x fewer, in " << seconds << " s" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * File: trf_gen.cpp
+ *
+ * Writes a synthetic trace to a 5TRF file. The trace is described by a
+ * generator spec, see lib/trace_gen.h, e.g.
+ *   ./trf_gen.bin "cpus=4;seq(len=1M,stride=64)+prodcons(rounds=8)" out.trf
+ * The same spec can drive a simulator directly as tracefile gen:spec.
+ * The header of the file records the spec, the workload name given with
+ * --name and the cache line size given with --line (64 by default).
+ */
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_gen.h"
+#include "trace_writer.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        const char *spec = NULL;
+        const char *output = NULL;
+        string name = "synthetic";
+        uint64_t line_size = 64;
+        for (int i = 1; i < argc; i++) {
+            if (!strncmp(argv[i], "--name=", 7)) {
+                name = argv[i] + 7;
+            } else if (!strncmp(argv[i], "--line=", 7)) {
+                line_size = stoull(argv[i] + 7);
+            } else if (spec == NULL) {
+                spec = argv[i];
+            } else if (output == NULL) {
+                output = argv[i];
+            } else {
+                spec = NULL;
+                break;
+            }
+        }
+        if (spec == NULL || output == NULL) {
+            throw invalid_argument("Usage: ./trf_gen.bin [--name=NAME] [--line=BYTES] [spec] [output_file]\n"
+                "Writes the trace generated from spec, see lib/trace_gen.h");
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        GeneratorTraceReader generator(spec);
+        uint32_t procs_count = generator.get_proc_count();
+        TraceWriter writer(output, procs_count);
+        writer.set_workload(name);
+        writer.set_params(spec);
+        writer.set_line_size(line_size);
+
+        // Generate the processors side by side, so the writer only holds a
+        // few batches of every processor
+        vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+        uint64_t entries = 0;
+        bool more = true;
+        while (more) {
+            more = false;
+            for (uint32_t pid = 0; pid < procs_count; pid++) {
+                size_t n = generator.fetch(pid, batch.data(), batch.size());
+                writer.add(pid, batch.data(), n);
+                entries += n;
+                more |= n > 0;
+            }
+        }
+        writer.close();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Wrote " << entries << " entries for " << procs_count << " CPUs ("
+             << writer.get_entry_count() << " with padding) to " << output << " in "
+             << seconds << " s" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * File: trf_index.cpp
+ *
+ * Adds an index to a 5TRF or 5TRZ tracefile, or replaces the index it
+ * already has. The index holds the number of entries of every processor,
+ * the positions of all barriers and a checkpoint every interval entries,
+ * which lets TraceFile::seek_to_entry() and seek_to_epoch() start anywhere
+ * in the trace. See lib/trace_index.h for the format.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_index.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+// Decodes the whole trace and records what goes into its index
+static void build_index(TraceReader *reader, TraceIndex &index) {
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+
+    for (uint32_t pid = 0; pid < index.get_proc_count(); pid++) {
+        uint64_t entry = 0;
+        uint64_t next_checkpoint = index.get_interval();
+
+        while (true) {
+            // Stop at every checkpoint
+            uint64_t want = next_checkpoint - entry < BATCH_SIZE ? next_checkpoint - entry : BATCH_SIZE;
+            size_t n = reader->fetch(pid, batch.data(), want);
+            if (n == 0) {
+                break;
+            }
+
+            for (size_t i = 0; i < n; i++) {
+                if (batch[i].type() == TraceFile::ENTRY_TYPE_BARRIER) {
+                    index.add_barrier(pid, entry + i);
+                }
+            }
+            entry += n;
+
+            if (entry == next_checkpoint) {
+                TraceCheckpoint cp;
+                reader->checkpoint(pid, cp);
+                cp.entry = entry;
+                index.add_checkpoint(pid, cp);
+                next_checkpoint += index.get_interval();
+            }
+        }
+        index.set_entry_count(pid, entry);
+    }
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        if (argc != 2 && argc != 3) {
+            throw invalid_argument("Usage: ./trf_index.bin [trace_file] [checkpoint_interval]\n"
+                "Adds an index to a 5TRF or 5TRZ trace, or replaces its index");
+        }
+        const char *filename = argv[1];
+        uint64_t interval = TraceIndex::default_interval;
+        if (argc == 3) {
+            interval = stoull(argv[2]);
+            if (interval == 0) {
+                throw invalid_argument("The checkpoint interval must be at least 1");
+            }
+        }
+
+        // The trace data ends where an index that is already there starts
+        uint64_t data_end;
+        {
+            ifstream input(filename, ios::in | ios::binary | ios::ate);
+            if (!input.is_open()) {
+                throw runtime_error(string("Unable to open file: ") + filename);
+            }
+            uint64_t size = input.tellg();
+            TraceIndex old;
+            if (!old.read(input, size, data_end)) {
+                data_end = size;
+            }
+        }
+
+        uint32_t procs_count;
+        TraceReader *reader = open_trace_reader(filename, TraceFile::READ_AUTO, procs_count);
+        TraceIndex index(procs_count, reader->get_state_words(), interval);
+        try {
+            build_index(reader, index);
+        } catch (exception &e) {
+            delete reader;
+            throw;
+        }
+        delete reader;
+
+        // Replace the old index
+        if (truncate(filename, data_end) != 0) {
+            throw runtime_error(string("Unable to write file: ") + filename);
+        }
+        ofstream output(filename, ios::out | ios::binary | ios::app);
+        index.write(output, data_end);
+        output.close();
+        if (output.fail()) {
+            throw runtime_error(string("Unable to write file: ") + filename);
+        }
+
+        // Opening the trace checks the index against the trace
+        TraceFile trace(filename);
+
+        cout << "CPUs:          " << procs_count << endl;
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            cout << "CPU " << pid << ":         " << trace.get_entry_count(pid) << " entries, "
+                 << index.get_barrier_count(pid) << " barriers, "
+                 << index.get_checkpoint_count(pid) << " checkpoints" << endl;
+        }
+        cout << "Epochs:        " << trace.get_epoch_count() << endl;
+        cout << "Interval:      " << interval << " entries" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
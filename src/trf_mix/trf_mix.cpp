@@ -0,0 +1,93 @@
+/*
+ * File: trf_mix.cpp
+ *
+ * Writes a multiprogrammed trace to a 5TRF file: every job is a single
+ * processor trace that runs on a processor of its own, see lib/trace_mix.h
+ * for the job parameters, e.g.
+ *   ./trf_mix.bin tracefiles/fft_1024_p1-O2.trf@runs=2 \
+ *       tracefiles/matrix_mult_50_50_p1-O2.trf@delay=10K mix.trf
+ * The same jobs joined by + can drive a simulator directly as tracefile
+ * mix:spec. The header of the file records the jobs, so the simulators
+ * print which job ran on which CPU. The cache line size given with --line
+ * is recorded too.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_mix.h"
+#include "trace_writer.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        vector<string> jobs;
+        uint64_t line_size = 0;
+        for (int i = 1; i < argc; i++) {
+            if (!strncmp(argv[i], "--line=", 7)) {
+                line_size = stoull(argv[i] + 7);
+            } else {
+                jobs.push_back(argv[i]);
+            }
+        }
+        if (jobs.size() < 2) {
+            throw invalid_argument("Usage: ./trf_mix.bin [--line=BYTES] job [job...] output_file\n"
+                "Writes a trace that runs every job on a CPU of its own, a job is\n"
+                "trace[@offset=BYTES,delay=NOPS,runs=N], see lib/trace_mix.h");
+        }
+        string output = jobs.back();
+        jobs.pop_back();
+
+        string spec;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i].find('+') != string::npos) {
+                throw runtime_error("A job cannot contain a +: " + jobs[i]);
+            }
+            spec += (i ? "+" : "") + jobs[i];
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        MixTraceReader mix(spec, TraceFile::READ_AUTO);
+        uint32_t procs_count = mix.get_proc_count();
+        TraceWriter writer(output.c_str(), procs_count);
+        writer.set_description(*mix.get_header());
+        writer.set_line_size(line_size);
+
+        // Read the jobs side by side, so the writer only holds a few batches
+        // of every processor
+        vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+        vector<uint64_t> entries(procs_count, 0);
+        bool more = true;
+        while (more) {
+            more = false;
+            for (uint32_t pid = 0; pid < procs_count; pid++) {
+                size_t n = mix.fetch(pid, batch.data(), batch.size());
+                writer.add(pid, batch.data(), n);
+                entries[pid] += n;
+                more |= n > 0;
+            }
+        }
+        writer.close();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        for (uint32_t pid = 0; pid < procs_count; pid++) {
+            cout << "CPU " << pid << ": " << entries[pid] << " entries of " << jobs[pid] << endl;
+        }
+        cout << "Wrote " << writer.get_entry_count() << " entries with padding to " << output
+             << " in " << seconds << " s" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
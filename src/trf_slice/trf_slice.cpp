@@ -0,0 +1,494 @@
+/*
+ * File: trf_slice.cpp
+ *
+ * Cuts a smaller 5TRF trace out of a tracefile, so experiments can run on a
+ * representative part of a long trace. A slice is selected by:
+ *   - a range of entries or of barrier epochs, the same for every CPU
+ *   - a subset of the CPUs, which are numbered from 0 in the output
+ *   - systematic sampling: L out of every P entries, or every N-th epoch
+ * Barriers are kept consistent: when the CPUs of the input pass the same
+ * barriers, so do the CPUs of the slice, and it simulates without deadlocks.
+ *
+ * The input is read through TraceFile, so 5TRF, 5TRZ and pipes work. With an
+ * index (see trf_index) the start of the range is found by seeking, without
+ * one the trace is read up to it.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <deque>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_index.h"
+#include "trace_writer.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+static const uint64_t NO_LIMIT = numeric_limits<uint64_t>::max();
+
+enum RangeMode {
+    RANGE_ALL,
+    RANGE_ENTRIES,
+    RANGE_EPOCHS
+};
+
+struct Options {
+    const char *input;
+    const char *output;
+    RangeMode mode;
+    uint64_t first; // Range [first, last) of entries or epochs
+    uint64_t last;
+    vector<uint32_t> cpus; // Input CPU of every output CPU, empty for all
+    uint64_t period; // Keep length out of every period entries
+    uint64_t length;
+    uint64_t epoch_period; // Keep every epoch_period-th epoch
+};
+
+/*
+ * Where a CPU is in the input trace. An entry belongs to epoch k when k
+ * barriers come before it; a barrier itself ends the epoch it belongs to.
+ */
+struct CpuState {
+    uint32_t in_pid;
+    uint32_t out_pid;
+    uint64_t pos;   // Index of the next entry
+    uint64_t epoch; // Number of barriers read so far
+    uint64_t start; // Index of the first entry in the range
+    bool started;   // The range has been reached
+    bool done;      // The range has been passed or the trace ended
+    bool ended;     // Nothing is read from the trace anymore
+
+    // Entries after a barrier of which it is not known yet whether every
+    // CPU reaches it within the range. The queue starts with that barrier,
+    // held_epoch is its number.
+    deque<TraceFile::PackedEntry> held;
+    uint64_t held_epoch;
+};
+
+class Slicer {
+    public:
+    Slicer(const Options &opt, TraceFile &trace, TraceWriter &writer);
+
+    // Reads the input up to the end of the range and writes the slice
+    void run();
+
+    private:
+    const Options &m_opt;
+    TraceFile &m_trace;
+    TraceWriter &m_writer;
+    vector<CpuState> m_cpus;
+    vector<uint32_t> m_drained; // Input CPUs that are read but not written
+    uint64_t m_skip_barriers;   // Barriers before this epoch are dropped
+
+    // Positions every CPU at the start of the range when the input has an
+    // index, returns false if the input has to be read up to it.
+    bool seek_to_range();
+
+    void process(CpuState &c, TraceFile::PackedEntry pe);
+    void process_barrier(CpuState &c, TraceFile::PackedEntry pe);
+
+    // Returns 1 if every CPU reaches barrier k within the range, 0 if one
+    // does not, -1 if this is not known yet.
+    int barrier_reached(uint64_t k) const;
+
+    // Writes or drops the held entries that can be decided on
+    void release(CpuState &c);
+
+    bool sampled(const CpuState &c) const;
+};
+
+Slicer::Slicer(const Options &opt, TraceFile &trace, TraceWriter &writer)
+: m_opt(opt), m_trace(trace), m_writer(writer), m_skip_barriers(0) {
+    vector<bool> selected(trace.get_proc_count(), opt.cpus.empty());
+    for (size_t i = 0; i < opt.cpus.size(); i++) {
+        if (opt.cpus[i] >= trace.get_proc_count()) {
+            throw invalid_argument("The trace has only " +
+                                   to_string(trace.get_proc_count()) + " CPUs");
+        }
+        selected[opt.cpus[i]] = true;
+    }
+
+    size_t out_count = opt.cpus.empty() ? trace.get_proc_count() : opt.cpus.size();
+    m_cpus.resize(out_count);
+    for (uint32_t out = 0; out < out_count; out++) {
+        CpuState &c = m_cpus[out];
+        c.in_pid = opt.cpus.empty() ? out : opt.cpus[out];
+        c.out_pid = out;
+        c.pos = 0;
+        c.epoch = 0;
+        c.start = 0;
+        c.started = false;
+        c.done = false;
+        c.ended = false;
+        c.held_epoch = 0;
+    }
+
+    // A pipe only buffers a limited part of every CPU's trace, so the CPUs
+    // that are left out, or are past the range, still have to be read along.
+    if (!trace.is_mapped()) {
+        for (uint32_t pid = 0; pid < trace.get_proc_count(); pid++) {
+            if (!selected[pid]) {
+                m_drained.push_back(pid);
+            }
+        }
+    }
+}
+
+bool Slicer::seek_to_range() {
+    if (m_opt.mode == RANGE_ALL || m_opt.first == 0 || !m_trace.has_index()) {
+        return false;
+    }
+
+    if (m_opt.mode == RANGE_EPOCHS) {
+        if (m_opt.first >= m_trace.get_epoch_count()) {
+            for (size_t i = 0; i < m_cpus.size(); i++) {
+                m_cpus[i].done = true;
+            }
+            return true;
+        }
+        m_trace.seek_to_epoch(m_opt.first);
+    } else {
+        m_trace.seek_to_entry(m_opt.first);
+    }
+
+    // The barrier positions are needed to continue the bookkeeping
+    ifstream input(m_opt.input, ios::in | ios::binary | ios::ate);
+    TraceIndex index;
+    uint64_t data_end;
+    if (!input.is_open() || !index.read(input, input.tellg(), data_end)) {
+        throw runtime_error(string("Unable to read the index of ") + m_opt.input);
+    }
+
+    for (size_t i = 0; i < m_cpus.size(); i++) {
+        CpuState &c = m_cpus[i];
+        if (m_opt.mode == RANGE_EPOCHS) {
+            c.epoch = m_opt.first;
+            c.pos = index.get_barrier(c.in_pid, c.epoch - 1) + 1;
+        } else {
+            // Count the barriers before the first entry
+            uint64_t lo = 0, hi = index.get_barrier_count(c.in_pid);
+            while (lo < hi) {
+                uint64_t mid = (lo + hi) / 2;
+                if (index.get_barrier(c.in_pid, mid) < m_opt.first) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            c.epoch = lo;
+            c.pos = m_opt.first;
+            if (c.pos >= index.get_entry_count(c.in_pid)) {
+                c.done = true;
+                c.ended = true;
+            }
+        }
+    }
+    return true;
+}
+
+void Slicer::run() {
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+    bool seeked = seek_to_range();
+
+    // In an entry range, barriers that some CPU passed before the range are
+    // dropped. Every CPU is read up to the range before any of them
+    // continues, so that number is known when the first barrier in the
+    // range comes by.
+    bool before = m_opt.mode == RANGE_ENTRIES && !seeked;
+    if (m_opt.mode == RANGE_ENTRIES && seeked) {
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            m_skip_barriers = max(m_skip_barriers, m_cpus[i].epoch);
+        }
+    }
+
+    while (true) {
+        bool active = false;
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            CpuState &c = m_cpus[i];
+            if (c.done || (before && c.pos >= m_opt.first)) {
+                continue;
+            }
+            active = true;
+
+            size_t n = BATCH_SIZE;
+            if (m_opt.mode == RANGE_ENTRIES) {
+                uint64_t limit = before ? m_opt.first : m_opt.last;
+                n = min<uint64_t>(n, limit - c.pos);
+            }
+            n = m_trace.next_batch(c.in_pid, batch.data(), n);
+            if (n == 0) {
+                // The trace stops without an end tag
+                c.done = true;
+                c.ended = true;
+            }
+            for (size_t k = 0; k < n && !c.done; k++) {
+                process(c, batch[k]);
+            }
+            if (m_opt.mode == RANGE_ENTRIES && c.pos >= m_opt.last) {
+                c.done = true;
+            }
+            if (c.done && !c.ended && !m_trace.is_mapped()) {
+                m_drained.push_back(c.in_pid);
+                c.ended = true;
+            }
+        }
+
+        if (!active) {
+            if (!before) {
+                break;
+            }
+            before = false;
+            for (size_t i = 0; i < m_cpus.size(); i++) {
+                m_skip_barriers = max(m_skip_barriers, m_cpus[i].epoch);
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i < m_drained.size(); i++) {
+            if (m_trace.next_batch(m_drained[i], batch.data(), batch.size()) == 0) {
+                m_drained.erase(m_drained.begin() + i--);
+            }
+        }
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            release(m_cpus[i]);
+        }
+    }
+
+    for (size_t i = 0; i < m_cpus.size(); i++) {
+        release(m_cpus[i]);
+    }
+}
+
+void Slicer::process(CpuState &c, TraceFile::PackedEntry pe) {
+    uint64_t pos = c.pos++;
+
+    if (!c.started) {
+        if (m_opt.mode == RANGE_ENTRIES ? pos >= m_opt.first :
+            m_opt.mode == RANGE_EPOCHS ? c.epoch >= m_opt.first : true) {
+            c.started = true;
+            c.start = pos;
+        }
+    }
+
+    switch (pe.type()) {
+    case TraceFile::ENTRY_TYPE_END:
+        c.done = true;
+        c.ended = true;
+        return;
+    case TraceFile::ENTRY_TYPE_BARRIER:
+        process_barrier(c, pe);
+        return;
+    default:
+        break;
+    }
+
+    if (!c.started || !sampled(c)) {
+        return;
+    }
+    if (m_opt.mode == RANGE_EPOCHS && (c.epoch - m_opt.first) % m_opt.epoch_period != 0) {
+        return;
+    }
+    if (!c.held.empty()) {
+        c.held.push_back(pe);
+    } else {
+        m_writer.add(c.out_pid, pe);
+    }
+}
+
+void Slicer::process_barrier(CpuState &c, TraceFile::PackedEntry pe) {
+    uint64_t k = c.epoch++;
+
+    if (m_opt.mode == RANGE_EPOCHS) {
+        // Barrier k starts epoch k + 1. Kept epochs are separated by a
+        // single barrier, the barriers of the epochs in between are dropped.
+        uint64_t next = k + 1;
+        if (next >= m_opt.last) {
+            c.done = true;
+        } else if (next > m_opt.first && (next - m_opt.first) % m_opt.epoch_period == 0) {
+            m_writer.add(c.out_pid, pe);
+        }
+        return;
+    }
+    if (m_opt.mode == RANGE_ALL) {
+        m_writer.add(c.out_pid, pe);
+        return;
+    }
+
+    // Entry range: CPUs reach the end of the range in different epochs, only
+    // the barriers that all of them reach are kept.
+    if (!c.started || k < m_skip_barriers) {
+        return;
+    }
+    if (!c.held.empty()) {
+        c.held.push_back(pe);
+        return;
+    }
+    int reached = barrier_reached(k);
+    if (reached == 1) {
+        m_writer.add(c.out_pid, pe);
+    } else if (reached == -1) {
+        c.held.push_back(pe);
+        c.held_epoch = k;
+    }
+}
+
+int Slicer::barrier_reached(uint64_t k) const {
+    int reached = 1;
+    for (size_t i = 0; i < m_cpus.size(); i++) {
+        if (m_cpus[i].epoch <= k) {
+            if (m_cpus[i].done) {
+                return 0;
+            }
+            reached = -1;
+        }
+    }
+    return reached;
+}
+
+void Slicer::release(CpuState &c) {
+    while (!c.held.empty()) {
+        int reached = barrier_reached(c.held_epoch);
+        if (reached == -1) {
+            return;
+        }
+
+        // The queue starts with the barrier, write the entries up to the next
+        if (reached == 1) {
+            m_writer.add(c.out_pid, c.held.front());
+        }
+        c.held.pop_front();
+        while (!c.held.empty() && c.held.front().type() != TraceFile::ENTRY_TYPE_BARRIER) {
+            m_writer.add(c.out_pid, c.held.front());
+            c.held.pop_front();
+        }
+        c.held_epoch++;
+    }
+}
+
+bool Slicer::sampled(const CpuState &c) const {
+    return (c.pos - 1 - c.start) % m_opt.period < m_opt.length;
+}
+
+static void usage(const char *name) {
+    throw invalid_argument(string("Usage: ") + name + " [options] [input] [output]\n"
+        "Writes a slice of a trace as a 5TRF trace\n"
+        "  --entries=A:B       Entries A up to B of every CPU\n"
+        "  --epochs=A:B        Barrier epochs A up to B\n"
+        "  --cpus=C,...        Only these CPUs, numbered in this order\n"
+        "  --sample=P[:L]      Keep L (default 1) out of every P entries\n"
+        "  --sample-epochs=N   Keep every N-th barrier epoch\n"
+        "B may be left out to slice up to the end of the trace");
+}
+
+// Parses A:B, where B may be missing
+static void parse_range(const string &value, uint64_t &first, uint64_t &last) {
+    size_t colon = value.find(':');
+    if (colon == string::npos) {
+        throw invalid_argument("A range is written as first:last");
+    }
+    first = stoull(value.substr(0, colon));
+    last = colon + 1 < value.size() ? stoull(value.substr(colon + 1)) : NO_LIMIT;
+    if (last <= first) {
+        throw invalid_argument("The range " + value + " is empty");
+    }
+}
+
+static Options parse_options(int argc, char *argv[]) {
+    Options opt;
+    opt.input = NULL;
+    opt.output = NULL;
+    opt.mode = RANGE_ALL;
+    opt.first = 0;
+    opt.last = NO_LIMIT;
+    opt.period = 1;
+    opt.length = 1;
+    opt.epoch_period = 1;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 10, "--entries=") == 0 || arg.compare(0, 9, "--epochs=") == 0) {
+            if (opt.mode != RANGE_ALL) {
+                throw invalid_argument("Only one range can be given");
+            }
+            opt.mode = arg.compare(0, 10, "--entries=") == 0 ? RANGE_ENTRIES : RANGE_EPOCHS;
+            parse_range(value, opt.first, opt.last);
+        } else if (arg.compare(0, 7, "--cpus=") == 0) {
+            size_t pos = 0;
+            while (pos <= value.size()) {
+                size_t comma = value.find(',', pos);
+                if (comma == string::npos) {
+                    comma = value.size();
+                }
+                uint32_t cpu = stoul(value.substr(pos, comma - pos));
+                for (size_t k = 0; k < opt.cpus.size(); k++) {
+                    if (opt.cpus[k] == cpu) {
+                        throw invalid_argument("CPU " + to_string(cpu) + " is given twice");
+                    }
+                }
+                opt.cpus.push_back(cpu);
+                pos = comma + 1;
+            }
+        } else if (arg.compare(0, 9, "--sample=") == 0) {
+            size_t colon = value.find(':');
+            opt.period = stoull(value.substr(0, colon));
+            opt.length = colon != string::npos ? stoull(value.substr(colon + 1)) : 1;
+            if (opt.length == 0 || opt.length > opt.period) {
+                throw invalid_argument("Sampling keeps 1 up to P out of every P entries");
+            }
+        } else if (arg.compare(0, 16, "--sample-epochs=") == 0) {
+            opt.epoch_period = stoull(value);
+            if (opt.epoch_period == 0) {
+                throw invalid_argument("The epoch sampling period must be at least 1");
+            }
+        } else if (opt.input == NULL && (arg == "-" || arg.compare(0, 2, "--") != 0)) {
+            opt.input = argv[i];
+        } else if (opt.output == NULL && arg.compare(0, 2, "--") != 0) {
+            opt.output = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (opt.input == NULL || opt.output == NULL) {
+        usage(argv[0]);
+    }
+    if (opt.epoch_period > 1) {
+        if (opt.mode == RANGE_ENTRIES) {
+            throw invalid_argument("Epochs can not be sampled within an entry range");
+        }
+        opt.mode = RANGE_EPOCHS;
+    }
+    return opt;
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        Options opt = parse_options(argc, argv);
+
+        TraceFile trace(opt.input);
+        size_t out_count = opt.cpus.empty() ? trace.get_proc_count() : opt.cpus.size();
+        TraceWriter writer(opt.output, out_count);
+        if (trace.get_header() != NULL) {
+            writer.set_description(*trace.get_header());
+        }
+        Slicer slicer(opt, trace, writer);
+        slicer.run();
+        writer.close();
+
+        cout << "Wrote " << writer.get_entry_count() << " entries for " << out_count
+             << " CPUs to " << opt.output << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,659 @@
+/*
+ * File: trf_stat.cpp
+ *
+ * Analyses a tracefile in a single pass, reading it through TraceFile so any
+ * trace the simulators accept works (5TRF, 5TRZ, pipes). Reports per CPU:
+ *   - the number of reads, writes, instruction fetches, atomic RMWs, fences,
+ *     NOPs and barriers
+ *   - the data footprint in unique cache lines, for several line sizes
+ *   - a histogram of the strides between consecutive memory accesses
+ * and for the whole trace the working set (unique lines) in consecutive
+ * windows of entries. Output is a text report, CSV or JSON. The text report
+ * also shows the workload description of a trace with a version 2 header.
+ *
+ * With --print the entries are printed instead, like scripts/trace_printer.py.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <systemc>
+
+#include "psa.h"
+#include "trace_header.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE = 4096;
+
+static const char *type_names[] = {
+    "NOP", "READ", "WRITE", "END", "BARRIER", "IFETCH", "RMW", "FENCE"
+};
+
+/*
+ * Counts occurrences of 64 bit keys. Open addressing with linear probing,
+ * which is a lot faster than std::unordered_map for the tens of millions of
+ * lookups in a large trace.
+ */
+class CountTable {
+    public:
+    CountTable() : m_keys(16), m_counts(16, 0), m_used(0), m_shift(60) {}
+
+    // Counts key, returns true if it was not in the table yet
+    bool add(uint64_t key) {
+        size_t mask = m_keys.size() - 1;
+        size_t i = (key * 0x9E3779B97F4A7C15ULL) >> m_shift;
+        while (m_counts[i] != 0) {
+            if (m_keys[i] == key) {
+                m_counts[i]++;
+                return false;
+            }
+            i = (i + 1) & mask;
+        }
+        insert(key, 1);
+        return true;
+    }
+
+    size_t size() const { return m_used; }
+
+    // Returns the count of key, 0 if it is not in the table
+    uint64_t get(uint64_t key) const {
+        size_t mask = m_keys.size() - 1;
+        size_t i = (key * 0x9E3779B97F4A7C15ULL) >> m_shift;
+        while (m_counts[i] != 0) {
+            if (m_keys[i] == key) {
+                return m_counts[i];
+            }
+            i = (i + 1) & mask;
+        }
+        return 0;
+    }
+
+    // Adds key with a count > 0, key must not be in the table yet
+    void insert(uint64_t key, uint64_t count) {
+        size_t mask = m_keys.size() - 1;
+        size_t i = (key * 0x9E3779B97F4A7C15ULL) >> m_shift;
+        while (m_counts[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        m_keys[i] = key;
+        m_counts[i] = count;
+        if (++m_used * 2 > m_keys.size()) {
+            grow();
+        }
+    }
+
+    // Returns the keys with the highest counts, most frequent first
+    vector<pair<uint64_t, uint64_t> > top(size_t n) const {
+        vector<pair<uint64_t, uint64_t> > all;
+        for (size_t i = 0; i < m_keys.size(); i++) {
+            if (m_counts[i] != 0) {
+                all.push_back(make_pair(m_keys[i], m_counts[i]));
+            }
+        }
+        n = min(n, all.size());
+        partial_sort(all.begin(), all.begin() + n, all.end(),
+                     [](const pair<uint64_t, uint64_t> &a, const pair<uint64_t, uint64_t> &b) {
+                         return a.second > b.second || (a.second == b.second && a.first < b.first);
+                     });
+        all.resize(n);
+        return all;
+    }
+
+    private:
+    vector<uint64_t> m_keys;
+    vector<uint64_t> m_counts; // 0 marks an empty slot
+    size_t m_used;
+    int m_shift;
+
+    void grow() {
+        vector<uint64_t> keys, counts;
+        keys.swap(m_keys);
+        counts.swap(m_counts);
+        m_keys.resize(keys.size() * 2);
+        m_counts.assign(keys.size() * 2, 0);
+        m_shift--;
+
+        size_t mask = m_keys.size() - 1;
+        for (size_t j = 0; j < keys.size(); j++) {
+            if (counts[j] == 0) {
+                continue;
+            }
+            size_t i = (keys[j] * 0x9E3779B97F4A7C15ULL) >> m_shift;
+            while (m_counts[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            m_keys[i] = keys[j];
+            m_counts[i] = counts[j];
+        }
+    }
+};
+
+/*
+ * Set of cache line numbers, kept as a bitmap per page of lines. Traces
+ * touch lines close to each other, so most lookups hit the last used page
+ * and need a single bit test.
+ */
+class LineSet {
+    public:
+    LineSet() : m_count(0), m_last_page(UINT64_MAX), m_last(NULL) {}
+
+    // Adds line, returns true if it was not in the set yet
+    bool add(uint64_t line) {
+        uint64_t page = line >> page_bits;
+        if (page != m_last_page) {
+            m_last = find_page(page);
+            m_last_page = page;
+        }
+        uint64_t &word = m_last[(line >> 6) & (page_words - 1)];
+        uint64_t bit = 1ULL << (line & 63);
+        if (word & bit) {
+            return false;
+        }
+        word |= bit;
+        m_count++;
+        return true;
+    }
+
+    size_t size() const { return m_count; }
+
+    void clear() {
+        for (size_t i = 0; i < m_pages.size(); i++) {
+            fill(m_pages[i].begin(), m_pages[i].end(), 0);
+        }
+        m_count = 0;
+    }
+
+    private:
+    static const int page_bits = 15; // Lines per page, 4 KiB of bits
+    static const size_t page_words = (1 << page_bits) / 64;
+
+    vector<vector<uint64_t> > m_pages;
+    CountTable m_page_ids; // Page number to index in m_pages + 1
+    size_t m_count;
+    uint64_t m_last_page;
+    uint64_t *m_last;
+
+    uint64_t *find_page(uint64_t page) {
+        uint64_t id = m_page_ids.get(page);
+        if (id == 0) {
+            m_pages.push_back(vector<uint64_t>(page_words, 0));
+            id = m_pages.size();
+            m_page_ids.insert(page, id);
+        }
+        return m_pages[id - 1].data();
+    }
+};
+
+// Strides up to this size are counted exactly, larger ones per power of 2
+static const int64_t max_exact_stride = 1 << 20;
+
+// Key under which a stride is counted. Large strides are mapped to the top
+// of the key range, by sign and number of bits.
+static uint64_t stride_key(int64_t stride) {
+    if (stride > -max_exact_stride && stride < max_exact_stride) {
+        return stride;
+    }
+    uint64_t magnitude = stride < 0 ? -(uint64_t)stride : stride;
+    return (0xFFULL << 56) | (stride < 0 ? 0x100 : 0) | (63 - __builtin_clzll(magnitude));
+}
+
+static string stride_label(uint64_t key) {
+    if ((key >> 56) != 0xFF || (int64_t)key > -max_exact_stride) {
+        return to_string((int64_t)key);
+    }
+    // Bucket of all strides of 2^bits up to 2^(bits+1) bytes
+    string sign = (key & 0x100) ? "-" : "";
+    return sign + "2^" + to_string(key & 0xFF);
+}
+
+struct Options {
+    const char *filename;
+    vector<uint64_t> line_sizes;
+    uint64_t window;
+    size_t top;
+    string format;
+    bool print;
+    bool hex;
+};
+
+struct CpuStats {
+    uint64_t counts[8];
+    uint64_t entries;
+    uint64_t last_addr;
+    bool has_last;
+    CountTable strides;
+    vector<LineSet> lines; // One per line size
+};
+
+struct WindowStats {
+    uint64_t first_entry;
+    uint64_t lines;
+};
+
+struct Results {
+    vector<CpuStats> cpus;
+    vector<LineSet> lines; // Footprint of all CPUs together
+    vector<WindowStats> windows;
+    double seconds;
+    string workload; // Description from the trace header, if any
+};
+
+static void usage(const char *name) {
+    throw invalid_argument(string("Usage: ") + name + " [options] [trace_file]\n"
+        "  --lines=32,64,...  Line sizes in bytes for the footprint (powers of 2)\n"
+        "  --window=N         Entries per CPU in a working set window\n"
+        "  --top=N            Number of strides in the histogram\n"
+        "  --format=F         text, csv or json\n"
+        "  --print [--hex]    Print the entries instead");
+}
+
+static Options parse_options(int argc, char *argv[]) {
+    Options opt;
+    opt.filename = NULL;
+    opt.line_sizes = {32, 64, 128};
+    opt.window = 100000;
+    opt.top = 16;
+    opt.format = "text";
+    opt.print = false;
+    opt.hex = false;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 8, "--lines=") == 0) {
+            opt.line_sizes.clear();
+            size_t pos = 0;
+            while (pos <= value.size()) {
+                size_t comma = value.find(',', pos);
+                if (comma == string::npos) {
+                    comma = value.size();
+                }
+                uint64_t size = stoull(value.substr(pos, comma - pos));
+                if (size == 0 || (size & (size - 1)) != 0) {
+                    throw invalid_argument("Line sizes must be powers of 2");
+                }
+                opt.line_sizes.push_back(size);
+                pos = comma + 1;
+            }
+            sort(opt.line_sizes.begin(), opt.line_sizes.end());
+            opt.line_sizes.erase(unique(opt.line_sizes.begin(), opt.line_sizes.end()),
+                                 opt.line_sizes.end());
+        } else if (arg.compare(0, 9, "--window=") == 0) {
+            opt.window = stoull(value);
+            if (opt.window == 0) {
+                throw invalid_argument("The window must hold at least 1 entry");
+            }
+        } else if (arg.compare(0, 6, "--top=") == 0) {
+            opt.top = stoull(value);
+        } else if (arg.compare(0, 9, "--format=") == 0) {
+            opt.format = value;
+            if (value != "text" && value != "csv" && value != "json") {
+                usage(argv[0]);
+            }
+        } else if (arg == "--print") {
+            opt.print = true;
+        } else if (arg == "--hex") {
+            opt.hex = true;
+        } else if (opt.filename == NULL && (arg == "-" || arg.compare(0, 2, "--") != 0)) {
+            opt.filename = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (opt.filename == NULL) {
+        usage(argv[0]);
+    }
+    return opt;
+}
+
+// Prints all entries, in the round-robin order of the 5TRF format
+static void print_trace(const Options &opt) {
+    TraceFile trace(opt.filename);
+    uint32_t procs = trace.get_proc_count();
+    vector<vector<TraceFile::PackedEntry> > batches(procs, vector<TraceFile::PackedEntry>(BATCH_SIZE));
+    vector<size_t> sizes(procs, 0);
+
+    cout << "5TRF " << procs << "\n";
+
+    bool more = true;
+    while (more) {
+        more = false;
+        for (uint32_t pid = 0; pid < procs; pid++) {
+            sizes[pid] = trace.next_batch(pid, batches[pid].data(), BATCH_SIZE);
+            more = more || sizes[pid] > 0;
+        }
+        for (size_t i = 0; i < BATCH_SIZE && more; i++) {
+            for (uint32_t pid = 0; pid < procs; pid++) {
+                if (i < sizes[pid]) {
+                    const TraceFile::PackedEntry &pe = batches[pid][i];
+                    cout << "P" << pid << " " << type_names[pe.type()] << " ";
+                    if (opt.hex) {
+                        cout << "0x" << hex << pe.addr() << dec;
+                    } else {
+                        cout << pe.addr();
+                    }
+                    if (pe.size() > 1) {
+                        cout << " (" << pe.size() << " B)";
+                    }
+                    cout << "\n";
+                }
+            }
+        }
+    }
+    cout << flush;
+}
+
+static void analyse(const Options &opt, Results &res) {
+    TraceFile trace(opt.filename);
+    uint32_t procs = trace.get_proc_count();
+    size_t num_sizes = opt.line_sizes.size();
+
+    vector<int> line_shifts;
+    for (size_t s = 0; s < num_sizes; s++) {
+        line_shifts.push_back(__builtin_ctzll(opt.line_sizes[s]));
+    }
+
+    res.cpus.resize(procs);
+    for (uint32_t pid = 0; pid < procs; pid++) {
+        CpuStats &c = res.cpus[pid];
+        memset(c.counts, 0, sizeof(c.counts));
+        c.entries = 0;
+        c.last_addr = 0;
+        c.has_last = false;
+        c.lines.resize(num_sizes);
+    }
+    res.lines.resize(num_sizes);
+
+    // The header tells the number of windows up front
+    const TraceHeader *header = trace.get_header();
+    if (header != NULL) {
+        res.workload = header->get_workload();
+        if (!header->get_params().empty()) {
+            res.workload += " (" + header->get_params() + ")";
+        }
+        if (header->get_line_size() != 0) {
+            res.workload += ", " + to_string(header->get_line_size()) + " B lines";
+        }
+        uint64_t longest = 0;
+        for (uint32_t pid = 0; pid < procs && header->has_counts(); pid++) {
+            longest = max(longest, header->get_entry_count(pid));
+        }
+        res.windows.reserve(longest / opt.window + 1);
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<TraceFile::PackedEntry> batch(BATCH_SIZE);
+    LineSet window_lines;
+    uint64_t first_entry = 0;
+    bool more = true;
+
+    // Every window takes the next opt.window entries of every CPU
+    while (more) {
+        more = false;
+        window_lines.clear();
+
+        for (uint32_t pid = 0; pid < procs; pid++) {
+            CpuStats &c = res.cpus[pid];
+            uint64_t left = opt.window;
+            size_t n;
+
+            while (left > 0 &&
+                   (n = trace.next_batch(pid, batch.data(), min<uint64_t>(left, BATCH_SIZE))) > 0) {
+                left -= n;
+                c.entries += n;
+                more = true;
+
+                for (size_t i = 0; i < n; i++) {
+                    uint32_t type = batch[i].type();
+                    c.counts[type]++;
+                    if (type != TraceFile::ENTRY_TYPE_READ && type != TraceFile::ENTRY_TYPE_WRITE &&
+                        type != TraceFile::ENTRY_TYPE_RMW) {
+                        continue;
+                    }
+
+                    uint64_t addr = batch[i].addr();
+                    if (c.has_last) {
+                        c.strides.add(stride_key(addr - c.last_addr));
+                    }
+                    c.last_addr = addr;
+                    c.has_last = true;
+
+                    // An access that crosses a line boundary touches every
+                    // line it covers
+                    uint64_t last = (addr + batch[i].size() - 1) >> line_shifts[0];
+                    for (uint64_t line0 = addr >> line_shifts[0]; line0 <= last; line0++) {
+                        window_lines.add(line0);
+
+                        // A line that was seen before is also seen at larger sizes
+                        for (size_t s = 0; s < num_sizes; s++) {
+                            uint64_t line = (line0 << line_shifts[0]) >> line_shifts[s];
+                            if (!c.lines[s].add(line)) {
+                                break;
+                            }
+                            res.lines[s].add(line);
+                        }
+                    }
+                }
+            }
+        }
+
+        if (more) {
+            WindowStats w;
+            w.first_entry = first_entry;
+            w.lines = window_lines.size();
+            res.windows.push_back(w);
+            first_entry += opt.window;
+        }
+    }
+
+    res.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t total_entries(const Results &res) {
+    uint64_t entries = 0;
+    for (size_t i = 0; i < res.cpus.size(); i++) {
+        entries += res.cpus[i].entries;
+    }
+    return entries;
+}
+
+static void print_text(const Options &opt, const Results &res) {
+    size_t w = 10;
+    cout << "Trace: " << opt.filename << ", " << res.cpus.size() << " CPUs" << endl;
+    if (!res.workload.empty()) {
+        cout << "Workload: " << res.workload << endl;
+    }
+    // Instruction fetches, RMWs and fences get a column in traces that have
+    // them
+    bool fetches = false;
+    bool atomics = false;
+    for (size_t pid = 0; pid < res.cpus.size(); pid++) {
+        const CpuStats &c = res.cpus[pid];
+        fetches = fetches || c.counts[TraceFile::ENTRY_TYPE_IFETCH] > 0;
+        atomics = atomics || c.counts[TraceFile::ENTRY_TYPE_RMW] > 0 ||
+                  c.counts[TraceFile::ENTRY_TYPE_FENCE] > 0;
+    }
+    size_t columns = 6 + (fetches ? 1 : 0) + (atomics ? 2 : 0);
+
+    cout << setw(w) << "CPU" << setw(w) << "Entries" << setw(w) << "Reads" << setw(w) << "Writes";
+    if (fetches) {
+        cout << setw(w) << "IFetches";
+    }
+    if (atomics) {
+        cout << setw(w) << "RMWs" << setw(w) << "Fences";
+    }
+    cout << setw(w) << "NOPs" << setw(w) << "Barriers";
+    for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+        cout << setw(w) << ("Lines" + to_string(opt.line_sizes[s]));
+    }
+    cout << endl;
+
+    for (size_t pid = 0; pid < res.cpus.size(); pid++) {
+        const CpuStats &c = res.cpus[pid];
+        cout << setw(w) << pid << setw(w) << c.entries
+             << setw(w) << c.counts[TraceFile::ENTRY_TYPE_READ]
+             << setw(w) << c.counts[TraceFile::ENTRY_TYPE_WRITE];
+        if (fetches) {
+            cout << setw(w) << c.counts[TraceFile::ENTRY_TYPE_IFETCH];
+        }
+        if (atomics) {
+            cout << setw(w) << c.counts[TraceFile::ENTRY_TYPE_RMW]
+                 << setw(w) << c.counts[TraceFile::ENTRY_TYPE_FENCE];
+        }
+        cout << setw(w) << c.counts[TraceFile::ENTRY_TYPE_NOP]
+             << setw(w) << c.counts[TraceFile::ENTRY_TYPE_BARRIER];
+        for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+            cout << setw(w) << c.lines[s].size();
+        }
+        cout << endl;
+    }
+
+    cout << setw(w) << "All" << setw(w * columns - w) << "";
+    for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+        cout << setw(w) << res.lines[s].size();
+    }
+    cout << endl << endl;
+
+    for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+        cout << "Footprint with " << opt.line_sizes[s] << " B lines: "
+             << res.lines[s].size() * opt.line_sizes[s] << " B" << endl;
+    }
+    cout << endl;
+
+    for (size_t pid = 0; pid < res.cpus.size(); pid++) {
+        cout << "CPU " << pid << " strides (bytes: count):";
+        vector<pair<uint64_t, uint64_t> > top = res.cpus[pid].strides.top(opt.top);
+        for (size_t i = 0; i < top.size(); i++) {
+            cout << " " << stride_label(top[i].first) << ": " << top[i].second;
+        }
+        cout << endl;
+    }
+    cout << endl;
+
+    cout << "Working set per window of " << opt.window << " entries per CPU ("
+         << opt.line_sizes[0] << " B lines)" << endl;
+    cout << setw(w) << "Window" << setw(w + 2) << "FirstEntry" << setw(w) << "Lines"
+         << setw(w + 2) << "Bytes" << endl;
+    for (size_t i = 0; i < res.windows.size(); i++) {
+        cout << setw(w) << i << setw(w + 2) << res.windows[i].first_entry
+             << setw(w) << res.windows[i].lines
+             << setw(w + 2) << res.windows[i].lines * opt.line_sizes[0] << endl;
+    }
+    cout << endl;
+
+    cout << "Analysed " << total_entries(res) << " entries in " << fixed << setprecision(3)
+         << res.seconds << " s (" << setprecision(1)
+         << total_entries(res) / res.seconds / 1e6 << " M entries/s)" << endl;
+}
+
+// One row per value: metric,cpu,key,value
+static void print_csv(const Options &opt, const Results &res) {
+    cout << "metric,cpu,key,value" << endl;
+    for (size_t pid = 0; pid < res.cpus.size(); pid++) {
+        const CpuStats &c = res.cpus[pid];
+        cout << "count," << pid << ",entries," << c.entries << endl;
+        for (int t = 0; t < 8; t++) {
+            if (c.counts[t] != 0 || t <= TraceFile::ENTRY_TYPE_BARRIER) {
+                cout << "count," << pid << "," << type_names[t] << "," << c.counts[t] << endl;
+            }
+        }
+        for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+            cout << "footprint_lines," << pid << "," << opt.line_sizes[s] << ","
+                 << c.lines[s].size() << endl;
+        }
+        vector<pair<uint64_t, uint64_t> > top = c.strides.top(opt.top);
+        for (size_t i = 0; i < top.size(); i++) {
+            cout << "stride," << pid << "," << stride_label(top[i].first) << "," << top[i].second << endl;
+        }
+    }
+    for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+        cout << "footprint_lines,all," << opt.line_sizes[s] << "," << res.lines[s].size() << endl;
+    }
+    for (size_t i = 0; i < res.windows.size(); i++) {
+        cout << "working_set_lines,all," << res.windows[i].first_entry << ","
+             << res.windows[i].lines << endl;
+    }
+}
+
+static void print_json(const Options &opt, const Results &res) {
+    cout << "{\n  \"trace\": \"";
+    for (const char *p = opt.filename; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            cout << '\\';
+        }
+        cout << *p;
+    }
+    cout << "\",\n  \"cpus\": " << res.cpus.size() << ",\n  \"line_sizes\": [";
+    for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+        cout << (s ? ", " : "") << opt.line_sizes[s];
+    }
+    cout << "],\n  \"window\": " << opt.window << ",\n  \"per_cpu\": [\n";
+
+    for (size_t pid = 0; pid < res.cpus.size(); pid++) {
+        const CpuStats &c = res.cpus[pid];
+        cout << "    {\"cpu\": " << pid << ", \"entries\": " << c.entries
+             << ", \"reads\": " << c.counts[TraceFile::ENTRY_TYPE_READ]
+             << ", \"writes\": " << c.counts[TraceFile::ENTRY_TYPE_WRITE]
+             << ", \"ifetches\": " << c.counts[TraceFile::ENTRY_TYPE_IFETCH]
+             << ", \"rmws\": " << c.counts[TraceFile::ENTRY_TYPE_RMW]
+             << ", \"fences\": " << c.counts[TraceFile::ENTRY_TYPE_FENCE]
+             << ", \"nops\": " << c.counts[TraceFile::ENTRY_TYPE_NOP]
+             << ", \"barriers\": " << c.counts[TraceFile::ENTRY_TYPE_BARRIER]
+             << ", \"footprint_lines\": {";
+        for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+            cout << (s ? ", " : "") << "\"" << opt.line_sizes[s] << "\": " << c.lines[s].size();
+        }
+        cout << "}, \"strides\": [";
+        vector<pair<uint64_t, uint64_t> > top = c.strides.top(opt.top);
+        for (size_t i = 0; i < top.size(); i++) {
+            cout << (i ? ", " : "") << "{\"stride\": \"" << stride_label(top[i].first) << "\""
+                 << ", \"count\": " << top[i].second << "}";
+        }
+        cout << "]}" << (pid + 1 < res.cpus.size() ? "," : "") << "\n";
+    }
+
+    cout << "  ],\n  \"footprint_lines\": {";
+    for (size_t s = 0; s < opt.line_sizes.size(); s++) {
+        cout << (s ? ", " : "") << "\"" << opt.line_sizes[s] << "\": " << res.lines[s].size();
+    }
+    cout << "},\n  \"working_set\": [";
+    for (size_t i = 0; i < res.windows.size(); i++) {
+        cout << (i ? ", " : "") << "{\"first_entry\": " << res.windows[i].first_entry
+             << ", \"lines\": " << res.windows[i].lines << "}";
+    }
+    cout << "]\n}" << endl;
+}
+
+int sc_main(int argc, char *argv[]) {
+    try {
+        Options opt = parse_options(argc, argv);
+
+        if (opt.print) {
+            print_trace(opt);
+            return 0;
+        }
+
+        Results res;
+        analyse(opt, res);
+        if (opt.format == "csv") {
+            print_csv(opt, res);
+        } else if (opt.format == "json") {
+            print_json(opt, res);
+        } else {
+            print_text(opt, res);
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}